@@ -0,0 +1,224 @@
+/*
+ * include/archive.h
+ *
+ * Asset packs: one file holding a table of contents and every asset blob,
+ * each either stored as is or LZ4 compressed (lz4block.h). A mounted pack is
+ * mapped once, so loading from it costs a few large sequential reads instead
+ * of an open and a seek per file, and a stored entry is read straight out of
+ * the mapping without a copy. tools/pack.cpp writes them.
+ *
+ * AssetFile is what the loaders read through: Shader, DecodedImage,
+ * TextureFile, cooked meshes and assimp (via ArchiveIOSystem in importer.h).
+ * It looks a path up in the mounted packs first and falls back to the file on
+ * disk, so an unpacked tree keeps working.
+ */
+
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <lz4block.h>
+#include <mappedfile.h>
+#include <trace.h>
+
+#define ARCHIVE_MAGIC "NPAK"
+#define ARCHIVE_VERSION 1
+#define ARCHIVE_EXTENSION ".npak"
+/* Blobs start on this boundary so the headers inside them can be read in place */
+#define ARCHIVE_ALIGNMENT 16
+
+enum ArchiveCompression {
+  ARCHIVE_STORED = 0,
+  ARCHIVE_LZ4 = 1
+};
+
+/*
+ * Layout: ArchiveHeader, entryCount ArchiveEntry, the string table of
+ * null terminated paths, then the blobs.
+ */
+struct ArchiveHeader {
+  char magic[4];
+  uint32_t version;
+  uint32_t entryCount;
+  uint32_t stringTableSize;
+};
+
+struct ArchiveEntry {
+  uint32_t path;        /* Offset into the string table */
+  uint32_t compression; /* ArchiveCompression */
+  uint64_t offset;      /* Of the blob, from the start of the file */
+  uint64_t storedSize;  /* Bytes in the pack */
+  uint64_t size;        /* Bytes once decompressed */
+};
+
+class AssetArchive {
+private:
+  struct Pack {
+    std::string path;
+    MappedFile file;
+    std::unordered_map<std::string, const ArchiveEntry*> entries;
+  };
+
+  inline static std::vector<std::unique_ptr<Pack>> packs;
+
+public:
+  /*
+   * Key for path inside a pack: lexically normalized with '/' separators and
+   * no leading "./", so "./resources\\a/../b.png" finds "resources/b.png".
+   */
+  static std::string normalize(const std::string& path) {
+    std::string generic = path;
+    for (char& c : generic) {
+      if (c == '\\') {
+        c = '/';
+      }
+    }
+    std::string normal = std::filesystem::path(generic).lexically_normal().generic_string();
+    while (normal.compare(0, 2, "./") == 0) {
+      normal.erase(0, 2);
+    }
+    return normal;
+  }
+
+  /*
+   * Map the pack at path and add its entries. Packs mounted later shadow
+   * earlier ones. Mount before loading anything: lookups from the loader
+   * jobs don't lock.
+   */
+  static bool mount(const std::string& path) {
+    std::unique_ptr<Pack> pack = std::make_unique<Pack>();
+    pack->path = path;
+    if (!pack->file.open(path)) {
+      std::cout << "ERROR::ARCHIVE::FILE_NOT_SUCCESSFULLY_READ: " << path << std::endl;
+      return false;
+    }
+
+    const MappedFile& file = pack->file;
+    const ArchiveHeader* header = (const ArchiveHeader*)file.data;
+    if (file.size < sizeof(ArchiveHeader) || memcmp(header->magic, ARCHIVE_MAGIC, 4) != 0 || header->version != ARCHIVE_VERSION) {
+      std::cout << "ERROR::ARCHIVE::INVALID_ARCHIVE: " << path << std::endl;
+      return false;
+    }
+
+    size_t tableEnd = sizeof(ArchiveHeader) + (size_t)header->entryCount * sizeof(ArchiveEntry) + header->stringTableSize;
+    if (tableEnd > file.size || (header->stringTableSize > 0 && file.data[tableEnd - 1] != '\0')) {
+      std::cout << "ERROR::ARCHIVE::INVALID_ARCHIVE: " << path << std::endl;
+      return false;
+    }
+
+    const ArchiveEntry* entries = (const ArchiveEntry*)(file.data + sizeof(ArchiveHeader));
+    const char* strings = (const char*)(entries + header->entryCount);
+    for (uint32_t i = 0; i < header->entryCount; ++i) {
+      const ArchiveEntry& entry = entries[i];
+      bool validCompression = entry.compression == ARCHIVE_STORED ? entry.storedSize == entry.size : entry.compression == ARCHIVE_LZ4;
+      if (entry.path >= header->stringTableSize || entry.offset > file.size || entry.storedSize > file.size - entry.offset || !validCompression) {
+        std::cout << "ERROR::ARCHIVE::INVALID_ARCHIVE: " << path << std::endl;
+        return false;
+      }
+      pack->entries[strings + entry.path] = &entry;
+    }
+
+    packs.push_back(std::move(pack));
+    return true;
+  }
+
+  static void unmountAll() {
+    packs.clear();
+  }
+
+  /* Entry for path in the most recently mounted pack holding it; file receives that pack's mapping */
+  static const ArchiveEntry* find(const std::string& path, const MappedFile*& file) {
+    if (packs.empty()) {
+      return nullptr;
+    }
+
+    std::string key = normalize(path);
+    for (auto pack = packs.rbegin(); pack != packs.rend(); ++pack) {
+      auto found = (*pack)->entries.find(key);
+      if (found != (*pack)->entries.end()) {
+        file = &(*pack)->file;
+        return found->second;
+      }
+    }
+    return nullptr;
+  }
+
+  static bool contains(const std::string& path) {
+    const MappedFile* file;
+    return find(path, file) != nullptr;
+  }
+
+  /* A path in the packs or on disk */
+  static bool exists(const std::string& path) {
+    std::error_code error;
+    return contains(path) || std::filesystem::exists(path, error);
+  }
+};
+
+/* The bytes of one asset: a view into a pack, an entry decompressed into memory, or a loose file mapped from disk */
+class AssetFile {
+private:
+  MappedFile mapped;
+  std::vector<unsigned char> decompressed;
+
+public:
+  const unsigned char* data = nullptr;
+  size_t size = 0;
+  bool packed = false; /* Whether it came from a mounted pack */
+
+  AssetFile() {}
+  AssetFile(const AssetFile&) = delete;
+  AssetFile& operator=(const AssetFile&) = delete;
+
+  bool open(const std::string& path) {
+    close();
+
+    const MappedFile* pack;
+    const ArchiveEntry* entry = AssetArchive::find(path, pack);
+    if (entry != nullptr) {
+      const unsigned char* stored = pack->data + entry->offset;
+      if (entry->compression == ARCHIVE_STORED) {
+        data = stored;
+      } else {
+        decompressed.resize(entry->size);
+        if (!LZ4Block::decompress(stored, entry->storedSize, decompressed.data(), decompressed.size())) {
+          std::cout << "ERROR::ARCHIVE::CORRUPT_ENTRY: " << path << std::endl;
+          close();
+          return false;
+        }
+        data = decompressed.data();
+      }
+      size = entry->size;
+      packed = true;
+      Trace::read(size);
+      return true;
+    }
+
+    if (!mapped.open(path)) {
+      return false;
+    }
+    data = mapped.data;
+    size = mapped.size;
+    Trace::read(size);
+    return true;
+  }
+
+  void close() {
+    mapped.close();
+    decompressed.clear();
+    decompressed.shrink_to_fit();
+    data = nullptr;
+    size = 0;
+    packed = false;
+  }
+};
+
+#endif
@@ -4,6 +4,42 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+/*
+ * Per-frame camera data, laid out to match the std140 "Camera" uniform block
+ * declared by the shaders. Written once per frame by Engine::refresh into a
+ * uniform buffer so individual draws never upload view/projection themselves.
+ */
+struct CameraUniforms {
+  glm::mat4 view;
+  glm::mat4 projection;
+  glm::mat4 viewProjection;
+  glm::vec4 position; /* w is unused; vec3 is padded to 16 bytes in std140 anyway */
+};
+
+/*
+ * The six planes bounding what a camera can see, as (normal, distance) with
+ * normals pointing inwards: a point p is inside a plane when
+ * dot(plane.xyz, p) + plane.w >= 0. Order is left, right, bottom, top, near, far.
+ */
+struct Frustum {
+  glm::vec4 planes[6];
+
+  /* Gribb/Hartmann extraction from a combined view-projection matrix */
+  void extract(const glm::mat4& viewProjection) {
+    for (int i = 0; i < 3; ++i) {
+      glm::vec4 row = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+      glm::vec4 w = glm::vec4(viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3]);
+      planes[i * 2] = w + row;
+      planes[i * 2 + 1] = w - row;
+    }
+
+    for (int i = 0; i < 6; ++i) {
+      float length = glm::length(glm::vec3(planes[i].x, planes[i].y, planes[i].z));
+      planes[i] = planes[i] * (1.0f / length);
+    }
+  }
+};
+
 struct Camera {
   glm::vec3 position;
   glm::vec3 lookVector;
@@ -14,6 +50,9 @@ struct Camera {
   float nearPlane;
   float farPlane;
 
+  /* Planes of the view volume, refreshed once per frame by updateFrustum */
+  Frustum frustum;
+
   Camera(glm::vec3 position, glm::vec3 lookVector, glm::vec3 up, float fov, float aspectRatio, float nearPlane, float farPlane)
     : position(position), 
     lookVector(lookVector), 
@@ -31,6 +70,19 @@ struct Camera {
   glm::mat4 getProjectionMatrix() {
     return glm::perspective(fov, aspectRatio, nearPlane, farPlane);
   }
+
+  CameraUniforms getUniforms() {
+    CameraUniforms uniforms;
+    uniforms.view = getViewMatrix();
+    uniforms.projection = getProjectionMatrix();
+    uniforms.viewProjection = uniforms.projection * uniforms.view;
+    uniforms.position = glm::vec4(position, 1.0f);
+    return uniforms;
+  }
+
+  void updateFrustum(const glm::mat4& viewProjection) {
+    frustum.extract(viewProjection);
+  }
 };
 
 #endif
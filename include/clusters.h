@@ -0,0 +1,337 @@
+/*
+ * include/clusters.h
+ *
+ * Clustered forward lighting. The view frustum is cut into a grid of
+ * CLUSTER_TILES_X by CLUSTER_TILES_Y screen tiles and CLUSTER_SLICES depth
+ * slices (exponentially spaced, so clusters stay roughly cubic). Every frame
+ * each point light's range sphere is tested against the clusters' view space
+ * boxes, one job per slice and four lights at a time, and the result goes to
+ * the GPU as three texture buffers:
+ *
+ *   lightData       RGBA32F, four texels per light, laid out like the Lights block
+ *   clusterRecords  RG32UI, per cluster the first entry in lightIndices and the count
+ *   lightIndices    R16UI, light numbers
+ *
+ * A fragment finds its cluster from gl_FragCoord and its view depth
+ * (src/shaders/include/clusters.glsl) and shades only those lights, so the
+ * cost per fragment follows how many lights actually reach it rather than
+ * how many there are. Turned on with Lighting::clustered.
+ */
+
+#ifndef CLUSTERS_H
+#define CLUSTERS_H
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include <camera.h>
+#include <culling.h>
+#include <globals.h>
+#include <glstate.h>
+#include <jobs.h>
+#include <lighting.h>
+#include <trace.h>
+
+/* Grid size; keep in sync with src/shaders/include/clusters.glsl */
+#define CLUSTER_TILES_X 16
+#define CLUSTER_TILES_Y 9
+#define CLUSTER_SLICES 24
+#define CLUSTER_COUNT (CLUSTER_TILES_X * CLUSTER_TILES_Y * CLUSTER_SLICES)
+/* Lights past this many in one cluster are dropped from it */
+#define CLUSTER_MAX_LIGHTS_PER_CLUSTER 128
+/* Light numbers are 16 bit */
+#define CLUSTER_MAX_LIGHTS 65535
+
+class LightClusters {
+private:
+  /* Lights overlapping one slice in view space, padded to a multiple of four with lights that reach nothing */
+  struct SliceLights {
+    std::vector<float> x, y, z, radius;
+    std::vector<uint16_t> index;
+  };
+
+  inline static unsigned int lightBuffer = 0, recordBuffer = 0, indexBuffer = 0;
+  inline static unsigned int lightTexture = 0, recordTexture = 0, indexTexture = 0;
+
+  /* View space box of every cluster, rebuilt when the projection changes */
+  inline static std::vector<glm::vec3> boxMin, boxMax;
+  inline static float sliceDepth[CLUSTER_SLICES + 1];
+  inline static float builtFov = 0.0f, builtAspect = 0.0f, builtNear = 0.0f, builtFar = 0.0f;
+
+  /* View space light spheres */
+  inline static std::vector<float> lightX, lightY, lightZ, lightRadius;
+  inline static SliceLights slices[CLUSTER_SLICES];
+
+  /* Per cluster light lists before they are packed */
+  inline static std::vector<uint32_t> counts;
+  inline static std::vector<uint16_t> lists;
+
+  /* What is uploaded */
+  inline static std::vector<glm::vec4> lightTexels;
+  inline static std::vector<uint32_t> records;
+  inline static std::vector<uint16_t> indices;
+
+  static void buildBoxes(const Camera& camera) {
+    builtFov = camera.fov;
+    builtAspect = camera.aspectRatio;
+    builtNear = camera.nearPlane;
+    builtFar = camera.farPlane;
+
+    for (int slice = 0; slice <= CLUSTER_SLICES; ++slice) {
+      sliceDepth[slice] = camera.nearPlane * std::pow(camera.farPlane / camera.nearPlane, (float)slice / CLUSTER_SLICES);
+    }
+
+    /* Half extent of the view at depth 1 */
+    float halfHeight = std::tan(camera.fov * 0.5f);
+    float halfWidth = halfHeight * camera.aspectRatio;
+
+    boxMin.resize(CLUSTER_COUNT);
+    boxMax.resize(CLUSTER_COUNT);
+    for (int slice = 0; slice < CLUSTER_SLICES; ++slice) {
+      float nearDepth = sliceDepth[slice];
+      float farDepth = sliceDepth[slice + 1];
+      for (int tileY = 0; tileY < CLUSTER_TILES_Y; ++tileY) {
+        float bottom = -1.0f + 2.0f * tileY / CLUSTER_TILES_Y;
+        float top = -1.0f + 2.0f * (tileY + 1) / CLUSTER_TILES_Y;
+        for (int tileX = 0; tileX < CLUSTER_TILES_X; ++tileX) {
+          float left = -1.0f + 2.0f * tileX / CLUSTER_TILES_X;
+          float right = -1.0f + 2.0f * (tileX + 1) / CLUSTER_TILES_X;
+
+          /* The tile's four edges at both ends of the slice; the box holds all eight corners */
+          glm::vec3 low = glm::vec3(INFINITY);
+          glm::vec3 high = glm::vec3(-INFINITY);
+          for (float depth : { nearDepth, farDepth }) {
+            for (float x : { left, right }) {
+              for (float y : { bottom, top }) {
+                glm::vec3 corner = glm::vec3(x * halfWidth * depth, y * halfHeight * depth, -depth);
+                low = glm::min(low, corner);
+                high = glm::max(high, corner);
+              }
+            }
+          }
+
+          size_t cluster = clusterIndex(tileX, tileY, slice);
+          boxMin[cluster] = low;
+          boxMax[cluster] = high;
+        }
+      }
+    }
+  }
+
+  /* Gather the lights whose sphere reaches the slice's depth range */
+  static void gatherSlice(int slice) {
+    SliceLights& lights = slices[slice];
+    lights.x.clear();
+    lights.y.clear();
+    lights.z.clear();
+    lights.radius.clear();
+    lights.index.clear();
+
+    /* View space z is negative in front of the camera */
+    float front = -sliceDepth[slice];
+    float back = -sliceDepth[slice + 1];
+    for (size_t i = 0; i < lightX.size(); ++i) {
+      if (lightZ[i] - lightRadius[i] > front || lightZ[i] + lightRadius[i] < back) {
+        continue;
+      }
+      lights.x.push_back(lightX[i]);
+      lights.y.push_back(lightY[i]);
+      lights.z.push_back(lightZ[i]);
+      lights.radius.push_back(lightRadius[i]);
+      lights.index.push_back((uint16_t)i);
+    }
+
+    while (lights.x.size() & 3) {
+      lights.x.push_back(INFINITY);
+      lights.y.push_back(INFINITY);
+      lights.z.push_back(INFINITY);
+      lights.radius.push_back(0.0f);
+      lights.index.push_back(0);
+    }
+  }
+
+  /* Append the lights of one slice to each of its clusters whose box they touch */
+  static void assignSlice(int slice) {
+    gatherSlice(slice);
+    const SliceLights& lights = slices[slice];
+    size_t lightCount = lights.x.size();
+
+    for (int tile = 0; tile < CLUSTER_TILES_X * CLUSTER_TILES_Y; ++tile) {
+      size_t cluster = (size_t)slice * CLUSTER_TILES_X * CLUSTER_TILES_Y + tile;
+      uint16_t* list = &lists[cluster * CLUSTER_MAX_LIGHTS_PER_CLUSTER];
+      uint32_t count = 0;
+      glm::vec3 low = boxMin[cluster];
+      glm::vec3 high = boxMax[cluster];
+
+      /* Sphere against box: squared distance from the centre to the box, against the squared radius */
+#ifdef NEPTUNE_CULLING_SSE
+      __m128 zero = _mm_setzero_ps();
+      __m128 lowX = _mm_set1_ps(low.x), lowY = _mm_set1_ps(low.y), lowZ = _mm_set1_ps(low.z);
+      __m128 highX = _mm_set1_ps(high.x), highY = _mm_set1_ps(high.y), highZ = _mm_set1_ps(high.z);
+
+      for (size_t i = 0; i < lightCount && count < CLUSTER_MAX_LIGHTS_PER_CLUSTER; i += 4) {
+        __m128 x = _mm_loadu_ps(&lights.x[i]);
+        __m128 y = _mm_loadu_ps(&lights.y[i]);
+        __m128 z = _mm_loadu_ps(&lights.z[i]);
+        __m128 radius = _mm_loadu_ps(&lights.radius[i]);
+
+        __m128 dx = _mm_max_ps(zero, _mm_max_ps(_mm_sub_ps(lowX, x), _mm_sub_ps(x, highX)));
+        __m128 dy = _mm_max_ps(zero, _mm_max_ps(_mm_sub_ps(lowY, y), _mm_sub_ps(y, highY)));
+        __m128 dz = _mm_max_ps(zero, _mm_max_ps(_mm_sub_ps(lowZ, z), _mm_sub_ps(z, highZ)));
+        __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+
+        int mask = _mm_movemask_ps(_mm_cmple_ps(distance, _mm_mul_ps(radius, radius)));
+        for (int lane = 0; lane < 4 && count < CLUSTER_MAX_LIGHTS_PER_CLUSTER; ++lane) {
+          if (mask & (1 << lane)) {
+            list[count++] = lights.index[i + lane];
+          }
+        }
+      }
+#else
+      for (size_t i = 0; i < lightCount && count < CLUSTER_MAX_LIGHTS_PER_CLUSTER; ++i) {
+        float dx = std::fmax(0.0f, std::fmax(low.x - lights.x[i], lights.x[i] - high.x));
+        float dy = std::fmax(0.0f, std::fmax(low.y - lights.y[i], lights.y[i] - high.y));
+        float dz = std::fmax(0.0f, std::fmax(low.z - lights.z[i], lights.z[i] - high.z));
+        if (dx * dx + dy * dy + dz * dz <= lights.radius[i] * lights.radius[i]) {
+          list[count++] = lights.index[i];
+        }
+      }
+#endif
+      counts[cluster] = count;
+    }
+  }
+
+  /* Replace a texture buffer's contents, orphaning the old storage so the upload never waits on draws still reading it */
+  static void upload(unsigned int buffer, const void* data, size_t size) {
+    GLState::bindBuffer(GL_TEXTURE_BUFFER, buffer);
+    glBufferData(GL_TEXTURE_BUFFER, size, NULL, GL_STREAM_DRAW);
+    if (data != NULL && size > 0) {
+      glBufferSubData(GL_TEXTURE_BUFFER, 0, size, data);
+    }
+  }
+
+public:
+  static size_t clusterIndex(int tileX, int tileY, int slice) {
+    return (size_t)tileX + CLUSTER_TILES_X * ((size_t)tileY + CLUSTER_TILES_Y * (size_t)slice);
+  }
+
+  /* Create the buffers; needs a current context */
+  static void initialize() {
+    unsigned int buffers[3];
+    unsigned int textures[3];
+    glGenBuffers(3, buffers);
+    glGenTextures(3, textures);
+    lightBuffer = buffers[0];
+    recordBuffer = buffers[1];
+    indexBuffer = buffers[2];
+    lightTexture = textures[0];
+    recordTexture = textures[1];
+    indexTexture = textures[2];
+
+    GLenum formats[3] = { GL_RGBA32F, GL_RG32UI, GL_R16UI };
+    unsigned int units[3] = { lightUnit(), recordUnit(), indexUnit() };
+    for (int i = 0; i < 3; ++i) {
+      /* A texture buffer needs a data store before it can be attached */
+      upload(buffers[i], NULL, 16);
+      GLState::bindTexture(units[i], GL_TEXTURE_BUFFER, textures[i]);
+      glTexBuffer(GL_TEXTURE_BUFFER, formats[i], buffers[i]);
+    }
+
+    counts.assign(CLUSTER_COUNT, 0);
+    lists.resize((size_t)CLUSTER_COUNT * CLUSTER_MAX_LIGHTS_PER_CLUSTER);
+    records.resize(CLUSTER_COUNT * 2);
+  }
+
+  /* Units the buffer textures stay bound to, shared by the forward and deferred programs */
+  static unsigned int lightUnit() {
+    return GLState::reservedUnit(TEXTURE_UNIT_CLUSTER_LIGHTS);
+  }
+
+  static unsigned int recordUnit() {
+    return GLState::reservedUnit(TEXTURE_UNIT_CLUSTER_RECORDS);
+  }
+
+  static unsigned int indexUnit() {
+    return GLState::reservedUnit(TEXTURE_UNIT_CLUSTER_INDICES);
+  }
+
+  /*
+   * Assign Lighting::pointLights to the clusters of camera's view and upload
+   * the lists. Also sets Lighting::clusterParameters, so call this before
+   * Lighting::upload.
+   */
+  static void update(Camera& camera) {
+    TraceScope trace("lighting", "clusters", "");
+
+    if (camera.fov != builtFov || camera.aspectRatio != builtAspect || camera.nearPlane != builtNear || camera.farPlane != builtFar) {
+      buildBoxes(camera);
+    }
+
+    /*
+     * Tile from window position, slice from log(view depth). gl_FragCoord is
+     * in framebuffer pixels, which on HiDPI displays are not the window's
+     * screen coordinates, and the size can change any frame.
+     */
+    int framebufferWidth = 0, framebufferHeight = 0;
+    glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+    float logRatio = std::log(camera.farPlane / camera.nearPlane);
+    Lighting::clusterParameters = glm::vec4((float)CLUSTER_TILES_X / std::max(framebufferWidth, 1), (float)CLUSTER_TILES_Y / std::max(framebufferHeight, 1), CLUSTER_SLICES / logRatio,
+                                            -CLUSTER_SLICES * std::log(camera.nearPlane) / logRatio);
+
+    /* Light texels, and each light's sphere in view space */
+    size_t lightCount = std::min<size_t>(Lighting::pointLights.size(), CLUSTER_MAX_LIGHTS);
+    glm::mat4 view = camera.getViewMatrix();
+    lightTexels.resize(lightCount * 4);
+    lightX.resize(lightCount);
+    lightY.resize(lightCount);
+    lightZ.resize(lightCount);
+    lightRadius.resize(lightCount);
+    for (size_t i = 0; i < lightCount; ++i) {
+      const PointLight& light = Lighting::pointLights[i];
+      float range = light.range();
+      lightTexels[i * 4] = glm::vec4(light.position, light.constant);
+      lightTexels[i * 4 + 1] = glm::vec4(light.ambient, light.linear);
+      lightTexels[i * 4 + 2] = glm::vec4(light.diffuse, light.quadratic);
+      lightTexels[i * 4 + 3] = glm::vec4(light.specular, range);
+
+      glm::vec4 center = view * glm::vec4(light.position, 1.0f);
+      lightX[i] = center.x;
+      lightY[i] = center.y;
+      lightZ[i] = center.z;
+      lightRadius[i] = range;
+    }
+
+    JobSystem::parallelFor(CLUSTER_SLICES, [](size_t slice) { assignSlice((int)slice); });
+
+    /* Pack the lists back to back */
+    indices.clear();
+    for (size_t cluster = 0; cluster < CLUSTER_COUNT; ++cluster) {
+      records[cluster * 2] = (uint32_t)indices.size();
+      records[cluster * 2 + 1] = counts[cluster];
+      const uint16_t* list = &lists[cluster * CLUSTER_MAX_LIGHTS_PER_CLUSTER];
+      indices.insert(indices.end(), list, list + counts[cluster]);
+    }
+
+    upload(lightBuffer, lightTexels.data(), lightTexels.size() * sizeof(glm::vec4));
+    upload(recordBuffer, records.data(), records.size() * sizeof(uint32_t));
+    upload(indexBuffer, indices.data(), indices.size() * sizeof(uint16_t));
+    Trace::uploaded(lightTexels.size() * sizeof(glm::vec4) + records.size() * sizeof(uint32_t) + indices.size() * sizeof(uint16_t));
+
+    /* Rebinding keeps the units right if anything else used them */
+    GLState::bindTexture(lightUnit(), GL_TEXTURE_BUFFER, lightTexture);
+    GLState::bindTexture(recordUnit(), GL_TEXTURE_BUFFER, recordTexture);
+    GLState::bindTexture(indexUnit(), GL_TEXTURE_BUFFER, indexTexture);
+  }
+
+  /* Lights assigned to all clusters in the last update, counting a light once per cluster */
+  static size_t assignedCount() {
+    return indices.size();
+  }
+};
+
+#endif
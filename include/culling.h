@@ -0,0 +1,169 @@
+/*
+ * include/culling.h
+ *
+ * Bounding volumes for meshes and primitives, and frustum culling over them.
+ */
+
+#ifndef CULLING_H
+#define CULLING_H
+
+#include <glm/glm.hpp>
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define NEPTUNE_CULLING_SSE
+#include <xmmintrin.h>
+#endif
+
+#include <camera.h>
+
+/* Object space bounds of a mesh: an axis aligned box and a sphere around the same points */
+struct BoundingVolume {
+  glm::vec3 min = glm::vec3(0.0f, 0.0f, 0.0f);
+  glm::vec3 max = glm::vec3(0.0f, 0.0f, 0.0f);
+  glm::vec3 center = glm::vec3(0.0f, 0.0f, 0.0f);
+  float radius = 0.0f;
+
+  /*
+   * Build the bounds of count positions, each made of three floats and stride
+   * floats apart. The sphere is centred on the box and just large enough to
+   * hold every point, which is tighter than the box's half diagonal.
+   */
+  static BoundingVolume fromPositions(const float* positions, size_t count, size_t stride) {
+    BoundingVolume bounds;
+    if (count == 0) {
+      return bounds;
+    }
+
+    bounds.min = bounds.max = glm::vec3(positions[0], positions[1], positions[2]);
+    for (size_t i = 1; i < count; ++i) {
+      const float* p = positions + i * stride;
+      bounds.min = glm::min(bounds.min, glm::vec3(p[0], p[1], p[2]));
+      bounds.max = glm::max(bounds.max, glm::vec3(p[0], p[1], p[2]));
+    }
+
+    bounds.center = (bounds.min + bounds.max) * 0.5f;
+
+    float radiusSquared = 0.0f;
+    for (size_t i = 0; i < count; ++i) {
+      const float* p = positions + i * stride;
+      glm::vec3 offset = glm::vec3(p[0], p[1], p[2]) - bounds.center;
+      radiusSquared = std::fmax(radiusSquared, glm::dot(offset, offset));
+    }
+    bounds.radius = std::sqrt(radiusSquared);
+
+    return bounds;
+  }
+
+  static BoundingVolume fromBox(glm::vec3 min, glm::vec3 max) {
+    BoundingVolume bounds;
+    bounds.min = min;
+    bounds.max = max;
+    bounds.center = (min + max) * 0.5f;
+    bounds.radius = glm::length(max - bounds.center);
+    return bounds;
+  }
+
+  /* World space sphere after applying a model matrix built from the given scale */
+  void worldSphere(const glm::mat4& model, glm::vec3 scale, glm::vec3& worldCenter, float& worldRadius) const {
+    glm::vec4 transformed = model * glm::vec4(center, 1.0f);
+    worldCenter = glm::vec3(transformed.x, transformed.y, transformed.z);
+
+    /* Rotation keeps lengths, so only the largest scale factor can grow the sphere */
+    float maxScale = std::fmax(std::fabs(scale.x), std::fmax(std::fabs(scale.y), std::fabs(scale.z)));
+    worldRadius = radius * maxScale;
+  }
+};
+
+/*
+ * World space bounding spheres for one frame, kept as separate x/y/z/radius
+ * arrays so the frustum test runs four spheres at a time. Objects add their
+ * sphere, remember the returned index and check isVisible after cull().
+ */
+class CullingSet {
+private:
+  std::vector<float> x, y, z, radius;
+  std::vector<uint8_t> visible;
+  size_t count = 0;
+
+public:
+  void clear() {
+    x.clear();
+    y.clear();
+    z.clear();
+    radius.clear();
+    count = 0;
+  }
+
+  size_t add(glm::vec3 center, float sphereRadius) {
+    x.push_back(center.x);
+    y.push_back(center.y);
+    z.push_back(center.z);
+    radius.push_back(sphereRadius);
+    return count++;
+  }
+
+  /* Test every sphere against the frustum; a sphere touching any plane counts as visible */
+  void cull(const Frustum& frustum) {
+    /* Pad to a multiple of four with spheres that always pass */
+    size_t padded = (count + 3) & ~(size_t)3;
+    x.resize(padded, 0.0f);
+    y.resize(padded, 0.0f);
+    z.resize(padded, 0.0f);
+    radius.resize(padded, INFINITY);
+    visible.resize(padded);
+
+#ifdef NEPTUNE_CULLING_SSE
+    __m128 planeX[6], planeY[6], planeZ[6], planeW[6];
+    for (int p = 0; p < 6; ++p) {
+      planeX[p] = _mm_set1_ps(frustum.planes[p].x);
+      planeY[p] = _mm_set1_ps(frustum.planes[p].y);
+      planeZ[p] = _mm_set1_ps(frustum.planes[p].z);
+      planeW[p] = _mm_set1_ps(frustum.planes[p].w);
+    }
+
+    for (size_t i = 0; i < padded; i += 4) {
+      __m128 sx = _mm_loadu_ps(&x[i]);
+      __m128 sy = _mm_loadu_ps(&y[i]);
+      __m128 sz = _mm_loadu_ps(&z[i]);
+      __m128 negativeRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&radius[i]));
+
+      __m128 inside = _mm_cmpeq_ps(_mm_setzero_ps(), _mm_setzero_ps());
+      for (int p = 0; p < 6; ++p) {
+        __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, planeX[p]), _mm_mul_ps(sy, planeY[p])), _mm_add_ps(_mm_mul_ps(sz, planeZ[p]), planeW[p]));
+        inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negativeRadius));
+      }
+
+      int mask = _mm_movemask_ps(inside);
+      visible[i] = mask & 1;
+      visible[i + 1] = (mask >> 1) & 1;
+      visible[i + 2] = (mask >> 2) & 1;
+      visible[i + 3] = (mask >> 3) & 1;
+    }
+#else
+    for (size_t i = 0; i < padded; ++i) {
+      uint8_t inside = 1;
+      for (int p = 0; p < 6; ++p) {
+        const glm::vec4& plane = frustum.planes[p];
+        float distance = plane.x * x[i] + plane.y * y[i] + plane.z * z[i] + plane.w;
+        inside &= distance >= -radius[i];
+      }
+      visible[i] = inside;
+    }
+#endif
+  }
+
+  bool isVisible(size_t index) const {
+    return visible[index] != 0;
+  }
+
+  size_t size() const {
+    return count;
+  }
+};
+
+#endif
@@ -0,0 +1,190 @@
+/*
+ * include/deferred.h
+ *
+ * Optional deferred path. With DeferredRenderer::enabled, meshes drawn with
+ * the Phong uber-shader go through RENDER_PASS_GBUFFER instead: their
+ * material is written to a compact G-buffer (see
+ * src/shaders/include/gbuffer.glsl) and nothing is lit. One full-screen pass
+ * then rebuilds each pixel's position from depth and shades it with the
+ * directional light and the point lights of its LightClusters cluster, so
+ * lighting costs the same however much overdraw the scene has. The depth
+ * buffer is copied to the window afterwards and the forward passes (objects
+ * with their own shaders, transparency) are drawn on top as before.
+ */
+
+#ifndef DEFERRED_H
+#define DEFERRED_H
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include <camera.h>
+#include <clusters.h>
+#include <globals.h>
+#include <glstate.h>
+#include <lighting.h>
+#include <shader.h>
+
+/* Shininess is stored as a fraction of this; keep in sync with gbuffer.glsl */
+#define GBUFFER_MAX_SHININESS 256.0f
+
+class DeferredRenderer {
+private:
+  inline static unsigned int framebuffer = 0;
+  inline static unsigned int albedoSpecular = 0, normalShininess = 0, depth = 0;
+  inline static int bufferWidth = 0, bufferHeight = 0;
+  /* The window's clear colour, put back after the G-buffer is cleared to zero */
+  inline static glm::vec4 clearColor = glm::vec4(0.0f);
+  /* Core profile draws need a bound VAO even without attributes */
+  inline static unsigned int emptyVAO = 0;
+
+  /* Lighting programs by directional light and fog */
+  inline static std::unordered_map<uint32_t, std::unique_ptr<Shader>> programs;
+
+  /* Targets live on their reserved units, where the lighting pass samples them */
+  static unsigned int createTarget(enum ReservedTextureUnit unit, GLenum internalFormat, GLenum format, GLenum type) {
+    unsigned int texture;
+    glGenTextures(1, &texture);
+    GLState::bindTexture(GLState::reservedUnit(unit), GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, bufferWidth, bufferHeight, 0, format, type, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    return texture;
+  }
+
+  static void release() {
+    unsigned int textures[3] = { albedoSpecular, normalShininess, depth };
+    for (unsigned int texture : textures) {
+      GLState::forgetTexture(texture);
+    }
+    glDeleteTextures(3, textures);
+    glDeleteFramebuffers(1, &framebuffer);
+    framebuffer = 0;
+  }
+
+  /* (Re)create the G-buffer at the given size, which is the window's framebuffer size */
+  static bool createBuffers(int framebufferWidth, int framebufferHeight) {
+    if (framebuffer != 0) {
+      release();
+    }
+    bufferWidth = framebufferWidth;
+    bufferHeight = framebufferHeight;
+
+    albedoSpecular = createTarget(TEXTURE_UNIT_GBUFFER_ALBEDO_SPECULAR, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE);
+    normalShininess = createTarget(TEXTURE_UNIT_GBUFFER_NORMAL_SHININESS, GL_RGB10_A2, GL_RGBA, GL_UNSIGNED_INT_2_10_10_10_REV);
+    /* Same format as the usual window depth buffer, so it can be blitted there */
+    depth = createTarget(TEXTURE_UNIT_GBUFFER_DEPTH, GL_DEPTH24_STENCIL8, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8);
+
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, albedoSpecular, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, normalShininess, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, depth, 0);
+    GLenum attachments[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+    glDrawBuffers(2, attachments);
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+      std::cout << "ERROR::DEFERRED::GBUFFER_INCOMPLETE" << std::endl;
+      glBindFramebuffer(GL_FRAMEBUFFER, 0);
+      release();
+      return false;
+    }
+
+    if (emptyVAO == 0) {
+      glGenVertexArrays(1, &emptyVAO);
+    }
+    return true;
+  }
+
+  static Shader& lightingProgram() {
+    uint32_t key = (uint32_t)Lighting::directionalEnabled | (uint32_t)Lighting::fogEnabled << 1;
+    auto found = programs.find(key);
+    if (found == programs.end()) {
+      ShaderDefines defines;
+      if (Lighting::directionalEnabled) defines.push_back({ "DIRECTIONAL_LIGHT", "" });
+      if (Lighting::fogEnabled) defines.push_back({ "FOG", "" });
+      found = programs.emplace(key, std::make_unique<Shader>(vertexPath.c_str(), fragmentPath.c_str(), defines, true)).first;
+    }
+    return *found->second;
+  }
+
+public:
+  /* Draw uber-shaded meshes through the G-buffer; can be switched any frame */
+  inline static bool enabled = false;
+
+  inline static std::string vertexPath = "src/shaders/deferred.vert";
+  inline static std::string fragmentPath = "src/shaders/deferred.frag";
+
+  /*
+   * Bind and clear the G-buffer for RENDER_PASS_GBUFFER; false if it could
+   * not be made. It matches the window's framebuffer in pixels, which on
+   * HiDPI displays is not the window size, and follows it when it changes.
+   */
+  static bool beginGeometry() {
+    int framebufferWidth = 0, framebufferHeight = 0;
+    glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+    if (framebufferWidth <= 0 || framebufferHeight <= 0) {
+      return false;
+    }
+    if ((framebuffer == 0 || bufferWidth != framebufferWidth || bufferHeight != framebufferHeight) && !createBuffers(framebufferWidth, framebufferHeight)) {
+      return false;
+    }
+    glGetFloatv(GL_COLOR_CLEAR_VALUE, &clearColor.x);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glViewport(0, 0, bufferWidth, bufferHeight);
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    return true;
+  }
+
+  /*
+   * Light the G-buffer into the window and copy its depth there, so the
+   * forward passes that follow are depth tested against it. Pixels no mesh
+   * covered keep the window's clear colour.
+   */
+  static void light(Camera& camera) {
+    /* Same size as the G-buffer, so the passes and the blit below line up pixel for pixel */
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, bufferWidth, bufferHeight);
+    glClearColor(clearColor.x, clearColor.y, clearColor.z, clearColor.w);
+
+    Shader& program = lightingProgram();
+    if (program.ready()) {
+      CameraUniforms uniforms = camera.getUniforms();
+      program.use();
+      program.setMat4(UNIFORM("inverseViewProjection"), glm::inverse(uniforms.viewProjection));
+      program.setInt(UNIFORM("gAlbedoSpecular"), GLState::reservedUnit(TEXTURE_UNIT_GBUFFER_ALBEDO_SPECULAR));
+      program.setInt(UNIFORM("gNormalShininess"), GLState::reservedUnit(TEXTURE_UNIT_GBUFFER_NORMAL_SHININESS));
+      program.setInt(UNIFORM("gDepth"), GLState::reservedUnit(TEXTURE_UNIT_GBUFFER_DEPTH));
+      program.setInt(UNIFORM("lightData"), LightClusters::lightUnit());
+      program.setInt(UNIFORM("clusterRecords"), LightClusters::recordUnit());
+      program.setInt(UNIFORM("lightIndices"), LightClusters::indexUnit());
+
+      GLState::bindTexture(GLState::reservedUnit(TEXTURE_UNIT_GBUFFER_ALBEDO_SPECULAR), GL_TEXTURE_2D, albedoSpecular);
+      GLState::bindTexture(GLState::reservedUnit(TEXTURE_UNIT_GBUFFER_NORMAL_SHININESS), GL_TEXTURE_2D, normalShininess);
+      GLState::bindTexture(GLState::reservedUnit(TEXTURE_UNIT_GBUFFER_DEPTH), GL_TEXTURE_2D, depth);
+
+      /* The triangle covers every pixel once; no depth test or write */
+      GLState::setCapability(GL_DEPTH_TEST, false);
+      GLState::depthMask(false);
+      GLState::bindVertexArray(emptyVAO);
+      glDrawArrays(GL_TRIANGLES, 0, 3);
+      GLState::depthMask(true);
+      GLState::setCapability(GL_DEPTH_TEST, true);
+    }
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+    glBlitFramebuffer(0, 0, bufferWidth, bufferHeight, 0, 0, bufferWidth, bufferHeight, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+  }
+};
+
+#endif
@@ -0,0 +1,57 @@
+/*
+ * include/depthprepass.h
+ *
+ * Optional depth pre-pass for the forward path. With DepthPrepass::enabled,
+ * meshes drawn with the Phong uber-shader are first drawn into the depth
+ * buffer alone from their position-only vertex stream (see
+ * VertexDataObject), with src/shaders/depth.vert and an empty fragment
+ * shader. The colour pass then draws them with GL_EQUAL depth testing, so
+ * the expensive lighting runs once per pixel however much they overlap.
+ * depth.vert computes gl_Position exactly like phong.vert and both declare
+ * it invariant, which is what lets the two passes' depths compare equal.
+ */
+
+#ifndef DEPTHPREPASS_H
+#define DEPTHPREPASS_H
+
+#include <glad/glad.h>
+
+#include <memory>
+#include <string>
+
+#include <renderqueue.h>
+#include <shader.h>
+
+class DepthPrepass {
+private:
+  inline static std::unique_ptr<Shader> shader;
+
+public:
+  /* Pre-pass uber-shaded meshes on the forward path; can be switched any frame */
+  inline static bool enabled = false;
+
+  inline static std::string vertexPath = "src/shaders/depth.vert";
+  inline static std::string fragmentPath = "src/shaders/depth.frag";
+
+  /* The depth-only program, queued on ShaderQueue the first time it is asked for */
+  static Shader& program() {
+    if (!shader) {
+      shader = std::make_unique<Shader>(vertexPath.c_str(), fragmentPath.c_str(), ShaderDefines(), true);
+    }
+    return *shader;
+  }
+
+  /* Lay down depth for queue's pre-passable packets; does nothing until the program has linked */
+  static void draw(RenderQueue& queue) {
+    Shader& depthProgram = program();
+    if (!depthProgram.ready()) {
+      return;
+    }
+
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    queue.submitDepth(depthProgram.ID);
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+  }
+};
+
+#endif
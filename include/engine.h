@@ -5,16 +5,31 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 
+#include <glstate.h>
 #include <shader.h>
 #include <input.h>
 #include <camera.h>
 #include <globals.h>
 #include <texture.h>
 #include <objects.h>
+#include <renderqueue.h>
+#include <lighting.h>
+#include <clusters.h>
+#include <deferred.h>
+#include <depthprepass.h>
 
 GLFWwindow* window;
 Camera activeCamera(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 0.0f), 0.0f, 0.0f, 0.0f, 0.0f);
 
+/* Uniform buffer backing the "Camera" block, bound at CAMERA_BLOCK_BINDING */
+unsigned int cameraUniformBuffer;
+
+/* Draw packets gathered from every object each frame */
+RenderQueue renderQueue;
+
+/* World space bounds of every object, tested against the camera frustum each frame */
+CullingSet cullingSet;
+
 #define CURSOR_NORMAL     0x00034001
 #define CURSOR_HIDDEN     0x00034002
 #define CURSOR_DISABLED   0x00034003
@@ -23,8 +38,8 @@ Camera activeCamera(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 0.0f), gl
 /* Rendering specifics */
 #define terminate() glfwTerminate()
 #define verticalSync(enabled) glfwSwapInterval(enabled)
-#define wireframe(enabled) glPolygonMode(GL_FRONT_AND_BACK, (enabled) ? GL_LINE : GL_FILL)
-#define cullBackFace(enabled) (enabled) ? glEnable(GL_CULL_FACE) : glDisable(GL_CULL_FACE)
+#define wireframe(enabled) GLState::polygonMode((enabled) ? GL_LINE : GL_FILL)
+#define cullBackFace(enabled) GLState::setCapability(GL_CULL_FACE, enabled)
 
 /* Input modes */
 #define cursorMode(mode) glfwSetInputMode(window, GLFW_CURSOR, mode);
@@ -36,17 +51,61 @@ Camera activeCamera(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 0.0f), gl
 
 class Engine {
 private:
+  /* Compute the camera matrices once per frame and share them with every shader */
+  static void updateCameraUniforms() {
+    CameraUniforms uniforms = activeCamera.getUniforms();
+
+    GLState::bindBuffer(GL_UNIFORM_BUFFER, cameraUniformBuffer);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(CameraUniforms), &uniforms);
+
+    activeCamera.updateFrustum(uniforms.viewProjection);
+  }
+
+  /*
+   * Cull every object against the camera frustum, gather the visible ones
+   * into the render queue, then draw it sorted by state and depth
+   */
   static void draw() {
+    cullingSet.clear();
+
     for (Model* Model : Models) {
-      Model->draw();
+      Model->addBounds(cullingSet);
     }
 
-    for (Cube* cube : Cubes) {
-      cube->draw();
+    Cube::updateAll(cullingSet);
+
+    for (SubdividedPlane* subdividedPlane : SubdividedPlanes) {
+      subdividedPlane->addBounds(cullingSet);
     }
 
+    cullingSet.cull(activeCamera.frustum);
+
+    /* Framebuffer pixels, not window units, and read every frame so LODs follow resizes */
+    int framebufferWidth = 0, framebufferHeight = 0;
+    glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+    renderQueue.begin(activeCamera, framebufferHeight);
+
+    for (Model* Model : Models) {
+      Model->submit(renderQueue, cullingSet);
+    }
+
+    Cube::submitAll(renderQueue, cullingSet);
+
     for (SubdividedPlane* subdividedPlane : SubdividedPlanes) {
-      subdividedPlane->draw();
+      subdividedPlane->submit(renderQueue, cullingSet);
+    }
+
+    renderQueue.sort();
+    if (DeferredRenderer::enabled && DeferredRenderer::beginGeometry()) {
+      renderQueue.submit(RENDER_PASS_GBUFFER);
+      DeferredRenderer::light(activeCamera);
+      renderQueue.submit(RENDER_PASS_OPAQUE);
+      renderQueue.submit(RENDER_PASS_TRANSPARENT);
+    } else {
+      if (DepthPrepass::enabled) {
+        DepthPrepass::draw(renderQueue);
+      }
+      renderQueue.submit();
     }
   }
 
@@ -76,9 +135,22 @@ public:
     gladLoadGL();
     
     /* Handle draw order */
-    glEnable(GL_DEPTH_TEST);
+    GLState::setCapability(GL_DEPTH_TEST, true);
     /* Back face culling */
-    glEnable(GL_CULL_FACE);
+    GLState::setCapability(GL_CULL_FACE, true);
+
+    /* Camera uniform block */
+    glGenBuffers(1, &cameraUniformBuffer);
+    GLState::bindBuffer(GL_UNIFORM_BUFFER, cameraUniformBuffer);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(CameraUniforms), NULL, GL_DYNAMIC_DRAW);
+    glBindBufferBase(GL_UNIFORM_BUFFER, CAMERA_BLOCK_BINDING, cameraUniformBuffer);
+
+    /* Lights uniform block and the clustered light buffers */
+    Lighting::initialize();
+    LightClusters::initialize();
+
+    /* Non-instanced draws read the instance matrix as the identity */
+    RenderQueue::resetInstanceModel();
 
     return window;
   }
@@ -86,6 +158,13 @@ public:
   static void refresh() {
     Input::updateInputState(window);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    TextureStreamer::update();
+    ShaderQueue::update();
+    updateCameraUniforms();
+    if (Lighting::clustered || DeferredRenderer::enabled) {
+      LightClusters::update(activeCamera);
+    }
+    Lighting::upload();
     draw(); 
     glfwSwapBuffers(window);
   }
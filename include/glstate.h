@@ -0,0 +1,230 @@
+/*
+ * include/glstate.h
+ *
+ * Shadow copy of the GL state the engine changes most often. Every bind goes
+ * through GLState, which skips the call when the value is already current and
+ * counts how many calls it saved.
+ */
+
+#ifndef GLSTATE_H
+#define GLSTATE_H
+
+#include <glad/glad.h>
+
+#include <vector>
+
+/* Shadowed value that is not known; forces the next call through */
+#define GL_STATE_UNKNOWN 0xFFFFFFFFu
+
+/*
+ * Texture units kept for textures the engine owns, counted down from the
+ * last unit the context has. Material textures use the units from 0 up to
+ * MAX_PACKET_TEXTURES (see RenderQueue), so the two never meet.
+ */
+enum ReservedTextureUnit {
+  TEXTURE_UNIT_CLUSTER_LIGHTS,
+  TEXTURE_UNIT_CLUSTER_RECORDS,
+  TEXTURE_UNIT_CLUSTER_INDICES,
+  TEXTURE_UNIT_GBUFFER_ALBEDO_SPECULAR,
+  TEXTURE_UNIT_GBUFFER_NORMAL_SHININESS,
+  TEXTURE_UNIT_GBUFFER_DEPTH,
+};
+
+class GLState {
+private:
+  inline static unsigned int program = GL_STATE_UNKNOWN;
+  inline static unsigned int vertexArray = GL_STATE_UNKNOWN;
+  inline static unsigned int activeUnit = GL_STATE_UNKNOWN;
+
+  /* Buffer bindings for the targets the engine uses */
+  inline static unsigned int arrayBuffer = GL_STATE_UNKNOWN;
+  inline static unsigned int elementArrayBuffer = GL_STATE_UNKNOWN;
+  inline static unsigned int uniformBuffer = GL_STATE_UNKNOWN;
+  inline static unsigned int pixelUnpackBuffer = GL_STATE_UNKNOWN;
+  inline static unsigned int textureBuffer = GL_STATE_UNKNOWN;
+
+  /* Texture bound to each unit, per tracked target */
+  inline static std::vector<unsigned int> textures2D;
+  inline static std::vector<unsigned int> texturesBuffer;
+
+  inline static unsigned int depthTest = GL_STATE_UNKNOWN;
+  inline static unsigned int cullFace = GL_STATE_UNKNOWN;
+  inline static unsigned int blend = GL_STATE_UNKNOWN;
+  inline static unsigned int polygonModeValue = GL_STATE_UNKNOWN;
+  inline static unsigned int depthFuncValue = GL_STATE_UNKNOWN;
+  inline static unsigned int depthMaskValue = GL_STATE_UNKNOWN;
+
+  /* GL_MAX_COMBINED_TEXTURE_IMAGE_UNITS, read once */
+  inline static int textureUnitCount = 0;
+
+  /* Returns true if the shadow changed, i.e. the GL call has to be made */
+  static bool update(unsigned int& shadow, unsigned int value) {
+    if (shadow == value) {
+      elidedCalls++;
+      return false;
+    }
+    shadow = value;
+    issuedCalls++;
+    return true;
+  }
+
+  static unsigned int* bufferShadow(GLenum target) {
+    switch (target) {
+      case GL_ARRAY_BUFFER: return &arrayBuffer;
+      case GL_ELEMENT_ARRAY_BUFFER: return &elementArrayBuffer;
+      case GL_UNIFORM_BUFFER: return &uniformBuffer;
+      case GL_PIXEL_UNPACK_BUFFER: return &pixelUnpackBuffer;
+      case GL_TEXTURE_BUFFER: return &textureBuffer;
+      default: return nullptr;
+    }
+  }
+
+  static unsigned int* textureShadow(unsigned int unit, GLenum target) {
+    std::vector<unsigned int>* units;
+    switch (target) {
+      case GL_TEXTURE_2D: units = &textures2D; break;
+      case GL_TEXTURE_BUFFER: units = &texturesBuffer; break;
+      default: return nullptr;
+    }
+    if (unit >= units->size()) {
+      units->resize(unit + 1, GL_STATE_UNKNOWN);
+    }
+    return &(*units)[unit];
+  }
+
+  static unsigned int* capabilityShadow(GLenum capability) {
+    switch (capability) {
+      case GL_DEPTH_TEST: return &depthTest;
+      case GL_CULL_FACE: return &cullFace;
+      case GL_BLEND: return &blend;
+      default: return nullptr;
+    }
+  }
+
+public:
+  /* GL calls made and GL calls skipped because they would not have changed anything */
+  inline static unsigned long issuedCalls = 0;
+  inline static unsigned long elidedCalls = 0;
+
+  static void resetCounters() {
+    issuedCalls = 0;
+    elidedCalls = 0;
+  }
+
+  /* Forget everything; call after code that changes GL state behind GLState's back */
+  static void invalidate() {
+    program = vertexArray = activeUnit = GL_STATE_UNKNOWN;
+    arrayBuffer = elementArrayBuffer = uniformBuffer = pixelUnpackBuffer = textureBuffer = GL_STATE_UNKNOWN;
+    textures2D.clear();
+    texturesBuffer.clear();
+    depthTest = cullFace = blend = GL_STATE_UNKNOWN;
+    polygonModeValue = depthFuncValue = depthMaskValue = GL_STATE_UNKNOWN;
+  }
+
+  static void useProgram(unsigned int id) {
+    if (update(program, id)) {
+      glUseProgram(id);
+    }
+  }
+
+  static void bindVertexArray(unsigned int id) {
+    if (update(vertexArray, id)) {
+      glBindVertexArray(id);
+      /* The element array binding belongs to the VAO */
+      elementArrayBuffer = GL_STATE_UNKNOWN;
+    }
+  }
+
+  static void bindBuffer(GLenum target, unsigned int id) {
+    unsigned int* shadow = bufferShadow(target);
+    if (shadow == nullptr) {
+      issuedCalls++;
+      glBindBuffer(target, id);
+    } else if (update(*shadow, id)) {
+      glBindBuffer(target, id);
+    }
+  }
+
+  static void activeTexture(unsigned int unit) {
+    if (update(activeUnit, unit)) {
+      glActiveTexture(GL_TEXTURE0 + unit);
+    }
+  }
+
+  /* The unit for an engine-owned texture; needs a current context */
+  static unsigned int reservedUnit(enum ReservedTextureUnit unit) {
+    if (textureUnitCount == 0) {
+      glGetIntegerv(GL_MAX_COMBINED_TEXTURE_IMAGE_UNITS, &textureUnitCount);
+    }
+    return (unsigned int)textureUnitCount - 1 - (unsigned int)unit;
+  }
+
+  /* Bind a texture to a unit, switching the active unit only if the bind is needed */
+  static void bindTexture(unsigned int unit, GLenum target, unsigned int id) {
+    unsigned int* shadow = textureShadow(unit, target);
+    if (shadow != nullptr && *shadow == id) {
+      elidedCalls++;
+      return;
+    }
+
+    activeTexture(unit);
+    issuedCalls++;
+    glBindTexture(target, id);
+    if (shadow != nullptr) {
+      *shadow = id;
+    }
+  }
+
+  static void setCapability(GLenum capability, bool enabled) {
+    unsigned int* shadow = capabilityShadow(capability);
+    if (shadow == nullptr) {
+      issuedCalls++;
+    } else if (!update(*shadow, enabled)) {
+      return;
+    }
+    enabled ? glEnable(capability) : glDisable(capability);
+  }
+
+  static void polygonMode(GLenum mode) {
+    if (update(polygonModeValue, mode)) {
+      glPolygonMode(GL_FRONT_AND_BACK, mode);
+    }
+  }
+
+  static void depthFunc(GLenum func) {
+    if (update(depthFuncValue, func)) {
+      glDepthFunc(func);
+    }
+  }
+
+  static void depthMask(bool enabled) {
+    if (update(depthMaskValue, enabled)) {
+      glDepthMask(enabled ? GL_TRUE : GL_FALSE);
+    }
+  }
+
+  /* Deleted objects are unbound by GL, so their names must not stay in the shadow */
+  static void forgetBuffer(unsigned int id) {
+    unsigned int* buffers[] = { &arrayBuffer, &elementArrayBuffer, &uniformBuffer, &pixelUnpackBuffer, &textureBuffer };
+    for (unsigned int* shadow : buffers) {
+      if (*shadow == id) {
+        *shadow = GL_STATE_UNKNOWN;
+      }
+    }
+  }
+
+  static void forgetTexture(unsigned int id) {
+    for (unsigned int& shadow : textures2D) {
+      if (shadow == id) {
+        shadow = GL_STATE_UNKNOWN;
+      }
+    }
+    for (unsigned int& shadow : texturesBuffer) {
+      if (shadow == id) {
+        shadow = GL_STATE_UNKNOWN;
+      }
+    }
+  }
+};
+
+#endif
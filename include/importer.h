@@ -0,0 +1,343 @@
+/*
+ * include/importer.h
+ *
+ * CPU side of model import: read a model with assimp (from the mounted asset
+ * packs or disk, see archive.h) and turn it into interleaved vertex data,
+ * indices, bounds and decoded images, spread across the job system. Meshes go
+ * through the optimisation pass in meshopt.h, get a LOD chain (simplify.h) and
+ * are quantized (quantize.h) when VertexQuantizer::tolerance allows. Nothing
+ * in here touches OpenGL, so it runs (and can be benchmarked) without a
+ * context; Model uploads the result on the GL thread.
+ */
+
+#ifndef IMPORTER_H
+#define IMPORTER_H
+
+#include <assimp/config.h>
+#include <assimp/Importer.hpp>
+#include <assimp/IOStream.hpp>
+#include <assimp/IOSystem.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <archive.h>
+#include <culling.h>
+#include <jobs.h>
+#include <meshopt.h>
+#include <quantize.h>
+#include <simplify.h>
+#include <texture.h>
+#include <trace.h>
+#include <vertex.h>
+
+/* Read-only assimp stream over an AssetFile */
+class ArchiveIOStream : public Assimp::IOStream {
+private:
+  size_t position = 0;
+
+public:
+  AssetFile file;
+
+  size_t Read(void* buffer, size_t size, size_t count) override {
+    if (size == 0) {
+      return 0;
+    }
+    size_t available = (file.size - position) / size;
+    count = std::min(count, available);
+    if (count > 0) {
+      memcpy(buffer, file.data + position, size * count);
+      position += size * count;
+    }
+    return count;
+  }
+
+  size_t Write(const void*, size_t, size_t) override {
+    return 0;
+  }
+
+  aiReturn Seek(size_t offset, aiOrigin origin) override {
+    size_t base = origin == aiOrigin_SET ? 0 : origin == aiOrigin_CUR ? position : file.size;
+    if (offset > file.size - base) {
+      return aiReturn_FAILURE;
+    }
+    position = base + offset;
+    return aiReturn_SUCCESS;
+  }
+
+  size_t Tell() const override {
+    return position;
+  }
+
+  size_t FileSize() const override {
+    return file.size;
+  }
+
+  void Flush() override {}
+};
+
+/*
+ * Lets assimp open a model and everything it references (.mtl files, external
+ * buffers) from the mounted asset packs, falling back to disk like AssetFile.
+ * Import only reads, so write modes are refused.
+ */
+class ArchiveIOSystem : public Assimp::IOSystem {
+public:
+  bool Exists(const char* path) const override {
+    return AssetArchive::exists(path);
+  }
+
+  char getOsSeparator() const override {
+    return '/';
+  }
+
+  Assimp::IOStream* Open(const char* path, const char* mode = "rb") override {
+    if (strchr(mode, 'w') || strchr(mode, 'a') || strchr(mode, '+')) {
+      return nullptr;
+    }
+    ArchiveIOStream* stream = new ArchiveIOStream();
+    if (!stream->file.open(path)) {
+      delete stream;
+      return nullptr;
+    }
+    return stream;
+  }
+
+  void Close(Assimp::IOStream* stream) override {
+    delete stream;
+  }
+};
+
+/* Meshes in depth first node order, the order Model has always loaded them in */
+void collectMeshes(const aiNode* node, const aiScene* scene, std::vector<const aiMesh*>& meshes) {
+  for (unsigned int i = 0; i < node->mNumMeshes; i++) {
+    meshes.push_back(scene->mMeshes[node->mMeshes[i]]);
+  }
+  for (unsigned int i = 0; i < node->mNumChildren; i++) {
+    collectMeshes(node->mChildren[i], scene, meshes);
+  }
+}
+
+/* Only triangles are kept; points and lines would break every triangle after them in the index list */
+unsigned int meshIndexCount(const aiMesh* mesh) {
+  unsigned int count = 0;
+  for (unsigned int i = 0; i < mesh->mNumFaces; i++) {
+    if (mesh->mFaces[i].mNumIndices == 3) {
+      count += 3;
+    }
+  }
+  return count;
+}
+
+/* Write a mesh as POSITION_NORMAL_TEXTURE floats; missing normals or UVs become zero */
+void interleaveVertices(const aiMesh* mesh, float* out) {
+  for (unsigned int i = 0; i < mesh->mNumVertices; i++) {
+    float* vertex = out + i * 8;
+
+    vertex[0] = mesh->mVertices[i].x;
+    vertex[1] = mesh->mVertices[i].y;
+    vertex[2] = mesh->mVertices[i].z;
+
+    if (mesh->mNormals) {
+      vertex[3] = mesh->mNormals[i].x;
+      vertex[4] = mesh->mNormals[i].y;
+      vertex[5] = mesh->mNormals[i].z;
+    } else {
+      vertex[3] = vertex[4] = vertex[5] = 0.0f;
+    }
+
+    if (mesh->mTextureCoords[0]) {
+      vertex[6] = mesh->mTextureCoords[0][i].x;
+      vertex[7] = mesh->mTextureCoords[0][i].y;
+    } else {
+      vertex[6] = vertex[7] = 0.0f;
+    }
+  }
+}
+
+void extractIndices(const aiMesh* mesh, unsigned int* out) {
+  for (unsigned int i = 0; i < mesh->mNumFaces; i++) {
+    const aiFace& face = mesh->mFaces[i];
+    if (face.mNumIndices != 3) {
+      continue;
+    }
+    for (unsigned int j = 0; j < 3; j++) {
+      *out++ = face.mIndices[j];
+    }
+  }
+}
+
+struct ImportedTexture {
+  std::string path;    /* As written in the material, relative to the model's directory */
+  enum TextureType type;
+  unsigned int slot;   /* Index among the material's textures of the same type */
+  uint32_t image;      /* Index into ImportedModel::imagePaths and images */
+};
+
+struct ImportedMesh {
+  std::vector<float> vertices; /* POSITION_NORMAL_TEXTURE, interleaved from the aiMesh arrays */
+  std::vector<unsigned int> indices; /* Every level of detail, one after the other */
+  std::vector<MeshLod> lods;
+  BoundingVolume bounds;
+  std::vector<ImportedTexture> textures;
+  MeshOptimizationStats optimization;
+  VertexQuantization quantization; /* Layout the vertices are uploaded in */
+
+  size_t vertexCount() const {
+    return vertices.size() / 8;
+  }
+
+  size_t vertexBytes() const {
+    return vertexCount() * vertexStride(quantization.attributes);
+  }
+
+  /* Write the vertices in their upload layout; out may be mapped GPU memory */
+  void writeVertices(void* out) const {
+    VertexQuantizer::encode(vertices.data(), vertexCount(), quantization, out);
+  }
+
+  size_t positionBytes() const {
+    return vertexCount() * positionStride(quantization.attributes);
+  }
+
+  /* Write the position-only stream that goes with writeVertices */
+  void writePositions(void* out) const {
+    VertexQuantizer::encodePositions(vertices.data(), vertexCount(), quantization, out);
+  }
+
+  /* Free the CPU copy once it has been written out */
+  void release() {
+    std::vector<float>().swap(vertices);
+    std::vector<unsigned int>().swap(indices);
+  }
+};
+
+struct ImportedModel {
+  std::string directory;
+  std::vector<ImportedMesh> meshes;
+  std::vector<std::string> imagePaths; /* Every texture the model uses, once, including the directory */
+  std::vector<DecodedImage> images;    /* Parallel to imagePaths when decoding; textures already registered stay empty */
+};
+
+/* Whether an RGBA image still has to be decoded, i.e. is not in the TextureRegistry yet */
+bool needsDecode(const std::string& path) {
+  return !TextureRegistry::contains(TextureRegistry::key(path, true));
+}
+
+/*
+ * Import path into model. Material textures are resolved first, one job per
+ * material, so identical paths collapse to one image. Mesh conversion and
+ * image decoding then share a single parallel pass. Returns false if assimp
+ * could not read the file.
+ */
+bool importModel(const std::string& path, ImportedModel& model, bool decode) {
+  TraceScope trace("model", "import", path);
+  Assimp::Importer import;
+  /* The importer owns and deletes the handler */
+  import.SetIOHandler(new ArchiveIOSystem());
+  /* Triangulate leaves point and line faces alone; drop them so every mesh is triangles only */
+  import.SetPropertyInteger(AI_CONFIG_PP_SBP_REMOVE, aiPrimitiveType_POINT | aiPrimitiveType_LINE);
+  const aiScene* scene;
+  {
+    TraceScope parseTrace("model", "parse", path);
+    scene = import.ReadFile(path, aiProcess_Triangulate | aiProcess_SortByPType | aiProcess_FlipUVs);
+  }
+
+  /* Error while importing model */
+  if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
+    std::cout << "ERROR::ASSIMP::" << import.GetErrorString() << std::endl;
+    return false;
+  }
+
+  model.directory = path.substr(0, path.find_last_of('/') + 1);
+
+  /* Material textures, diffuse maps first and then specular maps */
+  std::vector<std::vector<ImportedTexture>> materials(scene->mNumMaterials);
+  JobSystem::parallelFor(scene->mNumMaterials, [&](size_t m) {
+    const aiMaterial* material = scene->mMaterials[m];
+    const aiTextureType types[] = { aiTextureType_DIFFUSE, aiTextureType_SPECULAR };
+    const enum TextureType typeNames[] = { DIFFUSE, SPECULAR };
+
+    for (int t = 0; t < 2; ++t) {
+      for (unsigned int i = 0; i < material->GetTextureCount(types[t]); i++) {
+        aiString str;
+        material->GetTexture(types[t], i, &str);
+        materials[m].push_back({ str.C_Str(), typeNames[t], i, 0 });
+      }
+    }
+  });
+
+  std::unordered_map<std::string, uint32_t> imageIndices;
+  for (std::vector<ImportedTexture>& textures : materials) {
+    for (ImportedTexture& texture : textures) {
+      std::string fullPath = model.directory + texture.path;
+      auto found = imageIndices.find(fullPath);
+      if (found == imageIndices.end()) {
+        found = imageIndices.emplace(fullPath, (uint32_t)model.imagePaths.size()).first;
+        model.imagePaths.push_back(fullPath);
+      }
+      texture.image = found->second;
+    }
+  }
+
+  std::vector<const aiMesh*> meshes;
+  collectMeshes(scene->mRootNode, scene, meshes);
+
+  model.meshes.clear();
+  model.meshes.resize(meshes.size());
+  /* Images already in the TextureRegistry are not decoded again */
+  std::vector<uint8_t> decodeImage(model.imagePaths.size());
+  model.images.clear();
+  if (decode) {
+    model.images.resize(model.imagePaths.size());
+    for (size_t i = 0; i < model.imagePaths.size(); ++i) {
+      decodeImage[i] = needsDecode(model.imagePaths[i]);
+    }
+  }
+
+  /* Images usually cost the most, so they go first and the meshes fill in around them */
+  size_t imageCount = model.images.size();
+  JobSystem::parallelFor(imageCount + meshes.size(), [&](size_t job) {
+    if (job < imageCount) {
+      if (decodeImage[job]) {
+        model.images[job].load(model.imagePaths[job].c_str(), 4);
+      }
+      return;
+    }
+
+    const aiMesh* mesh = meshes[job - imageCount];
+    ImportedMesh& imported = model.meshes[job - imageCount];
+    TraceScope meshTrace("model", "convert", path);
+
+    /*
+     * The one CPU copy of the mesh. Welding, cache reordering, LODs and the
+     * layout choice all rewrite or read the whole mesh before its size is
+     * known, so it cannot go straight into the GL buffers; those are then
+     * written from it once and it is released (see ImportedMesh).
+     */
+    imported.vertices.resize((size_t)mesh->mNumVertices * 8);
+    interleaveVertices(mesh, imported.vertices.data());
+
+    imported.indices.resize(meshIndexCount(mesh));
+    extractIndices(mesh, imported.indices.data());
+
+    /* Welds the per corner duplicates assimp leaves without aiProcess_JoinIdenticalVertices and reorders for the GPU caches */
+    imported.optimization = MeshOptimizer::optimize(imported.vertices, imported.indices, 8);
+
+    imported.bounds = BoundingVolume::fromPositions(imported.vertices.data(), imported.vertexCount(), 8);
+    imported.lods = MeshSimplifier::buildLods(imported.vertices.data(), imported.vertexCount(), 8, imported.indices);
+    /* Only the layout is chosen here; the vertices are encoded once, into their destination */
+    VertexQuantizer::quantize(imported.vertices.data(), imported.vertexCount(), imported.bounds, VertexQuantizer::tolerance, imported.quantization);
+    imported.textures = materials[mesh->mMaterialIndex];
+  });
+
+  return true;
+}
+
+#endif
@@ -0,0 +1,147 @@
+/*
+ * include/jobs.h
+ *
+ * A small pool of worker threads for CPU work that does not need the GL
+ * context: asset import, image decoding and the like.
+ */
+
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class JobSystem {
+private:
+  inline static std::vector<std::thread> workers;
+  inline static std::deque<std::function<void()>> queue;
+  inline static std::mutex mutex;
+  inline static std::condition_variable wake;
+  inline static bool stopping = false;
+
+  /* Progress of one parallelFor, shared with helpers that may start after it returned */
+  struct ParallelForState {
+    std::atomic<size_t> next{ 0 };
+    std::atomic<size_t> completed{ 0 };
+    size_t count;
+    size_t batch;
+    std::mutex mutex;
+    std::condition_variable done;
+  };
+
+  static void workerLoop() {
+    for (;;) {
+      std::function<void()> job;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        wake.wait(lock, [] { return stopping || !queue.empty(); });
+        if (stopping && queue.empty()) {
+          return;
+        }
+        job = std::move(queue.front());
+        queue.pop_front();
+      }
+      job();
+    }
+  }
+
+  /* Claim and run batches until none are left */
+  static void runBatches(ParallelForState& state, const std::function<void(size_t)>& body) {
+    for (;;) {
+      size_t begin = state.next.fetch_add(state.batch);
+      if (begin >= state.count) {
+        return;
+      }
+      size_t end = std::min(begin + state.batch, state.count);
+      for (size_t i = begin; i < end; ++i) {
+        body(i);
+      }
+      if (state.completed.fetch_add(end - begin) + (end - begin) == state.count) {
+        std::lock_guard<std::mutex> lock(state.mutex);
+        state.done.notify_all();
+      }
+    }
+  }
+
+public:
+  /* Start count workers; has no effect once the pool is running */
+  static void start(unsigned int count) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (workers.empty()) {
+      stopping = false;
+      for (unsigned int i = 0; i < std::max(count, 1u); ++i) {
+        workers.emplace_back(workerLoop);
+      }
+      std::atexit(shutdown);
+    }
+  }
+
+  /* Starts the pool on first use: one worker per core, minus the calling thread */
+  static unsigned int workerCount() {
+    unsigned int cores = std::thread::hardware_concurrency();
+    start(cores > 1 ? cores - 1 : 1);
+    std::lock_guard<std::mutex> lock(mutex);
+    return workers.size();
+  }
+
+  /* Run a job on some worker; fire and forget */
+  static void submit(std::function<void()> job) {
+    workerCount();
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      queue.push_back(std::move(job));
+    }
+    wake.notify_one();
+  }
+
+  /*
+   * Call body(i) for every i in [0, count) across the workers and the calling
+   * thread, returning once all calls have finished. The caller works too, so
+   * this is safe to use from inside a job.
+   */
+  static void parallelFor(size_t count, const std::function<void(size_t)>& body) {
+    if (count == 0) {
+      return;
+    }
+
+    unsigned int helpers = workerCount();
+
+    std::shared_ptr<ParallelForState> state = std::make_shared<ParallelForState>();
+    state->count = count;
+    /* A few batches per thread keeps them busy when items vary in cost */
+    state->batch = std::max<size_t>(1, count / ((helpers + 1) * 4));
+
+    size_t helperCount = std::min<size_t>(helpers, (count + state->batch - 1) / state->batch - 1);
+    for (size_t i = 0; i < helperCount; ++i) {
+      /* A helper that starts after everything is done finds nothing left to claim and never touches body */
+      submit([state, &body] { runBatches(*state, body); });
+    }
+
+    runBatches(*state, body);
+
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->done.wait(lock, [&] { return state->completed.load() == count; });
+  }
+
+  static void shutdown() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread& worker : workers) {
+      worker.join();
+    }
+    workers.clear();
+  }
+};
+
+#endif
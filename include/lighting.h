@@ -0,0 +1,142 @@
+/*
+ * include/lighting.h
+ *
+ * Scene lights and fog, shared by every program through the "Lights"
+ * uniform block (src/shaders/include/lights.glsl) the same way the camera
+ * is. Set them from anywhere; Engine::refresh uploads them once per frame.
+ * How many lights are active also picks which PhongShader variant is drawn
+ * with, so unused lights cost nothing in the fragment shader. Past a handful
+ * of point lights, set clustered and they are culled per cluster instead
+ * (clusters.h).
+ */
+
+#ifndef LIGHTING_H
+#define LIGHTING_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include <glstate.h>
+
+/* Binding point of the "Lights" block; CAMERA_BLOCK_BINDING is 0 */
+#define LIGHTS_BLOCK_BINDING 1
+/* Size of the point light array in the block; keep in sync with MAX_POINT_LIGHTS in lights.glsl */
+#define LIGHTING_MAX_POINT_LIGHTS 16
+/* Light level treated as no light when working out how far a point light reaches */
+#define LIGHTING_CUTOFF (1.0f / 256.0f)
+
+struct DirectionalLight {
+  glm::vec3 direction = glm::vec3(-0.2f, -1.0f, -0.3f);
+  glm::vec3 ambient = glm::vec3(0.05f);
+  glm::vec3 diffuse = glm::vec3(0.4f);
+  glm::vec3 specular = glm::vec3(0.5f);
+};
+
+struct PointLight {
+  glm::vec3 position = glm::vec3(0.0f);
+  glm::vec3 ambient = glm::vec3(0.05f);
+  glm::vec3 diffuse = glm::vec3(0.8f);
+  glm::vec3 specular = glm::vec3(1.0f);
+  /* Attenuation 1 / (constant + linear * d + quadratic * d^2) */
+  float constant = 1.0f;
+  float linear = 0.09f;
+  float quadratic = 0.032f;
+
+  /* Distance at which the brightest diffuse channel falls below LIGHTING_CUTOFF; clustered lighting ignores the light past it */
+  float range() const {
+    float brightest = std::max(diffuse.x, std::max(diffuse.y, diffuse.z));
+    float limit = brightest / LIGHTING_CUTOFF - constant;
+    if (limit <= 0.0f) {
+      return 0.0f;
+    }
+    if (quadratic > 0.0f) {
+      return (-linear + std::sqrt(linear * linear + 4.0f * quadratic * limit)) / (2.0f * quadratic);
+    }
+    return linear > 0.0f ? limit / linear : INFINITY;
+  }
+};
+
+struct Fog {
+  glm::vec3 color = glm::vec3(0.3f);
+  float density = 0.05f; /* Exponential: visibility = exp(-density * distance) */
+};
+
+/* std140 image of the "Lights" block; every vec3 is padded to a vec4 */
+struct LightingUniforms {
+  glm::vec4 directionalDirection;
+  glm::vec4 directionalAmbient;
+  glm::vec4 directionalDiffuse;
+  glm::vec4 directionalSpecular;
+  glm::vec4 fog; /* rgb colour, a density */
+  glm::vec4 clusterParameters; /* See LightClusters::update */
+  struct {
+    glm::vec4 position; /* w constant */
+    glm::vec4 ambient;  /* w linear */
+    glm::vec4 diffuse;  /* w quadratic */
+    glm::vec4 specular;
+  } pointLights[LIGHTING_MAX_POINT_LIGHTS];
+};
+
+class Lighting {
+private:
+  inline static unsigned int buffer = 0;
+
+public:
+  inline static bool directionalEnabled = false;
+  inline static DirectionalLight directional;
+  /* Only the first LIGHTING_MAX_POINT_LIGHTS are used */
+  inline static std::vector<PointLight> pointLights;
+  inline static bool fogEnabled = false;
+  inline static Fog fog;
+  /*
+   * Shade point lights through LightClusters instead of the block. Each
+   * fragment then only loops over the lights that reach it, and there may be
+   * up to CLUSTER_MAX_LIGHTS of them.
+   */
+  inline static bool clustered = false;
+  /* Written by LightClusters::update */
+  inline static glm::vec4 clusterParameters = glm::vec4(0.0f);
+
+  /* Point lights held in the block itself; none when clustered */
+  static unsigned int pointLightCount() {
+    return clustered ? 0 : (unsigned int)std::min<size_t>(pointLights.size(), LIGHTING_MAX_POINT_LIGHTS);
+  }
+
+  /* Create the uniform buffer; needs a current context */
+  static void initialize() {
+    glGenBuffers(1, &buffer);
+    GLState::bindBuffer(GL_UNIFORM_BUFFER, buffer);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(LightingUniforms), NULL, GL_DYNAMIC_DRAW);
+    glBindBufferBase(GL_UNIFORM_BUFFER, LIGHTS_BLOCK_BINDING, buffer);
+  }
+
+  /* Write the active lights into the block; slots past pointLightCount() are never read */
+  static void upload() {
+    LightingUniforms uniforms;
+    uniforms.directionalDirection = glm::vec4(directional.direction, 0.0f);
+    uniforms.directionalAmbient = glm::vec4(directional.ambient, 0.0f);
+    uniforms.directionalDiffuse = glm::vec4(directional.diffuse, 0.0f);
+    uniforms.directionalSpecular = glm::vec4(directional.specular, 0.0f);
+    uniforms.fog = glm::vec4(fog.color, fog.density);
+    uniforms.clusterParameters = clusterParameters;
+
+    unsigned int count = pointLightCount();
+    for (unsigned int i = 0; i < count; ++i) {
+      const PointLight& light = pointLights[i];
+      uniforms.pointLights[i].position = glm::vec4(light.position, light.constant);
+      uniforms.pointLights[i].ambient = glm::vec4(light.ambient, light.linear);
+      uniforms.pointLights[i].diffuse = glm::vec4(light.diffuse, light.quadratic);
+      uniforms.pointLights[i].specular = glm::vec4(light.specular, 0.0f);
+    }
+
+    size_t used = sizeof(LightingUniforms) - (LIGHTING_MAX_POINT_LIGHTS - count) * sizeof(uniforms.pointLights[0]);
+    GLState::bindBuffer(GL_UNIFORM_BUFFER, buffer);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, used, &uniforms);
+  }
+};
+
+#endif
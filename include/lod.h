@@ -0,0 +1,75 @@
+/*
+ * include/lod.h
+ *
+ * Levels of detail for meshes. Every level is a range of the mesh's index
+ * buffer over the same vertices, generated at import time (see simplify.h),
+ * with the geometric error it introduces. Each frame Mesh picks the coarsest
+ * level whose error projects to less than errorPixels on screen.
+ */
+
+#ifndef LOD_H
+#define LOD_H
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+/* Levels per mesh, including the full resolution one */
+#define MESH_MAX_LODS 4
+
+struct MeshLod {
+  uint32_t indexOffset; /* First index of the level in the mesh's index buffer */
+  uint32_t indexCount;
+  float error;          /* Largest deviation from the full mesh, in object space units */
+};
+
+class LodSelector {
+public:
+  /* Screen space error, in pixels, a level may have */
+  inline static float errorPixels = 1.0f;
+  /* Fraction of errorPixels a level must beat to be switched to, and may exceed before being left, so levels don't flicker at the boundary */
+  inline static float hysteresis = 0.25f;
+  /* Objects whose bounding sphere covers fewer pixels across than this are not drawn */
+  inline static float cullPixels = 1.0f;
+
+  /* Pixels covered by one world unit at distance from a perspective camera */
+  static float pixelsPerUnit(float fov, float viewportHeight, float distance) {
+    return viewportHeight / (2.0f * std::tan(fov * 0.5f) * std::fmax(distance, 1e-4f));
+  }
+
+  static bool tooSmall(float radius, float pixelsPerUnit) {
+    return 2.0f * radius * pixelsPerUnit < cullPixels;
+  }
+
+  /*
+   * Level to draw given the current one and how many pixels one object space
+   * unit covers. Coarser levels are taken only once they are comfortably
+   * under the threshold and the current level is kept until it is clearly
+   * over it.
+   */
+  static unsigned int select(const std::vector<MeshLod>& lods, unsigned int current, float pixelsPerObjectUnit) {
+    if (lods.size() < 2) {
+      return 0;
+    }
+    if (current >= lods.size()) {
+      current = 0;
+    }
+
+    float coarser = errorPixels * (1.0f - hysteresis);
+    float finer = errorPixels * (1.0f + hysteresis);
+
+    if (lods[current].error * pixelsPerObjectUnit > finer) {
+      while (current > 0 && lods[current].error * pixelsPerObjectUnit > errorPixels) {
+        current--;
+      }
+      return current;
+    }
+
+    while (current + 1 < lods.size() && lods[current + 1].error * pixelsPerObjectUnit <= coarser) {
+      current++;
+    }
+    return current;
+  }
+};
+
+#endif
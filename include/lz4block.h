@@ -0,0 +1,175 @@
+/*
+ * include/lz4block.h
+ *
+ * The LZ4 block format (https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md),
+ * used to compress asset archive entries. Blocks written here decode with the
+ * reference decoder and the other way around. The compressor is a plain
+ * greedy single hash matcher; it only runs offline in tools/pack.cpp. The
+ * decoder checks every length against both buffers, so a damaged archive
+ * fails to load instead of reading or writing out of bounds.
+ */
+
+#ifndef LZ4BLOCK_H
+#define LZ4BLOCK_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#define LZ4_MIN_MATCH 4
+/* The last match must start at least 12 bytes before the end and the last 5 bytes are always literals */
+#define LZ4_MATCH_SAFE_DISTANCE 12
+#define LZ4_LAST_LITERALS 5
+#define LZ4_MAX_OFFSET 65535
+#define LZ4_HASH_BITS 16
+
+class LZ4Block {
+private:
+  static uint32_t read32(const uint8_t* p) {
+    uint32_t value;
+    memcpy(&value, p, 4);
+    return value;
+  }
+
+  static uint32_t hash(uint32_t sequence) {
+    return (sequence * 2654435761u) >> (32 - LZ4_HASH_BITS);
+  }
+
+  /* Lengths of 15 and more continue in extra bytes of 255 */
+  static void writeLength(std::vector<uint8_t>& out, size_t length) {
+    while (length >= 255) {
+      out.push_back(255);
+      length -= 255;
+    }
+    out.push_back((uint8_t)length);
+  }
+
+  static bool readLength(const uint8_t*& in, const uint8_t* end, size_t& length) {
+    uint8_t byte;
+    do {
+      if (in >= end) {
+        return false;
+      }
+      byte = *in++;
+      length += byte;
+    } while (byte == 255);
+    return true;
+  }
+
+  static void writeSequence(std::vector<uint8_t>& out, const uint8_t* literals, size_t literalLength, size_t offset, size_t matchLength) {
+    size_t matchCode = matchLength >= LZ4_MIN_MATCH ? matchLength - LZ4_MIN_MATCH : 0;
+    out.push_back((uint8_t)((literalLength < 15 ? literalLength : 15) << 4 | (matchLength == 0 ? 0 : (matchCode < 15 ? matchCode : 15))));
+    if (literalLength >= 15) {
+      writeLength(out, literalLength - 15);
+    }
+    out.insert(out.end(), literals, literals + literalLength);
+
+    if (matchLength == 0) {
+      return;
+    }
+    out.push_back((uint8_t)(offset & 0xFF));
+    out.push_back((uint8_t)(offset >> 8));
+    if (matchCode >= 15) {
+      writeLength(out, matchCode - 15);
+    }
+  }
+
+public:
+  /* Compress size bytes into a block appended to out */
+  static void compress(const uint8_t* data, size_t size, std::vector<uint8_t>& out) {
+    std::vector<uint32_t> table((size_t)1 << LZ4_HASH_BITS, UINT32_MAX);
+    size_t anchor = 0, position = 0;
+
+    if (size > LZ4_MATCH_SAFE_DISTANCE) {
+      size_t matchLimit = size - LZ4_MATCH_SAFE_DISTANCE;
+      size_t copyLimit = size - LZ4_LAST_LITERALS;
+
+      while (position < matchLimit) {
+        uint32_t sequence = read32(data + position);
+        uint32_t& slot = table[hash(sequence)];
+        size_t candidate = slot;
+        slot = (uint32_t)position;
+
+        if (candidate == UINT32_MAX || position - candidate > LZ4_MAX_OFFSET || read32(data + candidate) != sequence) {
+          position++;
+          continue;
+        }
+
+        size_t length = LZ4_MIN_MATCH;
+        while (position + length < copyLimit && data[candidate + length] == data[position + length]) {
+          length++;
+        }
+
+        writeSequence(out, data + anchor, position - anchor, position - candidate, length);
+        position += length;
+        anchor = position;
+      }
+    }
+
+    writeSequence(out, data + anchor, size - anchor, 0, 0);
+  }
+
+  /* Decode a block of inputSize bytes into exactly outputSize bytes; false if the block is malformed */
+  static bool decompress(const uint8_t* input, size_t inputSize, uint8_t* output, size_t outputSize) {
+    const uint8_t* in = input;
+    const uint8_t* inEnd = input + inputSize;
+    uint8_t* out = output;
+    uint8_t* outEnd = output + outputSize;
+
+    while (in < inEnd) {
+      uint8_t token = *in++;
+
+      size_t literalLength = token >> 4;
+      if (literalLength == 15 && !readLength(in, inEnd, literalLength)) {
+        return false;
+      }
+      if (literalLength > (size_t)(inEnd - in) || literalLength > (size_t)(outEnd - out)) {
+        return false;
+      }
+      if (literalLength > 0) {
+        memcpy(out, in, literalLength);
+      }
+      in += literalLength;
+      out += literalLength;
+
+      /* The last sequence has no match */
+      if (in == inEnd) {
+        break;
+      }
+
+      if (inEnd - in < 2) {
+        return false;
+      }
+      size_t offset = in[0] | (size_t)in[1] << 8;
+      in += 2;
+      if (offset == 0 || offset > (size_t)(out - output)) {
+        return false;
+      }
+
+      size_t matchLength = token & 15;
+      if (matchLength == 15 && !readLength(in, inEnd, matchLength)) {
+        return false;
+      }
+      matchLength += LZ4_MIN_MATCH;
+      if (matchLength > (size_t)(outEnd - out)) {
+        return false;
+      }
+
+      /* Matches may overlap their own output, so copy forwards byte by byte when they do */
+      const uint8_t* match = out - offset;
+      if (offset >= matchLength) {
+        memcpy(out, match, matchLength);
+        out += matchLength;
+      } else {
+        for (size_t i = 0; i < matchLength; ++i) {
+          *out++ = match[i];
+        }
+      }
+    }
+
+    return out == outEnd;
+  }
+};
+
+#endif
@@ -0,0 +1,110 @@
+/*
+ * include/mappedfile.h
+ *
+ * Read-only memory mapping of a whole file, used by the cooked asset formats.
+ */
+
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <cstddef>
+#include <string>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/* Read-only view of a whole file, mapped into memory */
+class MappedFile {
+private:
+#ifdef _WIN32
+  HANDLE file = INVALID_HANDLE_VALUE;
+  HANDLE mapping = NULL;
+#endif
+
+public:
+  const unsigned char* data = nullptr;
+  size_t size = 0;
+
+  MappedFile() {}
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  ~MappedFile() {
+    close();
+  }
+
+  bool open(const std::string& path) {
+    close();
+#ifdef _WIN32
+    file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+      return false;
+    }
+
+    LARGE_INTEGER fileSize;
+    GetFileSizeEx(file, &fileSize);
+    size = (size_t)fileSize.QuadPart;
+
+    mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping == NULL) {
+      close();
+      return false;
+    }
+    data = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+    int descriptor = ::open(path.c_str(), O_RDONLY);
+    if (descriptor < 0) {
+      return false;
+    }
+
+    struct stat status;
+    if (fstat(descriptor, &status) != 0 || status.st_size == 0) {
+      ::close(descriptor);
+      return false;
+    }
+    size = (size_t)status.st_size;
+
+    void* mapped = mmap(NULL, size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+    ::close(descriptor);
+
+    if (mapped == MAP_FAILED) {
+      size = 0;
+      return false;
+    }
+    /* The whole file is about to be read front to back */
+    madvise(mapped, size, MADV_SEQUENTIAL | MADV_WILLNEED);
+    data = (const unsigned char*)mapped;
+#endif
+    return data != nullptr;
+  }
+
+  void close() {
+#ifdef _WIN32
+    if (data != nullptr) {
+      UnmapViewOfFile(data);
+    }
+    if (mapping != NULL) {
+      CloseHandle(mapping);
+      mapping = NULL;
+    }
+    if (file != INVALID_HANDLE_VALUE) {
+      CloseHandle(file);
+      file = INVALID_HANDLE_VALUE;
+    }
+#else
+    if (data != nullptr) {
+      munmap((void*)data, size);
+    }
+#endif
+    data = nullptr;
+    size = 0;
+  }
+};
+
+#endif
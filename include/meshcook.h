@@ -0,0 +1,132 @@
+/*
+ * include/meshcook.h
+ *
+ * Offline side of the cooked mesh format: import a model (see importer.h) and
+ * write it out as a .nmesh file (see meshfile.h). Used by tools/cook.cpp;
+ * nothing in here touches OpenGL.
+ */
+
+#ifndef MESHCOOK_H
+#define MESHCOOK_H
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <culling.h>
+#include <importer.h>
+#include <meshfile.h>
+#include <texture.h>
+#include <vertex.h>
+
+class MeshCooker {
+private:
+  std::string strings;
+
+  uint32_t addString(const char* text) {
+    uint32_t offset = strings.size();
+    strings.append(text);
+    strings.push_back('\0');
+    return offset;
+  }
+
+  static uint64_t align(uint64_t offset) {
+    return (offset + MESH_FILE_ALIGNMENT - 1) & ~(uint64_t)(MESH_FILE_ALIGNMENT - 1);
+  }
+
+public:
+  /* Import source with assimp and write the cooked result to output. Returns false on failure. */
+  bool cook(const std::string& source, const std::string& output) {
+    ImportedModel model;
+    if (!importModel(source, model, false)) {
+      return false;
+    }
+
+    strings.clear();
+    std::vector<MeshFileEntry> entries(model.meshes.size());
+
+    for (size_t i = 0; i < model.meshes.size(); ++i) {
+      const ImportedMesh& mesh = model.meshes[i];
+      MeshFileEntry& entry = entries[i];
+      memset(&entry, 0, sizeof(entry));
+
+      entry.vertexAttributes = mesh.quantization.attributes;
+      entry.vertexCount = mesh.vertexCount();
+      entry.indexCount = mesh.indices.size();
+
+      for (int axis = 0; axis < 3; ++axis) {
+        entry.boundsMin[axis] = mesh.bounds.min[axis];
+        entry.boundsMax[axis] = mesh.bounds.max[axis];
+        entry.boundsCenter[axis] = mesh.bounds.center[axis];
+      }
+      entry.boundsRadius = mesh.bounds.radius;
+      entry.dequantizeOffset[0] = mesh.quantization.offset.x;
+      entry.dequantizeOffset[1] = mesh.quantization.offset.y;
+      entry.dequantizeOffset[2] = mesh.quantization.offset.z;
+      entry.dequantizeScale = mesh.quantization.scale;
+
+      entry.lodCount = std::min<size_t>(mesh.lods.size(), MESH_MAX_LODS);
+      std::copy(mesh.lods.begin(), mesh.lods.begin() + entry.lodCount, entry.lods);
+
+      const MeshOptimizationStats& stats = mesh.optimization;
+      std::cout << "NEPTUNE::INFO: Mesh " << i << ": " << mesh.lods[0].indexCount / 3 << " triangles, vertices " << stats.verticesBefore << " -> " << stats.verticesAfter
+                << ", ACMR " << stats.cacheBefore.acmr << " -> " << stats.cacheAfter.acmr << ", ATVR " << stats.cacheBefore.atvr << " -> " << stats.cacheAfter.atvr
+                << ", overfetch " << stats.fetchBefore.overfetch << " -> " << stats.fetchAfter.overfetch
+                << ", " << VertexQuantizer::layoutName(mesh.quantization.attributes) << " (" << vertexStride(mesh.quantization.attributes) << " bytes per vertex)" << std::endl;
+      for (size_t l = 1; l < mesh.lods.size(); ++l) {
+        std::cout << "NEPTUNE::INFO:   LOD " << l << ": " << mesh.lods[l].indexCount / 3 << " triangles, error " << mesh.lods[l].error << std::endl;
+      }
+
+      for (const ImportedTexture& texture : mesh.textures) {
+        if (entry.textureCount == MESH_FILE_MAX_TEXTURES) {
+          break;
+        }
+        entry.textures[entry.textureCount].type = texture.type;
+        entry.textures[entry.textureCount].path = addString(texture.path.c_str());
+        entry.textureCount++;
+      }
+    }
+
+    /* Place the blobs after the tables */
+    uint64_t offset = sizeof(MeshFileHeader) + entries.size() * sizeof(MeshFileEntry) + strings.size();
+    for (size_t i = 0; i < entries.size(); ++i) {
+      entries[i].vertexOffset = offset = align(offset);
+      offset += model.meshes[i].vertexBytes();
+      entries[i].indexOffset = offset = align(offset);
+      offset += model.meshes[i].indices.size() * sizeof(unsigned int);
+    }
+
+    MeshFileHeader header;
+    memcpy(header.magic, MESH_FILE_MAGIC, 4);
+    header.version = MESH_FILE_VERSION;
+    header.meshCount = entries.size();
+    header.stringTableSize = strings.size();
+
+    std::ofstream file(output, std::ios::binary | std::ios::trunc);
+    if (!file) {
+      std::cout << "ERROR::COOK::CANNOT_WRITE: " << output << std::endl;
+      return false;
+    }
+
+    file.write((const char*)&header, sizeof(header));
+    file.write((const char*)entries.data(), entries.size() * sizeof(MeshFileEntry));
+    file.write(strings.data(), strings.size());
+
+    static const char padding[MESH_FILE_ALIGNMENT] = { 0 };
+    std::vector<uint8_t> vertexData;
+    for (size_t i = 0; i < entries.size(); ++i) {
+      file.write(padding, entries[i].vertexOffset - (uint64_t)file.tellp());
+      vertexData.resize(model.meshes[i].vertexBytes());
+      model.meshes[i].writeVertices(vertexData.data());
+      file.write((const char*)vertexData.data(), vertexData.size());
+      file.write(padding, entries[i].indexOffset - (uint64_t)file.tellp());
+      file.write((const char*)model.meshes[i].indices.data(), model.meshes[i].indices.size() * sizeof(unsigned int));
+    }
+
+    return (bool)file;
+  }
+};
+
+#endif
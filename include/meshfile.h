@@ -0,0 +1,125 @@
+/*
+ * include/meshfile.h
+ *
+ * Cooked mesh container (.nmesh). Written offline by tools/cook.cpp and
+ * memory mapped at runtime (or read from an asset pack) so vertex and index data is uploaded straight from
+ * the mapping, without parsing or intermediate copies.
+ *
+ * Layout (all integers little endian):
+ *
+ *   MeshFileHeader
+ *   MeshFileEntry[meshCount]
+ *   string table (stringTableSize bytes of NUL terminated texture paths)
+ *   vertex and index blobs, each aligned to MESH_FILE_ALIGNMENT
+ */
+
+#ifndef MESHFILE_H
+#define MESHFILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include <archive.h>
+#include <lod.h>
+#include <vertex.h>
+
+#define MESH_FILE_MAGIC "NMSH"
+#define MESH_FILE_VERSION 3
+#define MESH_FILE_ALIGNMENT 16
+#define MESH_FILE_MAX_TEXTURES 4
+#define MESH_FILE_EXTENSION ".nmesh"
+
+struct MeshFileHeader {
+  char magic[4];
+  uint32_t version;
+  uint32_t meshCount;
+  uint32_t stringTableSize;
+};
+
+/* A texture used by a mesh; path is an offset into the string table, relative to the model's directory */
+struct MeshFileTexture {
+  uint32_t type; /* TextureType */
+  uint32_t path;
+};
+
+struct MeshFileEntry {
+  uint32_t vertexAttributes; /* VertexAttributes of the vertex blob */
+  uint32_t vertexCount;
+  uint32_t indexCount;       /* 32 bit indices */
+  uint32_t textureCount;
+  uint64_t vertexOffset;     /* From the start of the file */
+  uint64_t indexOffset;
+
+  /* BoundingVolume */
+  float boundsMin[3];
+  float boundsMax[3];
+  float boundsCenter[3];
+  float boundsRadius;
+
+  /* Quantized layouts only: object space position = offset + stored position * scale */
+  float dequantizeOffset[3];
+  float dequantizeScale;
+
+  /* Levels of detail as ranges of the index blob, finest first */
+  uint32_t lodCount;
+  MeshLod lods[MESH_MAX_LODS];
+
+  MeshFileTexture textures[MESH_FILE_MAX_TEXTURES];
+};
+
+/*
+ * Check a mapped .nmesh before trusting any offset in it. Returns the entry
+ * table, or nullptr if the file is not a mesh file this build can read.
+ */
+const MeshFileEntry* meshFileEntries(const AssetFile& file, const MeshFileHeader*& header, const char*& strings) {
+  if (file.size < sizeof(MeshFileHeader)) {
+    return nullptr;
+  }
+
+  header = (const MeshFileHeader*)file.data;
+  if (memcmp(header->magic, MESH_FILE_MAGIC, 4) != 0 || header->version != MESH_FILE_VERSION) {
+    return nullptr;
+  }
+
+  size_t tableEnd = sizeof(MeshFileHeader) + (size_t)header->meshCount * sizeof(MeshFileEntry) + header->stringTableSize;
+  if (tableEnd > file.size) {
+    return nullptr;
+  }
+
+  const MeshFileEntry* entries = (const MeshFileEntry*)(file.data + sizeof(MeshFileHeader));
+  strings = (const char*)(entries + header->meshCount);
+
+  for (uint32_t i = 0; i < header->meshCount; ++i) {
+    const MeshFileEntry& entry = entries[i];
+    uint64_t vertexBytes = (uint64_t)entry.vertexCount * vertexStride((enum VertexAttributes)entry.vertexAttributes);
+    uint64_t indexBytes = (uint64_t)entry.indexCount * sizeof(uint32_t);
+
+    if (vertexBytes == 0 || entry.vertexOffset + vertexBytes > file.size || entry.indexOffset + indexBytes > file.size || entry.textureCount > MESH_FILE_MAX_TEXTURES) {
+      return nullptr;
+    }
+    for (uint32_t t = 0; t < entry.textureCount; ++t) {
+      if (entry.textures[t].path >= header->stringTableSize) {
+        return nullptr;
+      }
+    }
+    if (entry.lodCount == 0 || entry.lodCount > MESH_MAX_LODS) {
+      return nullptr;
+    }
+    for (uint32_t l = 0; l < entry.lodCount; ++l) {
+      if ((uint64_t)entry.lods[l].indexOffset + entry.lods[l].indexCount > entry.indexCount) {
+        return nullptr;
+      }
+    }
+  }
+
+  /* The string table must end in a terminator so no path can run past it */
+  if (header->stringTableSize > 0 && strings[header->stringTableSize - 1] != '\0') {
+    return nullptr;
+  }
+
+  return entries;
+}
+
+#endif
@@ -0,0 +1,222 @@
+/*
+ * include/mipgen.h
+ *
+ * Offline mip chain generation for tools/texcompress.cpp. Levels are averaged
+ * in linear light (sRGB colour is decoded first and encoded again after), with
+ * a 2x2 box kernel vectorised with SSE, or AVX2 when built with -mavx2, and
+ * rows spread over the job system. Channel aware options renormalise normal
+ * maps and keep the alpha test coverage of cut out textures such as foliage.
+ */
+
+#ifndef MIPGEN_H
+#define MIPGEN_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define NEPTUNE_MIPGEN_SSE
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+#define NEPTUNE_MIPGEN_AVX2
+#include <immintrin.h>
+#endif
+
+#include <jobs.h>
+
+/* Mip levels of an RGBA8 image, largest first */
+struct MipChain {
+  std::vector<uint32_t> widths;
+  std::vector<uint32_t> heights;
+  std::vector<std::vector<uint8_t>> levels;
+};
+
+struct MipOptions {
+  bool srgb = true;         /* Colour channels are sRGB encoded; false for data such as specular or normal maps */
+  bool normalMap = false;   /* RGB holds a unit vector; renormalised in every level */
+  float alphaCutoff = 0.0f; /* Above 0, alpha is rescaled so each level passes an alpha test at this cutoff as often as level 0 */
+};
+
+class MipGenerator {
+private:
+  /* 16 bit linear value to 8 bit sRGB; fine enough that no dark value is off by more than rounding */
+  inline static std::vector<uint8_t> encodeTable;
+  inline static float decodeTable[256];
+
+  static void buildTables() {
+    if (!encodeTable.empty()) {
+      return;
+    }
+    for (int i = 0; i < 256; ++i) {
+      float value = i / 255.0f;
+      decodeTable[i] = value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+    }
+    encodeTable.resize(65536);
+    for (int i = 0; i < 65536; ++i) {
+      float value = i / 65535.0f;
+      float encoded = value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+      encodeTable[i] = (uint8_t)std::lround(std::clamp(encoded, 0.0f, 1.0f) * 255.0f);
+    }
+  }
+
+  /* Average 2x2 texels of two source rows into one output row; odd edges repeat the last texel */
+  static void downsampleRow(const float* row0, const float* row1, float* out, uint32_t sourceWidth, uint32_t width) {
+    uint32_t x = 0;
+#ifdef NEPTUNE_MIPGEN_AVX2
+    /* Two output texels per iteration: [p0 p1] and [p2 p3] become [p0+p1 p2+p3] */
+    const __m256 quarter = _mm256_set1_ps(0.25f);
+    for (; x + 1 < width && 2 * x + 3 < sourceWidth; x += 2) {
+      __m256 a0 = _mm256_loadu_ps(row0 + x * 8), b0 = _mm256_loadu_ps(row0 + x * 8 + 8);
+      __m256 a1 = _mm256_loadu_ps(row1 + x * 8), b1 = _mm256_loadu_ps(row1 + x * 8 + 8);
+      __m256 even = _mm256_add_ps(_mm256_permute2f128_ps(a0, b0, 0x20), _mm256_permute2f128_ps(a1, b1, 0x20));
+      __m256 odd = _mm256_add_ps(_mm256_permute2f128_ps(a0, b0, 0x31), _mm256_permute2f128_ps(a1, b1, 0x31));
+      _mm256_storeu_ps(out + x * 4, _mm256_mul_ps(_mm256_add_ps(even, odd), quarter));
+    }
+#endif
+#ifdef NEPTUNE_MIPGEN_SSE
+    const __m128 quarterSSE = _mm_set1_ps(0.25f);
+    for (; x < width && 2 * x + 1 < sourceWidth; ++x) {
+      __m128 top = _mm_add_ps(_mm_loadu_ps(row0 + x * 8), _mm_loadu_ps(row0 + x * 8 + 4));
+      __m128 bottom = _mm_add_ps(_mm_loadu_ps(row1 + x * 8), _mm_loadu_ps(row1 + x * 8 + 4));
+      _mm_storeu_ps(out + x * 4, _mm_mul_ps(_mm_add_ps(top, bottom), quarterSSE));
+    }
+#endif
+    for (; x < width; ++x) {
+      uint32_t x0 = std::min(2 * x, sourceWidth - 1), x1 = std::min(2 * x + 1, sourceWidth - 1);
+      for (int c = 0; c < 4; ++c) {
+        out[x * 4 + c] = (row0[x0 * 4 + c] + row0[x1 * 4 + c] + row1[x0 * 4 + c] + row1[x1 * 4 + c]) * 0.25f;
+      }
+    }
+  }
+
+  static float coverage(const std::vector<float>& level, float scale, float cutoff) {
+    size_t passed = 0, count = level.size() / 4;
+    for (size_t i = 0; i < count; ++i) {
+      passed += level[i * 4 + 3] * scale >= cutoff;
+    }
+    return (float)passed / count;
+  }
+
+  /* Alpha scale that brings the level's coverage closest to target */
+  static float coverageScale(const std::vector<float>& level, float cutoff, float target) {
+    float low = 0.0f, high = 4.0f;
+    for (int i = 0; i < 12; ++i) {
+      float middle = (low + high) * 0.5f;
+      if (coverage(level, middle, cutoff) < target) {
+        low = middle;
+      } else {
+        high = middle;
+      }
+    }
+    return (low + high) * 0.5f;
+  }
+
+  static void toLinear(const uint8_t* rgba, std::vector<float>& level, const MipOptions& options) {
+    JobSystem::parallelFor(level.size() / 4, [&](size_t i) {
+      for (int c = 0; c < 3; ++c) {
+        level[i * 4 + c] = options.srgb ? decodeTable[rgba[i * 4 + c]] : rgba[i * 4 + c] / 255.0f;
+      }
+      level[i * 4 + 3] = rgba[i * 4 + 3] / 255.0f;
+    });
+  }
+
+  static void toBytes(const std::vector<float>& level, std::vector<uint8_t>& rgba, uint32_t width, float alphaScale, const MipOptions& options) {
+    size_t height = level.size() / 4 / width;
+    JobSystem::parallelFor(height, [&](size_t y) {
+      const float* in = &level[y * width * 4];
+      uint8_t* out = &rgba[y * width * 4];
+      size_t x = 0;
+#ifdef NEPTUNE_MIPGEN_SSE
+      /* Colour to table indices four channels at a time */
+      const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+      const __m128 scale = options.srgb ? _mm_set_ps(255.0f * alphaScale, 65535.0f, 65535.0f, 65535.0f) : _mm_set_ps(255.0f * alphaScale, 255.0f, 255.0f, 255.0f);
+      const __m128 half = _mm_set1_ps(0.5f);
+      const __m128 alphaMaximum = _mm_set_ps(255.0f, options.srgb ? 65535.0f : 255.0f, options.srgb ? 65535.0f : 255.0f, options.srgb ? 65535.0f : 255.0f);
+      alignas(16) int32_t values[4];
+      for (; x < width; ++x) {
+        __m128 texel = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(in + x * 4), zero), one);
+        __m128 scaled = _mm_min_ps(_mm_add_ps(_mm_mul_ps(texel, scale), half), alphaMaximum);
+        _mm_store_si128((__m128i*)values, _mm_cvttps_epi32(scaled));
+        for (int c = 0; c < 3; ++c) {
+          out[x * 4 + c] = options.srgb ? encodeTable[values[c]] : (uint8_t)values[c];
+        }
+        out[x * 4 + 3] = (uint8_t)values[3];
+      }
+#endif
+      for (; x < width; ++x) {
+        for (int c = 0; c < 3; ++c) {
+          float value = std::clamp(in[x * 4 + c], 0.0f, 1.0f);
+          out[x * 4 + c] = options.srgb ? encodeTable[(int)(value * 65535.0f + 0.5f)] : (uint8_t)(value * 255.0f + 0.5f);
+        }
+        out[x * 4 + 3] = (uint8_t)std::min(255.0f, std::clamp(in[x * 4 + 3], 0.0f, 1.0f) * alphaScale * 255.0f + 0.5f);
+      }
+    });
+  }
+
+  static void renormalize(std::vector<float>& level) {
+    JobSystem::parallelFor(level.size() / 4, [&](size_t i) {
+      float* texel = &level[i * 4];
+      float x = texel[0] * 2.0f - 1.0f, y = texel[1] * 2.0f - 1.0f, z = texel[2] * 2.0f - 1.0f;
+      float length = std::sqrt(x * x + y * y + z * z);
+      if (length > 0.0f) {
+        texel[0] = x / length * 0.5f + 0.5f;
+        texel[1] = y / length * 0.5f + 0.5f;
+        texel[2] = z / length * 0.5f + 0.5f;
+      }
+    });
+  }
+
+public:
+  /* Full chain down to 1x1; level 0 is the input unchanged */
+  static MipChain build(const uint8_t* rgba, uint32_t width, uint32_t height, const MipOptions& options) {
+    buildTables();
+
+    MipChain chain;
+    chain.widths.push_back(width);
+    chain.heights.push_back(height);
+    chain.levels.emplace_back(rgba, rgba + (size_t)width * height * 4);
+
+    MipOptions levelOptions = options;
+    /* Normals are vectors, not colours */
+    levelOptions.srgb = options.srgb && !options.normalMap;
+
+    std::vector<float> source((size_t)width * height * 4);
+    toLinear(rgba, source, levelOptions);
+
+    float targetCoverage = options.alphaCutoff > 0.0f ? coverage(source, 1.0f, options.alphaCutoff) : 0.0f;
+
+    while (width > 1 || height > 1) {
+      uint32_t sourceWidth = width, sourceHeight = height;
+      width = std::max(1u, width / 2);
+      height = std::max(1u, height / 2);
+
+      std::vector<float> level((size_t)width * height * 4);
+      JobSystem::parallelFor(height, [&](size_t y) {
+        const float* row0 = &source[std::min<size_t>(2 * y, sourceHeight - 1) * sourceWidth * 4];
+        const float* row1 = &source[std::min<size_t>(2 * y + 1, sourceHeight - 1) * sourceWidth * 4];
+        downsampleRow(row0, row1, &level[y * width * 4], sourceWidth, width);
+      });
+
+      if (options.normalMap) {
+        renormalize(level);
+      }
+
+      float alphaScale = options.alphaCutoff > 0.0f ? coverageScale(level, options.alphaCutoff, targetCoverage) : 1.0f;
+
+      std::vector<uint8_t> bytes((size_t)width * height * 4);
+      toBytes(level, bytes, width, alphaScale, levelOptions);
+
+      chain.widths.push_back(width);
+      chain.heights.push_back(height);
+      chain.levels.push_back(std::move(bytes));
+      source.swap(level);
+    }
+
+    return chain;
+  }
+};
+
+#endif
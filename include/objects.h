@@ -21,52 +21,246 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include <algorithm>
+#include <filesystem>
+#include <string>
 #include <vector>
 
 #include <texture.h>
 #include <error.h>
 #include <globals.h>
-
-struct Vertex {
-  glm::vec3 Position;
-  glm::vec3 Normal;
-  glm::vec2 TexCoords;
-};
-
+#include <renderqueue.h>
+#include <glstate.h>
+#include <culling.h>
+#include <vertex.h>
+#include <meshfile.h>
+#include <importer.h>
+#include <lod.h>
+#include <trace.h>
+#include <phong.h>
+
+/* Build a model matrix: translation, then rotation (degrees, X then Y then Z), then scale */
+glm::mat4 transformMatrix(glm::vec3 pos, glm::vec3 rotation, glm::vec3 scale) {
+  glm::mat4 model = glm::translate(glm::mat4(1.0f), pos);
+
+  model = glm::rotate(model, glm::radians(rotation.x), glm::vec3(1, 0, 0));
+  model = glm::rotate(model, glm::radians(rotation.y), glm::vec3(0, 1, 0));
+  model = glm::rotate(model, glm::radians(rotation.z), glm::vec3(0, 0, 1));
+
+  return glm::scale(model, scale);
+}
 
 /*
- * Define what vertex attributes are used and in what order. If a normal or
- * texture vector/coordinate isn't needed, there is no point in storing that
- * data
+ * Matrix that takes object space normals to world space for a transform
+ * built from scale: the inverse transpose of its upper 3x3. Under uniform
+ * scale that is the 3x3 itself up to a factor, which shaders normalize away,
+ * so the inverse is skipped.
  */
-enum VertexAttributes {
-  POSITION,
-  POSITION_NORMAL,
-  POSITION_TEXTURE,
-  POSITION_NORMAL_TEXTURE,
-};
+glm::mat3 normalTransform(const glm::mat4& model, glm::vec3 scale) {
+  glm::vec3 size = glm::abs(scale);
+  if (size.x == size.y && size.y == size.z) {
+    return glm::mat3(model);
+  }
+  return glm::transpose(glm::inverse(glm::mat3(model)));
+}
 
-/* Vertex and index data for a given object */
+/*
+ * Vertex and index data for a given object. Next to the interleaved vertex
+ * buffer there is a position-only copy (positionStride bytes per vertex)
+ * with its own VAO sharing the index buffer, so depth-only passes fetch a
+ * fraction of the data.
+ */
 struct VertexDataObject {
   unsigned int VAO, VBO, EBO;
+  unsigned int depthVAO, positionVBO;
+
+  /* Only used between the mapping constructor and finish() */
+  size_t vertexBytes = 0, indexCount = 0;
+  enum VertexAttributes vertexAttributes = POSITION_NORMAL_TEXTURE;
+  std::vector<uint8_t> vertexStaging;
+  std::vector<uint8_t> positionStaging;
+  std::vector<uint8_t> indexStaging;
+
+  /* Map size bytes of the buffer bound to target for writing; a driver that refuses gets a staging copy, uploaded by finish(), instead */
+  static void* mapForWriting(GLenum target, size_t size, std::vector<uint8_t>& staging) {
+    void* mapped = size > 0 ? glMapBufferRange(target, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT) : nullptr;
+    if (mapped == nullptr && size > 0) {
+      staging.resize(size);
+      mapped = staging.data();
+    }
+    return mapped;
+  }
 
-  VertexDataObject(std::vector<float> vertices, std::vector<unsigned int> indices, enum VertexAttributes vertexAttributes) {
+  VertexDataObject(const std::vector<float>& vertices, const std::vector<unsigned int>& indices, enum VertexAttributes vertexAttributes)
+    : VertexDataObject(vertices.data(), vertices.size() * sizeof(float), indices.data(), indices.size(), vertexAttributes) {
+  }
+
+  /* Upload from raw memory, e.g. straight out of a memory mapped cooked mesh */
+  VertexDataObject(const void* vertices, size_t vertexBytes, const unsigned int* indices, size_t indexCount, enum VertexAttributes vertexAttributes) {
     glGenVertexArrays(1, &VAO);
     glGenBuffers(1, &VBO);
 
-    glBindVertexArray(VAO);
+    GLState::bindVertexArray(VAO);
+
+    GLState::bindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBufferData(GL_ARRAY_BUFFER, vertexBytes, vertices, GL_STATIC_DRAW);
 
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
+    glGenBuffers(1, &EBO);
+
+    GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(unsigned int), indices, GL_STATIC_DRAW);
+    Trace::uploaded(vertexBytes + indexCount * sizeof(unsigned int));
+
+    setAttributes(vertexAttributes);
+
+    /* Positions are pulled out straight into the mapped buffer, so a memory mapped mesh is still never copied on the heap */
+    size_t vertexCount = vertexBytes / vertexStride(vertexAttributes);
+    size_t positionBytes = vertexCount * positionStride(vertexAttributes);
+    createPositionStream(positionBytes);
+    void* positions = positionBytes > 0 ? glMapBufferRange(GL_ARRAY_BUFFER, 0, positionBytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT) : nullptr;
+    if (positions != nullptr) {
+      copyPositions(vertices, vertexCount, vertexAttributes, positions);
+      if (glUnmapBuffer(GL_ARRAY_BUFFER) == GL_FALSE) {
+        positions = nullptr;
+      }
+    }
+    /* The driver refused the mapping or lost its contents */
+    if (positions == nullptr && positionBytes > 0) {
+      std::vector<uint8_t> staging(positionBytes);
+      copyPositions(vertices, vertexCount, vertexAttributes, staging.data());
+      glBufferSubData(GL_ARRAY_BUFFER, 0, positionBytes, staging.data());
+    }
+    setPositionAttribute(vertexAttributes);
+  }
 
+  /*
+   * Create the buffers at their final size and map them for writing, so data
+   * can be produced straight into them instead of into a temporary copy.
+   * vertices, positions (the position-only stream) and indices may be filled
+   * from any thread; finish() must then be called on this one before the
+   * buffers are used.
+   */
+  VertexDataObject(size_t vertexBytes, size_t indexCount, enum VertexAttributes vertexAttributes, void*& vertices, void*& positions, unsigned int*& indices)
+    : vertexBytes(vertexBytes), indexCount(indexCount), vertexAttributes(vertexAttributes) {
+    glGenVertexArrays(1, &VAO);
+    glGenBuffers(1, &VBO);
     glGenBuffers(1, &EBO);
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+    GLState::bindVertexArray(VAO);
+
+    GLState::bindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBufferData(GL_ARRAY_BUFFER, vertexBytes, NULL, GL_STATIC_DRAW);
+    vertices = mapForWriting(GL_ARRAY_BUFFER, vertexBytes, vertexStaging);
 
+    GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(unsigned int), NULL, GL_STATIC_DRAW);
+    indices = (unsigned int*)mapForWriting(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(unsigned int), indexStaging);
 
-    /* Set vertex attributes according to the attributes specified by the caller */
+    size_t positionBytes = vertexBytes / vertexStride(vertexAttributes) * positionStride(vertexAttributes);
+    createPositionStream(positionBytes);
+    positions = mapForWriting(GL_ARRAY_BUFFER, positionBytes, positionStaging);
 
+    /* Whether mapped or staged, every byte ends up in the buffers */
+    Trace::uploaded(vertexBytes + indexCount * sizeof(unsigned int));
+  }
+
+  /*
+   * Unmap (or upload the staging copy) and set up the vertex attributes.
+   * Returns false if the driver lost the mapped contents, in which case the
+   * pointers are set up again, mapped or staged like in the constructor, for
+   * the data to be rewritten before the next call.
+   */
+  bool finish(void*& vertices, void*& positions, unsigned int*& indices) {
+    size_t positionBytes = vertexBytes / vertexStride(vertexAttributes) * positionStride(vertexAttributes);
+
+    GLState::bindVertexArray(VAO);
+    GLState::bindBuffer(GL_ARRAY_BUFFER, VBO);
+    GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+
+    bool intact = true;
+    if (!vertexStaging.empty()) {
+      glBufferSubData(GL_ARRAY_BUFFER, 0, vertexBytes, vertexStaging.data());
+      std::vector<uint8_t>().swap(vertexStaging);
+    } else if (vertexBytes > 0 && glUnmapBuffer(GL_ARRAY_BUFFER) == GL_FALSE) {
+      intact = false;
+    }
+    if (!indexStaging.empty()) {
+      glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, indexCount * sizeof(unsigned int), indexStaging.data());
+      std::vector<uint8_t>().swap(indexStaging);
+    } else if (indexCount > 0 && glUnmapBuffer(GL_ELEMENT_ARRAY_BUFFER) == GL_FALSE) {
+      intact = false;
+    }
+
+    GLState::bindBuffer(GL_ARRAY_BUFFER, positionVBO);
+    if (!positionStaging.empty()) {
+      glBufferSubData(GL_ARRAY_BUFFER, 0, positionBytes, positionStaging.data());
+      std::vector<uint8_t>().swap(positionStaging);
+    } else if (positionBytes > 0 && glUnmapBuffer(GL_ARRAY_BUFFER) == GL_FALSE) {
+      intact = false;
+    }
+
+    if (!intact) {
+      std::cout << "ERROR::VERTEX_DATA_OBJECT::MAPPED_DATA_LOST" << std::endl;
+      positions = mapForWriting(GL_ARRAY_BUFFER, positionBytes, positionStaging);
+      GLState::bindBuffer(GL_ARRAY_BUFFER, VBO);
+      vertices = mapForWriting(GL_ARRAY_BUFFER, vertexBytes, vertexStaging);
+      indices = (unsigned int*)mapForWriting(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(unsigned int), indexStaging);
+      return false;
+    }
+
+    GLState::bindBuffer(GL_ARRAY_BUFFER, VBO);
+    setAttributes(vertexAttributes);
+
+    GLState::bindVertexArray(depthVAO);
+    GLState::bindBuffer(GL_ARRAY_BUFFER, positionVBO);
+    setPositionAttribute(vertexAttributes);
+    return true;
+  }
+
+  /* Create the position-only buffer, size bytes left for the caller to fill, and its VAO, which is left bound with the buffer */
+  void createPositionStream(size_t size) {
+    glGenVertexArrays(1, &depthVAO);
+    glGenBuffers(1, &positionVBO);
+
+    GLState::bindVertexArray(depthVAO);
+    GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    GLState::bindBuffer(GL_ARRAY_BUFFER, positionVBO);
+    glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_STATIC_DRAW);
+    Trace::uploaded(size);
+  }
+
+  /* Delete the VAO and buffers, e.g. after a failed upload */
+  void destroy() {
+    GLState::bindVertexArray(0);
+    GLState::forgetBuffer(VBO);
+    GLState::forgetBuffer(EBO);
+    GLState::forgetBuffer(positionVBO);
+    glDeleteBuffers(1, &VBO);
+    glDeleteBuffers(1, &EBO);
+    glDeleteBuffers(1, &positionVBO);
+    glDeleteVertexArrays(1, &VAO);
+    glDeleteVertexArrays(1, &depthVAO);
+  }
+
+  /* Position attribute of the position-only stream, for the bound VAO and GL_ARRAY_BUFFER */
+  static void setPositionAttribute(enum VertexAttributes vertexAttributes) {
+    GLsizei stride = positionStride(vertexAttributes);
+    if (vertexAttributes == POSITION_NORMAL_TEXTURE_QUANTIZED16) {
+      glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void*)0);
+    } else if (vertexAttributes == POSITION_NORMAL_TEXTURE_QUANTIZED12) {
+      glVertexAttribPointer(0, 4, GL_UNSIGNED_INT_2_10_10_10_REV, GL_TRUE, stride, (void*)0);
+    } else {
+      glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
+    }
+    glEnableVertexAttribArray(0);
+  }
+
+  /*
+   * Set vertex attributes according to the attributes specified by the caller.
+   * Applies to the currently bound VAO and GL_ARRAY_BUFFER, so other VAOs can
+   * reuse an existing vertex buffer.
+   */
+  static void setAttributes(enum VertexAttributes vertexAttributes) {
     /* Only position attribute */
     if (vertexAttributes == POSITION) {
       // position attribute
@@ -106,6 +300,25 @@ struct VertexDataObject {
       glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
       glEnableVertexAttribArray(2);  
     }
+
+    /* Quantized position, normal and texture attributes; the fetch expands them to the same floats the shaders expect */
+    else if (vertexAttributes == POSITION_NORMAL_TEXTURE_QUANTIZED16) {
+      glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, 16, (void*)0);
+      glEnableVertexAttribArray(0);
+      glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, 16, (void*)8);
+      glEnableVertexAttribArray(1);
+      glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, 16, (void*)12);
+      glEnableVertexAttribArray(2);
+    }
+
+    else if (vertexAttributes == POSITION_NORMAL_TEXTURE_QUANTIZED12) {
+      glVertexAttribPointer(0, 4, GL_UNSIGNED_INT_2_10_10_10_REV, GL_TRUE, 12, (void*)0);
+      glEnableVertexAttribArray(0);
+      glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, 12, (void*)4);
+      glEnableVertexAttribArray(1);
+      glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, 12, (void*)8);
+      glEnableVertexAttribArray(2);
+    }
   }
 };
 
@@ -115,7 +328,11 @@ std::vector<Mesh*> Meshes;
 
 class Mesh {
 private:
-  std::vector<unsigned int> indicesArray;
+  unsigned int indexCount;
+
+  /* World space bounding sphere for the current frame, set by addBounds */
+  glm::vec3 worldCenter;
+  float worldRadius;
 
 public:
   glm::vec3 pos = glm::vec3(0.0f, 0.0f, 0.0f);
@@ -123,78 +340,116 @@ public:
   glm::vec3 scale = glm::vec3(0.1f, 0.1f, 0.1f);
   std::vector<Texture> textures;
   unsigned int VAO, VBO, EBO;
+  unsigned int depthVAO; /* Position-only stream for DepthPrepass */
+  BoundingVolume bounds;
 
+  /* Maps quantized vertex positions back to object space; identity for float vertices */
+  glm::mat4 dequantize = glm::mat4(1.0f);
 
-  Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> texturesArray) {
+  /* Index ranges of the levels of detail, finest first, and the one drawn last frame */
+  std::vector<MeshLod> lods;
+  unsigned int lod = 0;
 
-    /* OpenGL expects the vertices to be in one contiguous array */
-    std::vector<float> vertexArray;
+  /* Model and normal matrix and culling slot for the current frame, set by addBounds */
+  glm::mat4 model;
+  glm::mat3 normalMatrix;
+  size_t cullIndex;
 
-    for (int i = 0; i < vertices.size(); ++i) {
-      /* Position*/
-      vertexArray.push_back(vertices[i].Position.x);
-      vertexArray.push_back(vertices[i].Position.y);
-      vertexArray.push_back(vertices[i].Position.z);
-      /* Normal */
-      vertexArray.push_back(vertices[i].Normal.x);
-      vertexArray.push_back(vertices[i].Normal.y);
-      vertexArray.push_back(vertices[i].Normal.z);
-      /* Texture Coords */
-      vertexArray.push_back(vertices[i].TexCoords.x);
-      vertexArray.push_back(vertices[i].TexCoords.y);
-    }
+  /* Vertex already has the POSITION_NORMAL_TEXTURE layout, so the array is uploaded as it is */
+  Mesh(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, std::vector<Texture> texturesArray, BoundingVolume meshBounds)
+    : Mesh(vertices.data(), vertices.size() * sizeof(Vertex), POSITION_NORMAL_TEXTURE, indices.data(), indices.size(), texturesArray, meshBounds) {
+  }
 
-    VertexDataObject VDO(vertexArray, indices, POSITION_NORMAL_TEXTURE);
+  /*
+   * Create a mesh from vertex data already in its GPU layout. Quantized
+   * layouts pass their dequantize matrix; indices may hold several levels of
+   * detail, described by meshLods (the whole buffer is one level without it).
+   */
+  Mesh(const void* vertices, size_t vertexBytes, enum VertexAttributes vertexAttributes, const unsigned int* indices, size_t indicesCount, std::vector<Texture> texturesArray, BoundingVolume meshBounds,
+       glm::mat4 dequantizeMatrix = glm::mat4(1.0f), std::vector<MeshLod> meshLods = {})
+    : Mesh(VertexDataObject(vertices, vertexBytes, indices, indicesCount, vertexAttributes), indicesCount, texturesArray, meshBounds, dequantizeMatrix, meshLods) {
+  }
 
+  /* Wrap buffers that are already filled, e.g. by VertexDataObject's mapping constructor and finish() */
+  Mesh(const VertexDataObject& VDO, size_t indicesCount, std::vector<Texture> texturesArray, BoundingVolume meshBounds, glm::mat4 dequantizeMatrix, std::vector<MeshLod> meshLods) {
     VAO = VDO.VAO;
     VBO = VDO.VBO;
     EBO = VDO.EBO;
+    depthVAO = VDO.depthVAO;
     textures = texturesArray;
-    indicesArray = indices;
+    indexCount = indicesCount;
+    bounds = meshBounds;
+    dequantize = dequantizeMatrix;
+    lods = meshLods.empty() ? std::vector<MeshLod>{ { 0, (uint32_t)indicesCount, 0.0f } } : meshLods;
   }
 
-  void draw(unsigned int shaderProgram) {
-    glUseProgram(shaderProgram);
+  void addBounds(CullingSet& culling) {
+    model = transformMatrix(pos, rotation, scale);
+    normalMatrix = normalTransform(model, scale);
+    bounds.worldSphere(model, scale, worldCenter, worldRadius);
+    cullIndex = culling.add(worldCenter, worldRadius);
+  }
 
-    for (int i = 0; i < textures.size(); ++i) {
-      glActiveTexture(GL_TEXTURE1 + textures[i].texture);
-      glBindTexture(GL_TEXTURE_2D, textures[i].texture);
+  /* The PhongShader feature set for this mesh's maps under the scene's current lights */
+  PhongFeatures phongFeatures() const {
+    PhongFeatures features = PhongShader::sceneFeatures();
+    for (const Texture& texture : textures) {
+      features.diffuseMap |= texture.type == DIFFUSE;
+      features.specularMap |= texture.type == SPECULAR;
     }
+    return features;
+  }
 
-    // Build the transformation matrix
-    glm::mat4 identity = glm::mat4(1.0f); // identity matrix 
-
-    // Apply translation
-    glm::mat4 model = glm::translate(identity, pos); 
-
-    // Apply rotation on top of translation
-    model = glm::rotate(model, glm::radians(rotation.x), glm::vec3(1, 0, 0)); 
-    model = glm::rotate(model, glm::radians(rotation.y), glm::vec3(0, 1, 0)); 
-    model = glm::rotate(model, glm::radians(rotation.z), glm::vec3(0, 0, 1)); 
-
-    // Apply scale on top of translation and rotation
-    model = glm::scale(model, scale); 
-
-    // Create the view matrix
-    glm::mat4 view = activeCamera.getViewMatrix();
-
-    // Create a perspective projection matrix
-    glm::mat4 projection = activeCamera.getProjectionMatrix();
-
-    // Send the matrices to the shader
-    int modelLoc = glGetUniformLocation(shaderProgram, "model");
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-    int viewLoc = glGetUniformLocation(shaderProgram, "view");
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
+  /*
+   * Queue this mesh for drawing with the given shader at the level of detail
+   * its screen size needs, unless it was culled. Shader 0 picks the
+   * PhongShader variant for this mesh's maps and the scene's lights.
+   */
+  void submit(RenderQueue& queue, const CullingSet& culling, unsigned int shaderProgram) {
+    if (!culling.isVisible(cullIndex)) {
+      return;
+    }
 
-    int projectionLoc = glGetUniformLocation(shaderProgram, "projection");
-    glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, glm::value_ptr(projection));
+    float distance = glm::length(worldCenter - activeCamera.position);
+    if (LodSelector::tooSmall(worldRadius, LodSelector::pixelsPerUnit(activeCamera.fov, queue.viewportHeight(), distance))) {
+      return;
+    }
 
-    glBindVertexArray(VAO);
+    /* Error is judged at the nearest point of the bounding sphere */
+    float maxScale = std::fmax(std::fabs(scale.x), std::fmax(std::fabs(scale.y), std::fabs(scale.z)));
+    lod = LodSelector::select(lods, lod, maxScale * LodSelector::pixelsPerUnit(activeCamera.fov, queue.viewportHeight(), distance - worldRadius));
+
+    DrawPacket packet;
+    packet.shaderProgram = shaderProgram;
+    packet.VAO = VAO;
+    /* Only uber-shaded meshes are pre-passed: depth.vert matches phong.vert's position exactly */
+    packet.depthVAO = shaderProgram == 0 && !DeferredRenderer::enabled ? depthVAO : 0;
+    packet.firstIndex = lods[lod].indexOffset;
+    packet.indexCount = lods[lod].indexCount;
+    packet.instanceCount = 0;
+    packet.textureCount = 0;
+    if (shaderProgram == 0) {
+      /* The uber shader samples the first diffuse map then the first specular map, in packet order */
+      packet.shaderProgram = PhongShader::program(phongFeatures());
+      for (enum TextureType type : { DIFFUSE, SPECULAR }) {
+        for (const Texture& texture : textures) {
+          if (texture.type == type) {
+            packet.textures[packet.textureCount++] = texture.texture;
+            break;
+          }
+        }
+      }
+    } else {
+      for (int i = 0; i < textures.size() && i < MAX_PACKET_TEXTURES; ++i) {
+        packet.textures[packet.textureCount++] = textures[i].texture;
+      }
+    }
+    packet.model = model * dequantize;
+    /* Normals are stored unquantized, so only the object's own transform applies to them */
+    packet.normalMatrix = normalMatrix;
 
-    glDrawElements(GL_TRIANGLES, indicesArray.size(), GL_UNSIGNED_INT, 0);
-    glBindVertexArray(0);
+    /* Only the uber shader can write the G-buffer; everything else stays forward */
+    queue.add(packet, shaderProgram == 0 && DeferredRenderer::enabled ? RENDER_PASS_GBUFFER : RENDER_PASS_OPAQUE, pos);
   }
 };  
 
@@ -205,119 +460,289 @@ class Cube;
 
 std::vector<Cube*> Cubes;
 
+/*
+ * Cubes that share a shader and texture set are drawn together with a single
+ * instanced draw. Each batch owns a VAO that pairs the shared cube geometry
+ * with a buffer holding one model matrix per cube.
+ */
+struct CubeBatch {
+  unsigned int shaderProgram;
+  std::vector<unsigned int> textures;
+  unsigned int VAO, instanceVBO;
+  size_t capacity = 0; /* Instances the GPU buffer currently has room for */
+
+  std::vector<Cube*> cubes;
+  std::vector<glm::mat4> instances;
+  glm::vec3 center = glm::vec3(0.0f, 0.0f, 0.0f);
+  float radius = 0.0f;
+  size_t cullIndex;
+
+  /* Range of instances changed since the last upload */
+  size_t dirtyBegin = 0, dirtyEnd = 0;
+
+  void markDirty(size_t index) {
+    if (dirtyBegin == dirtyEnd) {
+      dirtyBegin = index;
+      dirtyEnd = index + 1;
+    } else {
+      dirtyBegin = std::min(dirtyBegin, index);
+      dirtyEnd = std::max(dirtyEnd, index + 1);
+    }
+  }
+};
+
+std::vector<CubeBatch*> CubeBatches;
+
+/*
+ * Cube shaders read the per-instance matrix from INSTANCE_MODEL_LOCATION and
+ * combine it as "model * aInstanceModel". The engine keeps that attribute at
+ * identity for other objects, so the same shaders work for every object.
+ */
 class Cube {
+private:
+  CubeBatch* batch = nullptr;
+  size_t instanceIndex;
+
+  /* Transform last written to the instance buffer */
+  glm::vec3 lastPos, lastRotation, lastScale;
+
+  /* 24 vertex cube shared by every cube */
+  static VertexDataObject& geometry() {
+      std::vector<float> vertices = {
+        // Back face (-Z)
+        -0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  0.0f,  0.0f, // 0
+        0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  1.0f,  0.0f, // 1
+        0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  1.0f,  1.0f, // 2
+        -0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  0.0f,  1.0f, // 3
+
+        // Front face (+Z)
+        -0.5f, -0.5f,  0.5f,  0.0f,  0.0f,  1.0f,  0.0f,  0.0f, // 4
+        0.5f, -0.5f,  0.5f,  0.0f,  0.0f,  1.0f,  1.0f,  0.0f, // 5
+        0.5f,  0.5f,  0.5f,  0.0f,  0.0f,  1.0f,  1.0f,  1.0f, // 6
+        -0.5f,  0.5f,  0.5f,  0.0f,  0.0f,  1.0f,  0.0f,  1.0f, // 7
+
+        // Left face (-X)
+        -0.5f, -0.5f, -0.5f, -1.0f,  0.0f,  0.0f,  0.0f,  1.0f, // 8
+        -0.5f, -0.5f,  0.5f, -1.0f,  0.0f,  0.0f,  0.0f,  0.0f, // 9
+        -0.5f,  0.5f,  0.5f, -1.0f,  0.0f,  0.0f,  1.0f,  0.0f, // 10
+        -0.5f,  0.5f, -0.5f, -1.0f,  0.0f,  0.0f,  1.0f,  1.0f, // 11
+
+        // Right face (+X)
+        0.5f, -0.5f,  0.5f,  1.0f,  0.0f,  0.0f,  0.0f,  0.0f, // 12
+        0.5f, -0.5f, -0.5f,  1.0f,  0.0f,  0.0f,  0.0f,  1.0f, // 13
+        0.5f,  0.5f, -0.5f,  1.0f,  0.0f,  0.0f,  1.0f,  1.0f, // 14
+        0.5f,  0.5f,  0.5f,  1.0f,  0.0f,  0.0f,  1.0f,  0.0f, // 15
+
+        // Bottom face (-Y)
+        -0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,  0.0f,  1.0f, // 16
+        0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,  1.0f,  1.0f, // 17
+        0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,  1.0f,  0.0f, // 18
+        -0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,  0.0f,  0.0f, // 19
+
+        // Top face (+Y)
+        -0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f,  0.0f,  1.0f, // 20
+        0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f,  1.0f,  1.0f, // 21
+        0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,  1.0f,  0.0f, // 22
+        -0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,  0.0f,  0.0f  // 23
+      };
+
+      std::vector<unsigned int> indices = {
+        // Back face (-Z)
+        0, 3, 2,  2, 1, 0,
+        // Front face (+Z)
+        6, 7, 4,  4, 5, 6,
+        // Left face (-X)
+        10, 11, 8,  8, 9, 10,
+        // Right face (+X)
+        14, 15, 12,  12, 13, 14,
+        // Bottom face (-Y)
+        18, 19, 16,  16, 17, 18,
+        // Top face (+Y)
+        20, 23, 22,  22, 21, 20
+      };
+
+    static VertexDataObject VDO(vertices, indices, POSITION_NORMAL_TEXTURE);
+    return VDO;
+  }
+
+  static const BoundingVolume& cubeBounds() {
+    static BoundingVolume bounds = BoundingVolume::fromBox(glm::vec3(-0.5f, -0.5f, -0.5f), glm::vec3(0.5f, 0.5f, 0.5f));
+    return bounds;
+  }
+
+  static CubeBatch* findBatch(unsigned int shaderProgram, const std::vector<unsigned int>& textures) {
+    for (CubeBatch* batch : CubeBatches) {
+      if (batch->shaderProgram == shaderProgram && batch->textures == textures) {
+        return batch;
+      }
+    }
+
+    VertexDataObject& shared = geometry();
+
+    CubeBatch* batch = new CubeBatch();
+    batch->shaderProgram = shaderProgram;
+    batch->textures = textures;
+
+    glGenVertexArrays(1, &batch->VAO);
+    glGenBuffers(1, &batch->instanceVBO);
+
+    GLState::bindVertexArray(batch->VAO);
+
+    GLState::bindBuffer(GL_ARRAY_BUFFER, shared.VBO);
+    VertexDataObject::setAttributes(POSITION_NORMAL_TEXTURE);
+    GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, shared.EBO);
+
+    /* One column of the model matrix per location, advancing once per instance */
+    GLState::bindBuffer(GL_ARRAY_BUFFER, batch->instanceVBO);
+    for (int column = 0; column < 4; ++column) {
+      glVertexAttribPointer(INSTANCE_MODEL_LOCATION + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(column * sizeof(glm::vec4)));
+      glEnableVertexAttribArray(INSTANCE_MODEL_LOCATION + column);
+      glVertexAttribDivisor(INSTANCE_MODEL_LOCATION + column, 1);
+    }
+
+    CubeBatches.push_back(batch);
+    return batch;
+  }
+
+  void leaveBatch() {
+    /* Move the last instance into the freed slot */
+    Cube* last = batch->cubes.back();
+    batch->cubes[instanceIndex] = last;
+    batch->instances[instanceIndex] = batch->instances.back();
+    last->instanceIndex = instanceIndex;
+
+    batch->cubes.pop_back();
+    batch->instances.pop_back();
+
+    batch->markDirty(instanceIndex);
+    batch = nullptr;
+  }
+
+  void joinBatch(CubeBatch* newBatch) {
+    batch = newBatch;
+    instanceIndex = batch->cubes.size();
+    batch->cubes.push_back(this);
+    batch->instances.push_back(glm::mat4(1.0f));
+  }
+
+  /* Move to the right batch and rewrite the instance matrix if anything changed since last frame */
+  void update() {
+    bool moved = false;
+
+    if (batch == nullptr || batch->shaderProgram != shaderProgram || batch->textures != textures) {
+      if (batch != nullptr) {
+        leaveBatch();
+      }
+      joinBatch(findBatch(shaderProgram, textures));
+      moved = true;
+    }
+
+    if (moved || pos != lastPos || rotation != lastRotation || scale != lastScale) {
+      batch->instances[instanceIndex] = transformMatrix(pos, rotation, scale);
+      batch->markDirty(instanceIndex);
+
+      lastPos = pos;
+      lastRotation = rotation;
+      lastScale = scale;
+    }
+  }
+
 public:
   glm::vec3 pos = glm::vec3(0.0f, 0.0f, 0.0f);
   glm::vec3 rotation = glm::vec3(0.0f, 0.0f, 0.0f);
   glm::vec3 scale = glm::vec3(1.0f, 1.0f, 1.0f);
   std::vector<unsigned int> textures;
   unsigned int shaderProgram;
-  unsigned int VAO, VBO;
 
   Cube(unsigned int shader) {
-    std::vector<float> vertices = {
-      // Back face (-Z)
-      -0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  0.0f,  0.0f, // 0
-      0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  1.0f,  0.0f, // 1
-      0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  1.0f,  1.0f, // 2
-      -0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  0.0f,  1.0f, // 3
-
-      // Front face (+Z)
-      -0.5f, -0.5f,  0.5f,  0.0f,  0.0f,  1.0f,  0.0f,  0.0f, // 4
-      0.5f, -0.5f,  0.5f,  0.0f,  0.0f,  1.0f,  1.0f,  0.0f, // 5
-      0.5f,  0.5f,  0.5f,  0.0f,  0.0f,  1.0f,  1.0f,  1.0f, // 6
-      -0.5f,  0.5f,  0.5f,  0.0f,  0.0f,  1.0f,  0.0f,  1.0f, // 7
-
-      // Left face (-X)
-      -0.5f, -0.5f, -0.5f, -1.0f,  0.0f,  0.0f,  0.0f,  1.0f, // 8
-      -0.5f, -0.5f,  0.5f, -1.0f,  0.0f,  0.0f,  0.0f,  0.0f, // 9
-      -0.5f,  0.5f,  0.5f, -1.0f,  0.0f,  0.0f,  1.0f,  0.0f, // 10
-      -0.5f,  0.5f, -0.5f, -1.0f,  0.0f,  0.0f,  1.0f,  1.0f, // 11
-
-      // Right face (+X)
-      0.5f, -0.5f,  0.5f,  1.0f,  0.0f,  0.0f,  0.0f,  0.0f, // 12
-      0.5f, -0.5f, -0.5f,  1.0f,  0.0f,  0.0f,  0.0f,  1.0f, // 13
-      0.5f,  0.5f, -0.5f,  1.0f,  0.0f,  0.0f,  1.0f,  1.0f, // 14
-      0.5f,  0.5f,  0.5f,  1.0f,  0.0f,  0.0f,  1.0f,  0.0f, // 15
-
-      // Bottom face (-Y)
-      -0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,  0.0f,  1.0f, // 16
-      0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,  1.0f,  1.0f, // 17
-      0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,  1.0f,  0.0f, // 18
-      -0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,  0.0f,  0.0f, // 19
-
-      // Top face (+Y)
-      -0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f,  0.0f,  1.0f, // 20
-      0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f,  1.0f,  1.0f, // 21
-      0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,  1.0f,  0.0f, // 22
-      -0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,  0.0f,  0.0f  // 23
-    };
-
-    std::vector<unsigned int> indices = {
-      // Back face (-Z)
-      0, 3, 2,  2, 1, 0,
-      // Front face (+Z)
-      6, 7, 4,  4, 5, 6,
-      // Left face (-X)
-      10, 11, 8,  8, 9, 10,
-      // Right face (+X)
-      14, 15, 12,  12, 13, 14,
-      // Bottom face (-Y)
-      18, 19, 16,  16, 17, 18,
-      // Top face (+Y)
-      20, 23, 22,  22, 21, 20
-    };
-
-    VertexDataObject VDO(vertices, indices, POSITION_NORMAL_TEXTURE);
-
-    VAO = VDO.VAO;
-    VBO = VDO.VBO;
     shaderProgram = shader;
 
+    /* Create the shared geometry while the caller is known to have a context */
+    geometry();
+
     Cubes.push_back(this);
   }
 
-  void draw() {
-    glUseProgram(shaderProgram);
-
-    for (int i = 0; i < textures.size(); ++i) {
-      glActiveTexture(GL_TEXTURE1 + textures[i]);
-      glBindTexture(GL_TEXTURE_2D, textures[i]);
+  /*
+   * Bring every batch up to date and add its bounding sphere for culling.
+   * Batches are culled as a whole since their instances are drawn together.
+   */
+  static void updateAll(CullingSet& culling) {
+    for (Cube* cube : Cubes) {
+      cube->update();
     }
 
-    // Build the transformation matrix
-    glm::mat4 identity = glm::mat4(1.0f); // identity matrix 
-
-    // Apply translation
-    glm::mat4 model = glm::translate(identity, pos); 
-
-    // Apply rotation on top of translation
-    model = glm::rotate(model, glm::radians(rotation.x), glm::vec3(1, 0, 0)); 
-    model = glm::rotate(model, glm::radians(rotation.y), glm::vec3(0, 1, 0)); 
-    model = glm::rotate(model, glm::radians(rotation.z), glm::vec3(0, 0, 1)); 
-
-    // Apply scale on top of translation and rotation
-    model = glm::scale(model, scale); 
-
-    // Create the view matrix
-    glm::mat4 view = activeCamera.getViewMatrix();
+    for (CubeBatch* batch : CubeBatches) {
+      if (batch->instances.empty()) {
+        continue;
+      }
 
-    // Create a perspective projection matrix
-    glm::mat4 projection = activeCamera.getProjectionMatrix();
+      bool grown = batch->instances.size() > batch->capacity;
+
+      if (grown || batch->dirtyBegin != batch->dirtyEnd) {
+        GLState::bindBuffer(GL_ARRAY_BUFFER, batch->instanceVBO);
+
+        /* Upload only the instances that changed; grow the buffer when it is too small */
+        if (grown) {
+          batch->capacity = batch->instances.size() * 2;
+          glBufferData(GL_ARRAY_BUFFER, batch->capacity * sizeof(glm::mat4), NULL, GL_DYNAMIC_DRAW);
+          glBufferSubData(GL_ARRAY_BUFFER, 0, batch->instances.size() * sizeof(glm::mat4), batch->instances.data());
+        } else {
+          size_t dirtyEnd = std::min(batch->dirtyEnd, batch->instances.size());
+          if (dirtyEnd > batch->dirtyBegin) {
+            glBufferSubData(GL_ARRAY_BUFFER, batch->dirtyBegin * sizeof(glm::mat4), (dirtyEnd - batch->dirtyBegin) * sizeof(glm::mat4), &batch->instances[batch->dirtyBegin]);
+          }
+        }
+        batch->dirtyBegin = batch->dirtyEnd = 0;
+
+        /* Sphere around every cube in the batch, also used for depth sorting */
+        glm::vec3 sum = glm::vec3(0.0f, 0.0f, 0.0f);
+        for (Cube* cube : batch->cubes) {
+          sum += cube->pos;
+        }
+        batch->center = sum / (float)batch->cubes.size();
+
+        batch->radius = 0.0f;
+        for (Cube* cube : batch->cubes) {
+          glm::vec3 cubeCenter;
+          float cubeRadius;
+          cubeBounds().worldSphere(batch->instances[cube->instanceIndex], cube->scale, cubeCenter, cubeRadius);
+          batch->radius = std::max(batch->radius, glm::length(cubeCenter - batch->center) + cubeRadius);
+        }
+      }
 
-    // Send the matrices to the shader
-    int modelLoc = glGetUniformLocation(shaderProgram, "model");
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
+      batch->cullIndex = culling.add(batch->center, batch->radius);
+    }
+  }
 
-    int viewLoc = glGetUniformLocation(shaderProgram, "view");
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
+  /* Queue one instanced draw per visible batch */
+  static void submitAll(RenderQueue& queue, const CullingSet& culling) {
+    for (CubeBatch* batch : CubeBatches) {
+      if (batch->instances.empty() || !culling.isVisible(batch->cullIndex)) {
+        continue;
+      }
 
-    int projectionLoc = glGetUniformLocation(shaderProgram, "projection");
-    glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, glm::value_ptr(projection));
+      queue.add(batchPacket(batch), RENDER_PASS_OPAQUE, batch->center);
+    }
+  }
 
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-    glBindVertexArray(0);
+private:
+  static DrawPacket batchPacket(CubeBatch* batch) {
+    DrawPacket packet;
+    packet.shaderProgram = batch->shaderProgram;
+    packet.VAO = batch->VAO;
+    packet.depthVAO = 0;
+    packet.firstIndex = 0;
+    packet.indexCount = 36;
+    packet.instanceCount = batch->instances.size();
+    packet.textureCount = 0;
+    for (int i = 0; i < batch->textures.size() && i < MAX_PACKET_TEXTURES; ++i) {
+      packet.textures[packet.textureCount++] = batch->textures[i];
+    }
+    /* The instance matrices carry the whole transform */
+    packet.model = glm::mat4(1.0f);
+    packet.normalMatrix = glm::mat3(1.0f);
+    return packet;
   }
 };
 
@@ -329,6 +754,10 @@ class SubdividedPlane {
 private:
   unsigned int VAO, VBO;
 
+  glm::mat4 model;
+  glm::mat3 normalMatrix;
+  size_t cullIndex;
+
 public:
   glm::vec3 pos = glm::vec3(0.0f, 0.0f, 0.0f);
   glm::vec3 rotation = glm::vec3(0.0f, 0.0f, 0.0f);
@@ -336,6 +765,7 @@ public:
   std::vector<unsigned int> textures;
   unsigned int shaderProgram;
   unsigned int indicesCount;
+  BoundingVolume bounds;
 
   SubdividedPlane(int subdivisions, unsigned int shader) {
     std::vector<float> vertices;
@@ -377,51 +807,42 @@ public:
     VBO = VDO.VBO;
     indicesCount = indices.size();
     shaderProgram = shader;
+    bounds = BoundingVolume::fromBox(glm::vec3(-planeWidth / 2.0f, 0.0f, -planeHeight / 2.0f), glm::vec3(planeWidth / 2.0f, 0.0f, planeHeight / 2.0f));
 
     SubdividedPlanes.push_back(this);
   }
 
-  void draw() {
-    glUseProgram(shaderProgram);
-
-    for (int i = 0; i < textures.size(); ++i) {
-      glActiveTexture(GL_TEXTURE1 + textures[i]);
-      glBindTexture(GL_TEXTURE_2D, textures[i]);
-    }
-
-    // Build the transformation matrix
-    glm::mat4 identity = glm::mat4(1.0f); // identity matrix 
-
-    // Apply translation
-    glm::mat4 model = glm::translate(identity, pos); 
-
-    // Apply rotation on top of translation
-    model = glm::rotate(model, glm::radians(rotation.x), glm::vec3(1, 0, 0)); 
-    model = glm::rotate(model, glm::radians(rotation.y), glm::vec3(0, 1, 0)); 
-    model = glm::rotate(model, glm::radians(rotation.z), glm::vec3(0, 0, 1)); 
-
-    // Apply scale on top of translation and rotation
-    model = glm::scale(model, scale); 
+  void addBounds(CullingSet& culling) {
+    glm::vec3 center;
+    float radius;
 
-    // Create the view matrix
-    glm::mat4 view = activeCamera.getViewMatrix();
-
-    // Create a perspective projection matrix
-    glm::mat4 projection = activeCamera.getProjectionMatrix();
-
-    // Send the matrices to the shader
-    int modelLoc = glGetUniformLocation(shaderProgram, "model");
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
+    model = transformMatrix(pos, rotation, scale);
+    normalMatrix = normalTransform(model, scale);
+    bounds.worldSphere(model, scale, center, radius);
+    cullIndex = culling.add(center, radius);
+  }
 
-    int viewLoc = glGetUniformLocation(shaderProgram, "view");
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
+  /* Queue this object for drawing, unless it was culled */
+  void submit(RenderQueue& queue, const CullingSet& culling) {
+    if (!culling.isVisible(cullIndex)) {
+      return;
+    }
 
-    int projectionLoc = glGetUniformLocation(shaderProgram, "projection");
-    glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, glm::value_ptr(projection));
+    DrawPacket packet;
+    packet.shaderProgram = shaderProgram;
+    packet.VAO = VAO;
+    packet.depthVAO = 0;
+    packet.firstIndex = 0;
+    packet.indexCount = indicesCount;
+    packet.instanceCount = 0;
+    packet.textureCount = 0;
+    for (int i = 0; i < textures.size() && i < MAX_PACKET_TEXTURES; ++i) {
+      packet.textures[packet.textureCount++] = textures[i];
+    }
+    packet.model = model;
+    packet.normalMatrix = normalMatrix;
 
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, indicesCount, GL_UNSIGNED_INT, 0);
-    glBindVertexArray(0);
+    queue.add(packet, RENDER_PASS_OPAQUE, pos);
   }
 };
 
@@ -444,7 +865,7 @@ public:
   glm::vec3 pos = glm::vec3(0.0f, 0.0f, 0.0f);
   glm::vec3 scale = glm::vec3(1.0f, 1.0f, 1.0f);
   glm::vec3 rotation = glm::vec3(0.0f, 0.0f, 0.0f);
-  unsigned int shaderProgram; 
+  unsigned int shaderProgram; /* 0 draws every mesh with its PhongShader variant */
 
   Model(std::string path, unsigned int shader) {
     loadModel(path);
@@ -452,116 +873,199 @@ public:
     Models.push_back(this);
   }
 
-  void draw() {
+  /*
+   * Lit by the Phong uber-shader, using whichever maps each mesh has. The
+   * variants are queued right away so they compile while the next assets load.
+   */
+  Model(std::string path) : Model(path, 0) {
+    for (const Mesh& mesh : meshes) {
+      PhongShader::program(mesh.phongFeatures());
+    }
+  }
+
+  void addBounds(CullingSet& culling) {
+    for (int i = 0; i < meshes.size(); ++i) {
+      meshes[i].addBounds(culling);
+    }
+  }
+
+  void submit(RenderQueue& queue, const CullingSet& culling) {
     for (int i = 0; i < meshes.size(); ++i) {
-      meshes[i].draw(shaderProgram);
+      meshes[i].submit(queue, culling, shaderProgram);
     }
   }
 
 private:
   std::vector<Mesh> meshes;
-  char* directory;  
+  std::string directory;
 
+  /*
+   * Prefer a cooked .nmesh: either the path itself, <path>.nmesh in a mounted
+   * pack, or <path>.nmesh next to the source when it is at least as new as the
+   * source. Anything else goes through assimp.
+   */
   void loadModel(std::string path) {
-    Assimp::Importer import;
-    const aiScene *scene = import.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs);	
+    TraceScope trace("model", "load", path);
+    directory = path.substr(0, path.find_last_of('/') + 1);
+
+    std::string cookedPath = path;
+    if (!endsWith(path, MESH_FILE_EXTENSION)) {
+      cookedPath = path + MESH_FILE_EXTENSION;
+
+      std::error_code error;
+      if (AssetArchive::contains(cookedPath)) {
+        /* Packs are built after cooking, so a packed .nmesh is never stale */
+      } else if (!std::filesystem::exists(cookedPath, error)) {
+        cookedPath.clear();
+      } else if (std::filesystem::exists(path, error) && std::filesystem::last_write_time(cookedPath, error) < std::filesystem::last_write_time(path, error)) {
+        neptuneInfo("Cooked mesh is older than its source, importing the source instead");
+        cookedPath.clear();
+      }
+    }
 
-    /* Error while importing model */
-    if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
-      std::cout << "ERROR::ASSIMP::" << import.GetErrorString() << std::endl;
+    if (!cookedPath.empty() && loadCooked(cookedPath)) {
       return;
     }
 
-    directory = strcat(path.substr(0, path.find_last_of('/')).data(), "/");
+    /* Conversion runs on the job system and textures stream in behind it; only the buffer uploads below need this thread */
+    ImportedModel imported;
+    if (!importModel(path, imported, false)) {
+      return;
+    }
 
-    processNode(scene->mRootNode, scene);
-  }  
+    std::vector<Texture> images = streamImages(imported.imagePaths);
 
-  void processNode(aiNode* node, const aiScene* scene) {
-    neptuneInfo("Processing node");
-    /* Process all the node's meshes (if any) */
-    for(unsigned int i = 0; i < node->mNumMeshes; i++) {
-      aiMesh* mesh = scene->mMeshes[node->mMeshes[i]]; 
-      meshes.push_back(processMesh(mesh, scene));
+    /*
+     * Buffers are created at their final size and mapped, and the job system
+     * encodes every mesh straight into them; no quantized or staging copy is
+     * made on the way. Each CPU copy is freed as soon as its buffers are done.
+     */
+    TraceScope uploadTrace("model", "upload", path);
+    size_t count = imported.meshes.size();
+    std::vector<VertexDataObject> uploads;
+    std::vector<void*> vertexTargets(count);
+    std::vector<void*> positionTargets(count);
+    std::vector<unsigned int*> indexTargets(count);
+    std::vector<size_t> indexCounts(count);
+    uploads.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+      const ImportedMesh& mesh = imported.meshes[i];
+      indexCounts[i] = mesh.indices.size();
+      uploads.emplace_back(mesh.vertexBytes(), mesh.indices.size(), mesh.quantization.attributes, vertexTargets[i], positionTargets[i], indexTargets[i]);
     }
 
-    /* Then do the same for each of its children */
-    for(unsigned int i = 0; i < node->mNumChildren; i++) {
-      processNode(node->mChildren[i], scene);
-    }
-  }  
+    auto write = [&](size_t i) {
+      ImportedMesh& mesh = imported.meshes[i];
+      mesh.writeVertices(vertexTargets[i]);
+      mesh.writePositions(positionTargets[i]);
+      memcpy(indexTargets[i], mesh.indices.data(), mesh.indices.size() * sizeof(unsigned int));
+    };
+    JobSystem::parallelFor(count, write);
+
+    meshes.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+      ImportedMesh& mesh = imported.meshes[i];
+      bool uploaded = uploads[i].finish(vertexTargets[i], positionTargets[i], indexTargets[i]);
+      if (!uploaded) {
+        write(i);
+        uploaded = uploads[i].finish(vertexTargets[i], positionTargets[i], indexTargets[i]);
+      }
+      mesh.release();
 
-  Mesh processMesh(aiMesh *mesh, const aiScene *scene) {
-    std::vector<Vertex> vertices;
-    std::vector<unsigned int> indices;
-    std::vector<Texture> textures;
-
-    /* Process vertices */
-    for(unsigned int i = 0; i < mesh->mNumVertices; i++) {
-      Vertex vertex;
-      glm::vec3 vector; 
-
-      /* Position */
-      vector.x = mesh->mVertices[i].x;
-      vector.y = mesh->mVertices[i].y;
-      vector.z = mesh->mVertices[i].z; 
-      vertex.Position = vector;
-      /* Normal */
-      if (mesh->mNormals) {
-        vector.x = mesh->mNormals[i].x;
-        vector.y = mesh->mNormals[i].y;
-        vector.z = mesh->mNormals[i].z;
-        vertex.Normal = vector;  
-      } else {
-        /* No normal vectors */
-        vertex.Normal = glm::vec3(0.0f, 0.0f, 0.0f);
+      if (!uploaded) {
+        std::cout << "ERROR::MODEL::UPLOAD_FAILED: " << path << std::endl;
+        uploads[i].destroy();
+        continue;
       }
 
-      if(mesh->mTextureCoords[0]) { /* Check if the mesh contains texture coordinates */
-        glm::vec2 vec;
-        vec.x = mesh->mTextureCoords[0][i].x; 
-        vec.y = mesh->mTextureCoords[0][i].y;
-        vertex.TexCoords = vec;
-      } else {
-        /* No texture coordinates */
-        vertex.TexCoords = glm::vec2(0.0f, 0.0f);
+      std::vector<Texture> textures;
+      for (const ImportedTexture& texture : mesh.textures) {
+        textures.push_back(images[texture.image]);
+        textures.back().type = texture.type;
       }
-      vertices.push_back(vertex);
+
+      meshes.push_back(Mesh(uploads[i], indexCounts[i], textures, mesh.bounds, mesh.quantization.dequantize(), mesh.lods));
     }
+  }
 
-    /* 
-     * Process indices 
-     * For each face, retrieve its indices and push it back to the indices array
-     */
-    for(unsigned int i = 0; i < mesh->mNumFaces; i++) {
-      aiFace face = mesh->mFaces[i];
-      for(unsigned int j = 0; j < face.mNumIndices; j++) {
-        indices.push_back(face.mIndices[j]);
+  /* One streamed Texture per image, shared through the TextureRegistry; meshes copy the ones they use and set their own type */
+  static std::vector<Texture> streamImages(const std::vector<std::string>& paths) {
+    std::vector<Texture> images;
+    images.reserve(paths.size());
+    for (const std::string& path : paths) {
+      images.push_back(Texture(path.c_str(), 0, true, GENERIC, true));
+    }
+    return images;
+  }
+
+  static bool endsWith(const std::string& text, const std::string& suffix) {
+    return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+  }
+
+  /* Map a cooked mesh file, or find it in a pack, and upload every mesh directly from the mapping */
+  bool loadCooked(const std::string& path) {
+    AssetFile file;
+    if (!file.open(path)) {
+      return false;
+    }
+
+    const MeshFileHeader* header;
+    const char* strings;
+    const MeshFileEntry* entries = meshFileEntries(file, header, strings);
+    if (entries == nullptr) {
+      std::cout << "ERROR::MODEL::INVALID_COOKED_MESH: " << path << std::endl;
+      return false;
+    }
+
+    /* Every distinct texture, streamed in the background */
+    std::vector<std::string> imagePaths;
+    std::vector<std::vector<uint32_t>> imageIndices(header->meshCount);
+    for (uint32_t i = 0; i < header->meshCount; ++i) {
+      for (uint32_t t = 0; t < entries[i].textureCount; ++t) {
+        std::string texturePath = directory + (strings + entries[i].textures[t].path);
+        size_t image = std::find(imagePaths.begin(), imagePaths.end(), texturePath) - imagePaths.begin();
+        if (image == imagePaths.size()) {
+          imagePaths.push_back(texturePath);
+        }
+        imageIndices[i].push_back(image);
       }
-    }  
-
-    /* Process material */
-    if(mesh->mMaterialIndex >= 0) {
-      aiMaterial *material = scene->mMaterials[mesh->mMaterialIndex];
-      std::vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, DIFFUSE);
-      textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
-      std::vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, SPECULAR);
-      textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
-    }  
-    return Mesh(vertices, indices, textures);
-  }  
-
-  std::vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type, enum TextureType typeName) {
-    std::vector<Texture> textures;
-    for(unsigned int i = 0; i < mat->GetTextureCount(type); i++) {
-      aiString str;
-      mat->GetTexture(type, i, &str);
-      /* WIP Slot may be incorrect */
-      Texture texture(strcat(directory, str.C_Str()), i, true, typeName);
-      textures.push_back(texture);
-    }
-    return textures;
-  }  
+    }
+
+    std::vector<Texture> images = streamImages(imagePaths);
+
+    TraceScope uploadTrace("model", "upload", path);
+    meshes.reserve(header->meshCount);
+    for (uint32_t i = 0; i < header->meshCount; ++i) {
+      const MeshFileEntry& entry = entries[i];
+      enum VertexAttributes vertexAttributes = (enum VertexAttributes)entry.vertexAttributes;
+
+      BoundingVolume bounds;
+      bounds.min = glm::vec3(entry.boundsMin[0], entry.boundsMin[1], entry.boundsMin[2]);
+      bounds.max = glm::vec3(entry.boundsMax[0], entry.boundsMax[1], entry.boundsMax[2]);
+      bounds.center = glm::vec3(entry.boundsCenter[0], entry.boundsCenter[1], entry.boundsCenter[2]);
+      bounds.radius = entry.boundsRadius;
+
+      VertexQuantization quantization;
+      quantization.offset = glm::vec3(entry.dequantizeOffset[0], entry.dequantizeOffset[1], entry.dequantizeOffset[2]);
+      quantization.scale = entry.dequantizeScale;
+
+      std::vector<MeshLod> lods(entry.lods, entry.lods + entry.lodCount);
+
+      std::vector<Texture> textures;
+      for (uint32_t t = 0; t < entry.textureCount; ++t) {
+        textures.push_back(images[imageIndices[i][t]]);
+        textures.back().type = (enum TextureType)entry.textures[t].type;
+      }
+
+      meshes.push_back(Mesh(file.data + entry.vertexOffset, (size_t)entry.vertexCount * vertexStride(vertexAttributes), vertexAttributes,
+                            (const unsigned int*)(file.data + entry.indexOffset), entry.indexCount, textures, bounds, quantization.dequantize(), lods));
+    }
+
+    if (debugPrint == true) {
+      std::cout << "NEPTUNE::INFO: Loaded cooked mesh: " << path << " (" << header->meshCount << " meshes)" << std::endl;
+    }
+    return true;
+  }
 };
 
 #endif
@@ -0,0 +1,96 @@
+/*
+ * include/phong.h
+ *
+ * The Phong uber-shader (src/shaders/phong.vert and phong.frag). Every
+ * feature is behind a define: diffuse and specular maps, the directional
+ * light, the number of point lights (or clustered point lights) and fog. On
+ * the deferred path the variants write the G-buffer instead. PhongShader compiles a variant
+ * the first time a draw asks for its feature set and keeps it, so each mesh
+ * is drawn with the cheapest program that fits its material and the scene's
+ * lights. Variants compile through ShaderQueue without blocking, and linked
+ * ones land in the ProgramCache, so later runs only pay for loading them.
+ */
+
+#ifndef PHONG_H
+#define PHONG_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include <deferred.h>
+#include <lighting.h>
+#include <shader.h>
+
+struct PhongFeatures {
+  bool diffuseMap = false;
+  bool specularMap = false;
+  bool directionalLight = false;
+  unsigned int pointLights = 0; /* At most LIGHTING_MAX_POINT_LIGHTS */
+  bool clusteredLights = false;
+  bool fog = false;
+  /* Write the G-buffer (gbuffer.frag) instead of lighting; only the maps matter then */
+  bool gbuffer = false;
+
+  /* Unique per feature set */
+  uint32_t key() const {
+    return (uint32_t)diffuseMap | (uint32_t)specularMap << 1 | (uint32_t)directionalLight << 2 | (uint32_t)fog << 3 | (uint32_t)clusteredLights << 4 |
+           (uint32_t)gbuffer << 5 | pointLights << 6;
+  }
+
+  ShaderDefines defines() const {
+    ShaderDefines result;
+    if (diffuseMap) result.push_back({ "DIFFUSE_MAP", "" });
+    if (specularMap) result.push_back({ "SPECULAR_MAP", "" });
+    if (directionalLight) result.push_back({ "DIRECTIONAL_LIGHT", "" });
+    if (fog) result.push_back({ "FOG", "" });
+    if (clusteredLights) result.push_back({ "CLUSTERED_LIGHTS", "" });
+    result.push_back({ "POINT_LIGHTS", std::to_string(pointLights) });
+    return result;
+  }
+};
+
+class PhongShader {
+private:
+  inline static std::unordered_map<uint32_t, std::unique_ptr<Shader>> variants;
+
+public:
+  inline static std::string vertexPath = "src/shaders/phong.vert";
+  inline static std::string fragmentPath = "src/shaders/phong.frag";
+  inline static std::string gbufferPath = "src/shaders/gbuffer.frag";
+
+  /* The scene side of a feature set: which lights and fog are on right now, or the G-buffer on the deferred path */
+  static PhongFeatures sceneFeatures() {
+    PhongFeatures features;
+    if (DeferredRenderer::enabled) {
+      features.gbuffer = true;
+      return features;
+    }
+    features.directionalLight = Lighting::directionalEnabled;
+    features.pointLights = Lighting::pointLightCount();
+    features.clusteredLights = Lighting::clustered;
+    features.fog = Lighting::fogEnabled;
+    return features;
+  }
+
+  /*
+   * Program for features. A variant nothing has asked for yet is queued on
+   * ShaderQueue, so this never waits for the compiler; draws with it are
+   * skipped until it has linked.
+   */
+  static unsigned int program(const PhongFeatures& features) {
+    uint32_t key = features.key();
+    auto found = variants.find(key);
+    if (found == variants.end()) {
+      found = variants.emplace(key, std::make_unique<Shader>(vertexPath.c_str(), (features.gbuffer ? gbufferPath : fragmentPath).c_str(), features.defines(), true)).first;
+    }
+    return found->second->ID;
+  }
+
+  static size_t variantCount() {
+    return variants.size();
+  }
+};
+
+#endif
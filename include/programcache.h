@@ -0,0 +1,230 @@
+/*
+ * include/programcache.h
+ *
+ * On-disk cache of linked shader programs. After a program links, its driver
+ * binary is saved with glGetProgramBinary; the next start-up hands that back
+ * to glProgramBinary and skips compiling and linking altogether. Entries are
+ * keyed by a 64-bit FNV-1a hash of the sources, the defines and the driver's
+ * vendor, renderer and version strings, so editing a shader or updating the
+ * driver simply misses. A binary the driver rejects anyway is deleted and the
+ * program is compiled and cached again.
+ *
+ * Program binaries are GL 4.1 (or ARB_get_program_binary); the entry points
+ * are not in the 3.3 glad loader and are fetched through GLFW. Without them,
+ * or when the driver offers no binary formats, every program is compiled as
+ * before.
+ */
+
+#ifndef PROGRAMCACHE_H
+#define PROGRAMCACHE_H
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <mappedfile.h>
+
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+
+#define PROGRAM_CACHE_MAGIC "NPRG"
+#define PROGRAM_CACHE_VERSION 1
+#define PROGRAM_CACHE_EXTENSION ".bin"
+
+#define FNV64_OFFSET 14695981039346656037ull
+#define FNV64_PRIME 1099511628211ull
+
+/* Layout: ProgramCacheHeader, then size bytes of driver binary */
+struct ProgramCacheHeader {
+  char magic[4];
+  uint32_t version;
+  uint64_t key;    /* Repeated so a renamed or truncated file is never loaded */
+  uint32_t format; /* As returned by glGetProgramBinary */
+  uint32_t size;
+};
+
+class ProgramCache {
+private:
+  typedef void (APIENTRYP GetProgramBinaryProc)(GLuint program, GLsizei bufSize, GLsizei* length, GLenum* binaryFormat, void* binary);
+  typedef void (APIENTRYP ProgramBinaryProc)(GLuint program, GLenum binaryFormat, const void* binary, GLsizei length);
+  typedef void (APIENTRYP ProgramParameteriProc)(GLuint program, GLenum pname, GLint value);
+
+  inline static bool initialized = false;
+  inline static bool supported = false;
+  inline static GetProgramBinaryProc getProgramBinary = nullptr;
+  inline static ProgramBinaryProc programBinary = nullptr;
+  inline static ProgramParameteriProc programParameteri = nullptr;
+  /* Hash of the driver strings, folded into every key */
+  inline static uint64_t driver = FNV64_OFFSET;
+
+  static void initialize() {
+    if (initialized) {
+      return;
+    }
+    initialized = true;
+
+    getProgramBinary = (GetProgramBinaryProc)glfwGetProcAddress("glGetProgramBinary");
+    programBinary = (ProgramBinaryProc)glfwGetProcAddress("glProgramBinary");
+    programParameteri = (ProgramParameteriProc)glfwGetProcAddress("glProgramParameteri");
+
+    GLint formats = 0;
+    if (getProgramBinary != nullptr && programBinary != nullptr) {
+      glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    }
+    supported = formats > 0;
+
+    for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION, GL_SHADING_LANGUAGE_VERSION }) {
+      const char* value = (const char*)glGetString(name);
+      driver = hash(value ? value : "", value ? strlen(value) : 0, driver);
+    }
+  }
+
+  static std::string path(uint64_t key) {
+    char name[17];
+    snprintf(name, sizeof(name), "%016llx", (unsigned long long)key);
+    return directory + "/" + name + PROGRAM_CACHE_EXTENSION;
+  }
+
+public:
+  /* Where binaries are kept, relative to the working directory; empty turns the cache off */
+  inline static std::string directory = "shadercache";
+
+  /* FNV-1a, 64 bit */
+  static uint64_t hash(const void* data, size_t size, uint64_t seed = FNV64_OFFSET) {
+    const unsigned char* bytes = (const unsigned char*)data;
+    for (size_t i = 0; i < size; ++i) {
+      seed = (seed ^ bytes[i]) * FNV64_PRIME;
+    }
+    return seed;
+  }
+
+  /* Whether programs are cached at all; needs a current context */
+  static bool enabled() {
+    initialize();
+    return supported && !directory.empty();
+  }
+
+  /*
+   * Key of the program built from these (preprocessed) sources and defines on
+   * this driver. Each part is hashed with its length, so moving text from one
+   * source to the next changes the key.
+   */
+  static uint64_t key(const std::string& vertexSource, const std::string& fragmentSource, const std::string& defines) {
+    initialize();
+    uint64_t result = driver;
+    for (const std::string* part : { &vertexSource, &fragmentSource, &defines }) {
+      uint64_t length = part->size();
+      result = hash(&length, sizeof(length), result);
+      result = hash(part->data(), part->size(), result);
+    }
+    return result;
+  }
+
+  /*
+   * Load the cached binary for key into program. Returns false, leaving
+   * program unlinked and ready to be compiled, if there is none or the driver
+   * refuses it; a refused entry is deleted.
+   */
+  static bool load(GLuint program, uint64_t key) {
+    if (!enabled()) {
+      return false;
+    }
+
+    std::string file = path(key);
+    bool valid = false;
+    {
+      MappedFile mapped;
+      if (!mapped.open(file)) {
+        return false;
+      }
+
+      const ProgramCacheHeader* header = (const ProgramCacheHeader*)mapped.data;
+      if (mapped.size >= sizeof(ProgramCacheHeader) && memcmp(header->magic, PROGRAM_CACHE_MAGIC, 4) == 0 && header->version == PROGRAM_CACHE_VERSION &&
+          header->key == key && mapped.size - sizeof(ProgramCacheHeader) == header->size) {
+        programBinary(program, header->format, mapped.data + sizeof(ProgramCacheHeader), header->size);
+        GLint linked = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        valid = linked == GL_TRUE;
+      }
+    }
+
+    if (!valid) {
+      std::error_code error;
+      std::filesystem::remove(file, error);
+    }
+    return valid;
+  }
+
+  /* Ask the driver to keep program's binary retrievable; call before linking */
+  static void prepare(GLuint program) {
+    if (enabled() && programParameteri != nullptr) {
+      programParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+  }
+
+  /* Save the binary of a successfully linked program under key */
+  static void store(GLuint program, uint64_t key) {
+    if (!enabled()) {
+      return;
+    }
+
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) {
+      return;
+    }
+
+    std::vector<unsigned char> binary(length);
+    GLsizei written = 0;
+    GLenum format = 0;
+    getProgramBinary(program, length, &written, &format, binary.data());
+    if (written <= 0) {
+      return;
+    }
+
+    ProgramCacheHeader header;
+    memcpy(header.magic, PROGRAM_CACHE_MAGIC, 4);
+    header.version = PROGRAM_CACHE_VERSION;
+    header.key = key;
+    header.format = format;
+    header.size = (uint32_t)written;
+
+    /* Written under a temporary name and renamed, so another instance never maps half a file */
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+    std::string file = path(key);
+    std::string temporary = file + ".tmp";
+    {
+      std::ofstream out(temporary, std::ios::binary);
+      out.write((const char*)&header, sizeof(header));
+      out.write((const char*)binary.data(), written);
+      if (!out) {
+        std::cout << "ERROR::SHADER::PROGRAM_CACHE_NOT_WRITTEN: " << file << std::endl;
+        out.close();
+        std::filesystem::remove(temporary, error);
+        return;
+      }
+    }
+    std::filesystem::rename(temporary, file, error);
+    if (error) {
+      std::filesystem::remove(temporary, error);
+    }
+  }
+};
+
+#endif
@@ -0,0 +1,275 @@
+/*
+ * include/quantize.h
+ *
+ * Quantized vertex layouts for imported meshes. Positions are stored as
+ * normalized integers relative to the mesh's bounding box, normals as signed
+ * 10:10:10:2 and UVs as half floats, so the vertex fetch hardware expands them
+ * and no shader has to change. The position offset and scale go into a
+ * dequantize matrix that Mesh multiplies onto its model matrix. The layout is
+ * picked first and the vertices are then written once, straight into their
+ * destination buffer.
+ *
+ * The scale is the same on every axis (the box's longest side): a uniform
+ * scale does not change the direction of transformed normals, whichever way a
+ * shader builds its normal matrix.
+ */
+
+#ifndef QUANTIZE_H
+#define QUANTIZE_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <culling.h>
+#include <vertex.h>
+
+/*
+ * Largest error a quantized layout may introduce before the importer falls
+ * back to the next larger one. The position tolerance is a distance, so
+ * every mesh of a model (and every model) gets the same precision however
+ * big it is, and neighbouring meshes quantized against their own boxes
+ * never drift apart by more than it. A position is off by up to 1/2046 of
+ * the box's longest side with 10 bits and 1/131070 with 16, so at the
+ * default QUANTIZED12 covers meshes up to about 1 unit across, QUANTIZED16
+ * up to about 65 and larger ones stay float. tools/cook prints the layout
+ * each mesh got.
+ */
+struct QuantizationTolerance {
+  float position = 0.0005f;          /* In object space units, half a millimetre for a scene in metres; 0 keeps float vertices */
+  float normal = 0.005f;             /* Length of the error vector on a unit normal, about 0.3 degrees */
+  float texture = 1.0f / 2048.0f;    /* In UV units; half a texel of a 1024 texture */
+};
+
+/* How a mesh's vertices are stored: a quantized layout and its dequantize parameters, or POSITION_NORMAL_TEXTURE floats */
+struct VertexQuantization {
+  enum VertexAttributes attributes = POSITION_NORMAL_TEXTURE;
+  glm::vec3 offset = glm::vec3(0.0f);
+  float scale = 1.0f;
+
+  /* Object space position = dequantize * stored position */
+  glm::mat4 dequantize() const {
+    return glm::scale(glm::translate(glm::mat4(1.0f), offset), glm::vec3(scale));
+  }
+};
+
+class VertexQuantizer {
+private:
+  static uint32_t floatBits(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, 4);
+    return bits;
+  }
+
+  static float bitsFloat(uint32_t bits) {
+    float value;
+    memcpy(&value, &bits, 4);
+    return value;
+  }
+
+  static uint32_t quantizeUnorm(float value, int bits) {
+    float maximum = (float)((1 << bits) - 1);
+    return (uint32_t)(std::clamp(value, 0.0f, 1.0f) * maximum + 0.5f);
+  }
+
+  static uint32_t quantizeSnorm(float value, int bits) {
+    float maximum = (float)((1 << (bits - 1)) - 1);
+    int32_t quantized = (int32_t)std::lround(std::clamp(value, -1.0f, 1.0f) * maximum);
+    return (uint32_t)quantized & ((1u << bits) - 1);
+  }
+
+  static float dequantizeSnorm(uint32_t value, int bits) {
+    int32_t quantized = (int32_t)(value << (32 - bits)) >> (32 - bits);
+    return std::max(-1.0f, quantized / (float)((1 << (bits - 1)) - 1));
+  }
+
+  /* Encode one POSITION_NORMAL_TEXTURE vertex in a quantized layout */
+  static void encodeVertex(const float* vertex, const VertexQuantization& quantization, uint8_t* target) {
+    glm::vec3 position = (glm::vec3(vertex[0], vertex[1], vertex[2]) - quantization.offset) / quantization.scale;
+    uint32_t normal = packSnorm1010102(glm::vec3(vertex[3], vertex[4], vertex[5]));
+    uint16_t texture[2] = { halfFromFloat(vertex[6]), halfFromFloat(vertex[7]) };
+
+    if (quantization.attributes == POSITION_NORMAL_TEXTURE_QUANTIZED16) {
+      uint16_t packed[4] = { (uint16_t)quantizeUnorm(position.x, 16), (uint16_t)quantizeUnorm(position.y, 16), (uint16_t)quantizeUnorm(position.z, 16), 0 };
+      memcpy(target, packed, 8);
+      memcpy(target + 8, &normal, 4);
+      memcpy(target + 12, texture, 4);
+    } else {
+      uint32_t packed = quantizeUnorm(position.x, 10) | quantizeUnorm(position.y, 10) << 10 | quantizeUnorm(position.z, 10) << 20;
+      memcpy(target, &packed, 4);
+      memcpy(target + 4, &normal, 4);
+      memcpy(target + 8, texture, 4);
+    }
+  }
+
+  /* Whether every vertex decodes back within tolerance */
+  static bool withinTolerance(const float* vertices, size_t count, const VertexQuantization& quantization, const QuantizationTolerance& tolerance) {
+    uint8_t source[16];
+    for (size_t i = 0; i < count; ++i) {
+      const float* vertex = vertices + i * 8;
+      encodeVertex(vertex, quantization, source);
+
+      glm::vec3 position;
+      uint32_t normal;
+      uint16_t texture[2];
+      if (quantization.attributes == POSITION_NORMAL_TEXTURE_QUANTIZED16) {
+        uint16_t packed[4];
+        memcpy(packed, source, 8);
+        position = glm::vec3(packed[0], packed[1], packed[2]) / 65535.0f;
+        memcpy(&normal, source + 8, 4);
+        memcpy(texture, source + 12, 4);
+      } else {
+        uint32_t packed;
+        memcpy(&packed, source, 4);
+        position = glm::vec3(packed & 0x3FF, (packed >> 10) & 0x3FF, (packed >> 20) & 0x3FF) / 1023.0f;
+        memcpy(&normal, source + 4, 4);
+        memcpy(texture, source + 8, 4);
+      }
+
+      glm::vec3 positionError = glm::abs(quantization.offset + position * quantization.scale - glm::vec3(vertex[0], vertex[1], vertex[2]));
+      if (std::max(positionError.x, std::max(positionError.y, positionError.z)) > tolerance.position) {
+        return false;
+      }
+
+      glm::vec3 decodedNormal = unpackSnorm1010102(normal);
+      if (glm::length(decodedNormal - glm::vec3(vertex[3], vertex[4], vertex[5])) > tolerance.normal) {
+        return false;
+      }
+
+      if (std::fabs(floatFromHalf(texture[0]) - vertex[6]) > tolerance.texture || std::fabs(floatFromHalf(texture[1]) - vertex[7]) > tolerance.texture) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+public:
+  /* Used by importModel; set before loading to trade precision for size */
+  inline static QuantizationTolerance tolerance;
+
+  /* Round to nearest; out of range values become the largest half, tiny ones flush to zero */
+  static uint16_t halfFromFloat(float value) {
+    uint32_t bits = floatBits(value);
+    uint16_t sign = (bits >> 16) & 0x8000;
+    float magnitude = std::fabs(value);
+
+    if (magnitude != magnitude) {
+      return sign | 0x7E00;
+    }
+    if (magnitude >= 65520.0f) {
+      return sign | 0x7BFF;
+    }
+    if (magnitude < 6.103515625e-05f) {
+      /* Subnormal halves are multiples of 2^-24 */
+      return sign | (uint16_t)std::lround(magnitude * 16777216.0f);
+    }
+
+    uint32_t magnitudeBits = floatBits(magnitude);
+    uint32_t exponent = (magnitudeBits >> 23) - 127 + 15;
+    uint32_t mantissa = magnitudeBits & 0x7FFFFF;
+    uint32_t half = exponent << 10 | mantissa >> 13;
+    /* Round half to even on the dropped 13 bits; a carry correctly bumps the exponent */
+    uint32_t remainder = mantissa & 0x1FFF;
+    if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1))) {
+      half++;
+    }
+    return sign | (uint16_t)half;
+  }
+
+  static float floatFromHalf(uint16_t half) {
+    uint32_t sign = (uint32_t)(half & 0x8000) << 16;
+    uint32_t exponent = (half >> 10) & 0x1F;
+    uint32_t mantissa = half & 0x3FF;
+
+    if (exponent == 0) {
+      float magnitude = mantissa / 16777216.0f;
+      return sign ? -magnitude : magnitude;
+    }
+    if (exponent == 31) {
+      return bitsFloat(sign | 0x7F800000 | mantissa << 13);
+    }
+    return bitsFloat(sign | (exponent - 15 + 127) << 23 | mantissa << 13);
+  }
+
+  /* GL_INT_2_10_10_10_REV with normalization; w is left at 0 */
+  static uint32_t packSnorm1010102(glm::vec3 value) {
+    return quantizeSnorm(value.x, 10) | quantizeSnorm(value.y, 10) << 10 | quantizeSnorm(value.z, 10) << 20;
+  }
+
+  static glm::vec3 unpackSnorm1010102(uint32_t value) {
+    return glm::vec3(dequantizeSnorm(value & 0x3FF, 10), dequantizeSnorm((value >> 10) & 0x3FF, 10), dequantizeSnorm((value >> 20) & 0x3FF, 10));
+  }
+
+  /*
+   * Pick the smallest layout for count POSITION_NORMAL_TEXTURE vertices that
+   * stays within tolerance: 12 bytes, then 16 bytes. Returns false, leaving
+   * quantization at floats, if neither does.
+   */
+  static bool quantize(const float* vertices, size_t count, const BoundingVolume& bounds, const QuantizationTolerance& tolerance, VertexQuantization& quantization) {
+    quantization = VertexQuantization();
+    if (count == 0 || tolerance.position <= 0.0f) {
+      return false;
+    }
+
+    glm::vec3 extent = bounds.max - bounds.min;
+    float scale = std::max(extent.x, std::max(extent.y, extent.z));
+
+    const enum VertexAttributes layouts[] = { POSITION_NORMAL_TEXTURE_QUANTIZED12, POSITION_NORMAL_TEXTURE_QUANTIZED16 };
+    for (enum VertexAttributes layout : layouts) {
+      quantization.attributes = layout;
+      quantization.offset = bounds.min;
+      quantization.scale = scale > 0.0f ? scale : 1.0f;
+      if (withinTolerance(vertices, count, quantization, tolerance)) {
+        return true;
+      }
+    }
+
+    quantization = VertexQuantization();
+    return false;
+  }
+
+  static const char* layoutName(enum VertexAttributes attributes) {
+    switch (attributes) {
+      case POSITION_NORMAL_TEXTURE_QUANTIZED16: return "QUANTIZED16";
+      case POSITION_NORMAL_TEXTURE_QUANTIZED12: return "QUANTIZED12";
+      default: return "FLOAT";
+    }
+  }
+
+  /* Write count POSITION_NORMAL_TEXTURE vertices to out in the layout quantize picked; out may be mapped GPU memory */
+  static void encode(const float* vertices, size_t count, const VertexQuantization& quantization, void* out) {
+    if (quantization.attributes == POSITION_NORMAL_TEXTURE) {
+      memcpy(out, vertices, count * 8 * sizeof(float));
+      return;
+    }
+
+    size_t stride = vertexStride(quantization.attributes);
+    for (size_t i = 0; i < count; ++i) {
+      encodeVertex(vertices + i * 8, quantization, (uint8_t*)out + i * stride);
+    }
+  }
+
+  /* Write just the positions, in the position-only stream of the same layout (see positionStride) */
+  static void encodePositions(const float* vertices, size_t count, const VertexQuantization& quantization, void* out) {
+    size_t size = positionStride(quantization.attributes);
+    if (quantization.attributes == POSITION_NORMAL_TEXTURE) {
+      for (size_t i = 0; i < count; ++i) {
+        memcpy((uint8_t*)out + i * size, vertices + i * 8, size);
+      }
+      return;
+    }
+
+    uint8_t vertex[16];
+    for (size_t i = 0; i < count; ++i) {
+      encodeVertex(vertices + i * 8, quantization, vertex);
+      memcpy((uint8_t*)out + i * size, vertex, size);
+    }
+  }
+};
+
+#endif
@@ -0,0 +1,330 @@
+/*
+ * include/renderqueue.h
+ *
+ * Collect the draw packets for a frame, sort them by render state and submit
+ * them in that order so neighbouring draws share programs, textures and VAOs.
+ */
+
+#ifndef RENDERQUEUE_H
+#define RENDERQUEUE_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <cstdint>
+#include <vector>
+
+#include <camera.h>
+#include <clusters.h>
+#include <shader.h>
+#include <glstate.h>
+
+/* Most textures any single draw binds */
+#define MAX_PACKET_TEXTURES 4
+
+/*
+ * First attribute location of the per-instance model matrix. A mat4 attribute
+ * takes four consecutive locations (3, 4, 5 and 6).
+ */
+#define INSTANCE_MODEL_LOCATION 3
+
+/*
+ * Passes are drawn in enum order. Opaque packets are sorted front-to-back so
+ * the depth test rejects hidden fragments before the fragment shader runs,
+ * transparent packets back-to-front so they blend correctly. G-buffer
+ * packets are opaque ones for the deferred path (deferred.h), which lights
+ * them before the other passes are drawn.
+ */
+enum RenderPass {
+  RENDER_PASS_GBUFFER,
+  RENDER_PASS_OPAQUE,
+  RENDER_PASS_TRANSPARENT,
+};
+
+/* Everything needed to issue one draw without going back to the object */
+struct DrawPacket {
+  uint64_t key;
+  unsigned int shaderProgram;
+  unsigned int VAO;
+  unsigned int depthVAO;      /* Position-only VAO for the depth pre-pass, 0 to leave the packet out of it */
+  unsigned int firstIndex;    /* Offset into the element buffer, e.g. the start of a LOD */
+  unsigned int indexCount;
+  unsigned int instanceCount; /* 0 for a regular draw, otherwise the number of instances */
+  unsigned int textureCount;
+  unsigned int textures[MAX_PACKET_TEXTURES]; /* Bound to units 0 to textureCount - 1, in order */
+  glm::mat4 model;
+  glm::mat3 normalMatrix;     /* For the "normalMatrix" uniform; see normalTransform */
+};
+
+/*
+ * Sort key layout, most significant bits first:
+ *
+ *   | pass (2) | shader program (10) | material (12) | VAO (16) | depth (24) |
+ *
+ * GL object names are small integers in practice so the low bits of each are
+ * enough to group identical state; a collision only costs a redundant bind,
+ * never a wrong one, because submit() compares the real names.
+ */
+#define SORT_KEY_PASS_SHIFT     62
+#define SORT_KEY_PROGRAM_SHIFT  52
+#define SORT_KEY_MATERIAL_SHIFT 40
+#define SORT_KEY_VAO_SHIFT      24
+
+#define SORT_KEY_PROGRAM_MASK   0x3FFull
+#define SORT_KEY_MATERIAL_MASK  0xFFFull
+#define SORT_KEY_VAO_MASK       0xFFFFull
+#define SORT_KEY_DEPTH_MASK     0xFFFFFFull
+
+class RenderQueue {
+private:
+  std::vector<DrawPacket> packets;
+
+  /* Radix sort works on (key, packet index) pairs so the packets never move */
+  std::vector<uint64_t> keys, keysScratch;
+  std::vector<uint32_t> order, orderScratch;
+
+  glm::vec3 eye;
+  glm::vec3 forward;
+  float farPlane;
+  float height;
+
+  /* Whether submitDepth() has laid down depth for this frame's pre-passable packets */
+  bool prepassed = false;
+
+  /* Fold the bound texture set into the material bits of the key */
+  static uint64_t materialId(const DrawPacket& packet) {
+    uint32_t hash = 2166136261u;
+    for (unsigned int i = 0; i < packet.textureCount; ++i) {
+      hash = (hash ^ packet.textures[i]) * 16777619u;
+    }
+    return (hash ^ (hash >> 12) ^ (hash >> 24)) & SORT_KEY_MATERIAL_MASK;
+  }
+
+  /* View depth of a point quantized to 24 bits, 0 at the eye and max at the far plane */
+  uint64_t depthBits(glm::vec3 worldPos) const {
+    float depth = glm::dot(worldPos - eye, forward) / farPlane;
+    depth = depth < 0.0f ? 0.0f : (depth > 1.0f ? 1.0f : depth);
+    return (uint64_t)(depth * (float)SORT_KEY_DEPTH_MASK);
+  }
+
+public:
+  /* Start a new frame as seen from the given camera, drawn viewportHeight pixels high */
+  void begin(const Camera& camera, int viewportHeight) {
+    packets.clear();
+    height = viewportHeight > 0 ? (float)viewportHeight : 1.0f;
+    prepassed = false;
+    eye = camera.position;
+    forward = glm::normalize(camera.lookVector);
+    farPlane = camera.farPlane > 0.0f ? camera.farPlane : 1.0f;
+  }
+
+  /* Queue a draw; worldPos is used to order it by distance from the camera */
+  void add(DrawPacket packet, enum RenderPass pass, glm::vec3 worldPos) {
+    uint64_t depth = depthBits(worldPos);
+    if (pass == RENDER_PASS_TRANSPARENT) {
+      depth = SORT_KEY_DEPTH_MASK - depth;
+    }
+
+    packet.key = ((uint64_t)pass << SORT_KEY_PASS_SHIFT)
+      | (((uint64_t)packet.shaderProgram & SORT_KEY_PROGRAM_MASK) << SORT_KEY_PROGRAM_SHIFT)
+      | (materialId(packet) << SORT_KEY_MATERIAL_SHIFT)
+      | (((uint64_t)packet.VAO & SORT_KEY_VAO_MASK) << SORT_KEY_VAO_SHIFT)
+      | depth;
+
+    packets.push_back(packet);
+  }
+
+  /*
+   * LSD radix sort on the 64 bit keys, one byte per pass. Passes where every
+   * key has the same byte (common for the pass and program bytes) are skipped.
+   */
+  void sort() {
+    size_t count = packets.size();
+
+    keys.resize(count);
+    keysScratch.resize(count);
+    order.resize(count);
+    orderScratch.resize(count);
+
+    for (size_t i = 0; i < count; ++i) {
+      keys[i] = packets[i].key;
+      order[i] = (uint32_t)i;
+    }
+
+    for (int shift = 0; shift < 64; shift += 8) {
+      size_t histogram[256] = { 0 };
+      for (size_t i = 0; i < count; ++i) {
+        histogram[(keys[i] >> shift) & 0xFF]++;
+      }
+
+      if (count == 0 || histogram[(keys[0] >> shift) & 0xFF] == count) {
+        continue;
+      }
+
+      size_t offset = 0;
+      for (int bucket = 0; bucket < 256; ++bucket) {
+        size_t bucketSize = histogram[bucket];
+        histogram[bucket] = offset;
+        offset += bucketSize;
+      }
+
+      for (size_t i = 0; i < count; ++i) {
+        size_t destination = histogram[(keys[i] >> shift) & 0xFF]++;
+        keysScratch[destination] = keys[i];
+        orderScratch[destination] = order[i];
+      }
+
+      keys.swap(keysScratch);
+      order.swap(orderScratch);
+    }
+  }
+
+  /*
+   * Only instanced draws enable the instance matrix attribute. Everything
+   * else reads its current value, which has to be the identity matrix. GL
+   * leaves that value undefined after a draw that read the attribute from an
+   * array, so this is called again after every instanced draw.
+   */
+  static void resetInstanceModel() {
+    for (int column = 0; column < 4; ++column) {
+      glVertexAttrib4f(INSTANCE_MODEL_LOCATION + column, column == 0, column == 1, column == 2, column == 3);
+    }
+  }
+
+  /* Point the clustered lighting samplers, where a program has them, at LightClusters' buffers */
+  static void bindClusterSamplers(unsigned int program) {
+    int location = uniformLocation(program, UNIFORM("lightData"));
+    if (location < 0) {
+      return;
+    }
+    glUniform1i(location, LightClusters::lightUnit());
+    glUniform1i(uniformLocation(program, UNIFORM("clusterRecords")), LightClusters::recordUnit());
+    glUniform1i(uniformLocation(program, UNIFORM("lightIndices")), LightClusters::indexUnit());
+  }
+
+  /* Issue the sorted packets; GLState drops the binds that match the previous packet */
+  void submit() {
+    submitRange(0, order.size());
+  }
+
+  /* Issue only the sorted packets of one pass */
+  void submit(enum RenderPass pass) {
+    size_t first = 0;
+    while (first < order.size() && (keys[first] >> SORT_KEY_PASS_SHIFT) < (uint64_t)pass) {
+      first++;
+    }
+    size_t last = first;
+    while (last < order.size() && (keys[last] >> SORT_KEY_PASS_SHIFT) == (uint64_t)pass) {
+      last++;
+    }
+    submitRange(first, last);
+  }
+
+  /*
+   * Draw the opaque packets that have a depthVAO into the depth buffer only,
+   * with program (which must take just the "model" uniform). The colour
+   * passes then test those packets with GL_EQUAL and leave depth writes off,
+   * so each pixel is shaded once. Packets whose own program is not ready yet
+   * are left out, since they will not be drawn to match.
+   */
+  void submitDepth(unsigned int program) {
+    GLState::useProgram(program);
+    int modelLoc = uniformLocation(program, UNIFORM("model"));
+
+    for (size_t i = 0; i < order.size(); ++i) {
+      if ((keys[i] >> SORT_KEY_PASS_SHIFT) != RENDER_PASS_OPAQUE) {
+        continue;
+      }
+      const DrawPacket& packet = packets[order[i]];
+      if (packet.depthVAO == 0 || !ShaderQueue::isReady(packet.shaderProgram)) {
+        continue;
+      }
+
+      glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(packet.model));
+      GLState::bindVertexArray(packet.depthVAO);
+      glDrawElements(GL_TRIANGLES, packet.indexCount, GL_UNSIGNED_INT, (const void*)((size_t)packet.firstIndex * sizeof(unsigned int)));
+    }
+    prepassed = true;
+  }
+
+  size_t size() const {
+    return packets.size();
+  }
+
+  /* Height in pixels of the frame being queued, for screen size decisions like LodSelector's */
+  float viewportHeight() const {
+    return height;
+  }
+
+private:
+  void submitRange(size_t first, size_t last) {
+    unsigned int currentProgram = 0;
+    bool currentReady = false;
+    int modelLoc = -1;
+    int normalLoc = -1;
+    /* Samplers of the PhongShader variants; -1 in programs without them */
+    int diffuseLoc = -1;
+    int specularLoc = -1;
+
+    for (size_t i = first; i < last; ++i) {
+      const DrawPacket& packet = packets[order[i]];
+
+      /* Draws with a program that is still compiling are dropped until it has linked */
+      if (packet.shaderProgram != currentProgram) {
+        currentProgram = packet.shaderProgram;
+        currentReady = ShaderQueue::isReady(currentProgram);
+        if (!currentReady) {
+          continue;
+        }
+        GLState::useProgram(packet.shaderProgram);
+        modelLoc = uniformLocation(packet.shaderProgram, UNIFORM("model"));
+        normalLoc = uniformLocation(packet.shaderProgram, UNIFORM("normalMatrix"));
+        diffuseLoc = uniformLocation(packet.shaderProgram, UNIFORM("diffuseMap"));
+        specularLoc = uniformLocation(packet.shaderProgram, UNIFORM("specularMap"));
+        /* Packets for the uber shader hold the diffuse map (if it has one) then the specular map */
+        if (diffuseLoc >= 0) {
+          glUniform1i(diffuseLoc, 0);
+        }
+        if (specularLoc >= 0) {
+          glUniform1i(specularLoc, diffuseLoc >= 0 ? 1 : 0);
+        }
+        bindClusterSamplers(packet.shaderProgram);
+      } else if (!currentReady) {
+        continue;
+      }
+
+      /* Pre-passed packets only shade the fragments that won the depth pre-pass */
+      bool equalDepth = prepassed && packet.depthVAO != 0;
+      GLState::depthFunc(equalDepth ? GL_EQUAL : GL_LESS);
+      GLState::depthMask(!equalDepth);
+
+      /* Dense units, so the sampler units stay fixed per program and clear of GLState's reserved ones */
+      for (unsigned int t = 0; t < packet.textureCount; ++t) {
+        GLState::bindTexture(t, GL_TEXTURE_2D, packet.textures[t]);
+      }
+
+      glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(packet.model));
+      if (normalLoc >= 0) {
+        glUniformMatrix3fv(normalLoc, 1, GL_FALSE, glm::value_ptr(packet.normalMatrix));
+      }
+
+      GLState::bindVertexArray(packet.VAO);
+
+      const void* firstIndex = (const void*)((size_t)packet.firstIndex * sizeof(unsigned int));
+      if (packet.instanceCount > 0) {
+        glDrawElementsInstanced(GL_TRIANGLES, packet.indexCount, GL_UNSIGNED_INT, firstIndex, packet.instanceCount);
+        resetInstanceModel();
+      } else {
+        glDrawElements(GL_TRIANGLES, packet.indexCount, GL_UNSIGNED_INT, firstIndex);
+      }
+    }
+
+    GLState::depthFunc(GL_LESS);
+    GLState::depthMask(true);
+  }
+
+};
+
+#endif
@@ -2,165 +2,586 @@
 #define SHADER_H
 
 #include <glad/glad.h>
+#include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
 
+#include <archive.h>
+#include <glstate.h>
+#include <lighting.h>
+#include <programcache.h>
+#include <shaderpreprocessor.h>
+#include <trace.h>
+
+#include <cstdint>
 #include <string>
-#include <fstream>
-#include <sstream>
 #include <iostream>
+#include <type_traits>
+#include <vector>
+
+/*
+ * Uniform block binding points shared by every program. GLSL 330 has no
+ * layout(binding = N), so the blocks are bound by name after linking.
+ */
+#define CAMERA_BLOCK_BINDING 0
+
+/*
+ * Uniform reflection
+ *
+ * After linking, every active uniform of a program is enumerated once and its
+ * location stored in a flat open-addressing table keyed by the FNV-1a hash of
+ * its name. Setting a uniform then costs a hash and a probe instead of a
+ * driver string lookup, and never allocates. Entries keep their name and a
+ * probe only stops at a matching name, so two uniforms whose hashes collide
+ * both stay reachable and unknown names never alias a known one.
+ */
+
+/* FNV-1a; constexpr so literal names can be hashed at compile time */
+constexpr uint32_t uniformHash(const char* name, uint32_t hash = 2166136261u) {
+  return *name ? uniformHash(name + 1, (hash ^ (uint8_t)*name) * 16777619u) : hash;
+}
+
+/* A uniform name with its hash precomputed; the name only confirms the match the hash finds */
+struct UniformName {
+  uint32_t hash;
+  const char* name;
+};
+
+/* Hash a literal uniform name at compile time: shader.setFloat(UNIFORM("material.shininess"), 32.0f) */
+#define UNIFORM(name) (UniformName{ std::integral_constant<uint32_t, uniformHash(name)>::value, name })
+
+/* A location looked up once with Shader::handle and reused for every set */
+struct UniformHandle {
+  int location;
+};
+
+class UniformTable {
+private:
+  struct Entry {
+    uint32_t hash;
+    int location;
+    uint32_t name; /* Index into names */
+  };
+
+  /* Power of two sized, at most half full; a hash of 0 marks an empty slot */
+  std::vector<Entry> entries;
+  std::vector<std::string> names;
+
+  static uint32_t slotHash(uint32_t hash) {
+    return hash == 0 ? 1 : hash;
+  }
+
+  /* Colliding hashes simply take the next free slot; lookups tell them apart by name */
+  void insert(uint32_t nameIndex, int location) {
+    const std::string& name = names[nameIndex];
+    uint32_t hash = slotHash(uniformHash(name.c_str()));
+    size_t mask = entries.size() - 1;
+    for (size_t i = hash & mask; ; i = (i + 1) & mask) {
+      if (entries[i].hash == 0) {
+        entries[i] = Entry{ hash, location, nameIndex };
+        return;
+      }
+      if (entries[i].hash == hash && names[entries[i].name] == name) {
+        return;
+      }
+    }
+  }
+
+public:
+  /* Enumerate the active uniforms of a linked program */
+  void reflect(unsigned int program) {
+    GLint count = 0, maxLength = 0;
+    glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+    names.clear();
+    std::vector<int> locations;
+    std::vector<char> buffer(maxLength + 16);
+
+    for (GLint i = 0; i < count; ++i) {
+      GLint size;
+      GLenum type;
+      glGetActiveUniform(program, i, buffer.size(), NULL, &size, &type, buffer.data());
+
+      std::string name = buffer.data();
+      int location = glGetUniformLocation(program, name.c_str());
+
+      /* Members of uniform blocks have no location */
+      if (location < 0) {
+        continue;
+      }
+
+      names.push_back(name);
+      locations.push_back(location);
+
+      /* Arrays are reported once as "name[0]"; make "name" and every element reachable too */
+      if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0) {
+        std::string base = name.substr(0, name.size() - 3);
+        names.push_back(base);
+        locations.push_back(location);
+
+        for (GLint element = 1; element < size; ++element) {
+          std::string elementName = base + "[" + std::to_string(element) + "]";
+          names.push_back(elementName);
+          locations.push_back(glGetUniformLocation(program, elementName.c_str()));
+        }
+      }
+    }
+
+    size_t capacity = 16;
+    while (capacity < names.size() * 2) {
+      capacity *= 2;
+    }
+    entries.assign(capacity, Entry{ 0, -1, 0 });
+
+    for (size_t i = 0; i < names.size(); ++i) {
+      insert((uint32_t)i, locations[i]);
+    }
+  }
+
+  /* -1 if the program has no such active uniform, which glUniform* silently ignores; hash must be uniformHash(name) */
+  int location(uint32_t hash, const char* name) const {
+    if (entries.empty()) {
+      return -1;
+    }
+
+    hash = slotHash(hash);
+    size_t mask = entries.size() - 1;
+    for (size_t i = hash & mask; ; i = (i + 1) & mask) {
+      if (entries[i].hash == hash && names[entries[i].name] == name) {
+        return entries[i].location;
+      }
+      if (entries[i].hash == 0) {
+        return -1;
+      }
+    }
+  }
+};
+
+/* Uniform tables indexed by program name, filled in when a program is first used */
+std::vector<UniformTable*> UniformTables;
+
+UniformTable& uniformTable(unsigned int program) {
+  if (program >= UniformTables.size()) {
+    UniformTables.resize(program + 1, nullptr);
+  }
+  if (UniformTables[program] == nullptr) {
+    UniformTables[program] = new UniformTable();
+    UniformTables[program]->reflect(program);
+  }
+  return *UniformTables[program];
+}
+
+/* Location of a uniform in any program, including ones not built through Shader */
+int uniformLocation(unsigned int program, UniformName name) {
+  return uniformTable(program).location(name.hash, name.name);
+}
+
+/* Attach the engine's shared uniform blocks to their fixed binding points; program must be linked */
+void bindUniformBlocks(GLuint program) {
+  GLuint cameraBlock = glGetUniformBlockIndex(program, "Camera");
+  if (cameraBlock != GL_INVALID_INDEX) {
+    glUniformBlockBinding(program, cameraBlock, CAMERA_BLOCK_BINDING);
+  }
+  GLuint lightsBlock = glGetUniformBlockIndex(program, "Lights");
+  if (lightsBlock != GL_INVALID_INDEX) {
+    glUniformBlockBinding(program, lightsBlock, LIGHTS_BLOCK_BINDING);
+  }
+}
+
+/*
+ * Compile queue
+ *
+ * Asking for a compile or link status makes the driver finish that work
+ * there and then, so compiling programs one after the other keeps only one
+ * compiler thread busy. ShaderQueue submits the compile and link of a
+ * program and leaves it; the status is only read once the program is needed
+ * or, with KHR_parallel_shader_compile (or the ARB version), once
+ * GL_COMPLETION_STATUS_KHR says the driver's compiler threads are done with
+ * it. Until then the program is pending and RenderQueue skips its draws.
+ * Without the extension update() finishes every pending program, so loading
+ * in between still overlaps whatever the driver compiles in the background.
+ */
+
+#ifndef GL_MAX_SHADER_COMPILER_THREADS_KHR
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+#endif
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+enum ShaderStatus {
+  SHADER_READY,   /* Linked, or not built through Shader at all */
+  SHADER_PENDING, /* Submitted; the driver may still be compiling it */
+  SHADER_FAILED   /* Did not compile or link; the errors have been printed */
+};
+
+class ShaderQueue {
+private:
+  typedef void (APIENTRYP MaxShaderCompilerThreadsProc)(GLuint count);
+
+  struct PendingProgram {
+    GLuint program;
+    GLuint vertex;
+    GLuint fragment;
+    /* Files behind each source string, for naming them in errors */
+    std::vector<std::string> vertexFiles;
+    std::vector<std::string> fragmentFiles;
+    uint64_t cacheKey;
+    std::string path;
+  };
+
+  inline static bool initialized = false;
+  inline static bool parallel = false;
+  inline static std::vector<PendingProgram> pending;
+  /* Indexed by program name like UniformTables; missing entries are SHADER_READY */
+  inline static std::vector<uint8_t> statuses;
+
+  static void initialize() {
+    if (initialized) {
+      return;
+    }
+    initialized = true;
+
+    MaxShaderCompilerThreadsProc maxThreads = nullptr;
+    if (glfwExtensionSupported("GL_KHR_parallel_shader_compile")) {
+      maxThreads = (MaxShaderCompilerThreadsProc)glfwGetProcAddress("glMaxShaderCompilerThreadsKHR");
+    } else if (glfwExtensionSupported("GL_ARB_parallel_shader_compile")) {
+      maxThreads = (MaxShaderCompilerThreadsProc)glfwGetProcAddress("glMaxShaderCompilerThreadsARB");
+    }
+    parallel = maxThreads != nullptr;
+    if (parallel) {
+      /* 0xFFFFFFFF lets the driver use as many threads as it likes */
+      maxThreads(0xFFFFFFFF);
+    }
+  }
+
+  static void setStatus(GLuint program, enum ShaderStatus status) {
+    if (program >= statuses.size()) {
+      statuses.resize(program + 1, SHADER_READY);
+    }
+    statuses[program] = status;
+  }
+
+  static bool checkCompileErrors(GLuint shader, const char* type, const std::vector<std::string>& files) {
+    GLint success;
+    GLchar infoLog[1024];
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+    if (!success) {
+      glGetShaderInfoLog(shader, 1024, NULL, infoLog);
+      std::cout << "ERROR::SHADER_COMPILATION_ERROR of type: " << type << "\n" << infoLog;
+      /* Error locations are "source(line)"; name the file behind each source number */
+      for (size_t i = 0; i < files.size(); ++i) {
+        std::cout << "  source " << i << ": " << files[i] << "\n";
+      }
+      std::cout << " -- --------------------------------------------------- -- " << std::endl;
+    }
+    return success;
+  }
+
+  static bool checkLinkErrors(GLuint program) {
+    GLint success;
+    GLchar infoLog[1024];
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success) {
+      glGetProgramInfoLog(program, 1024, NULL, infoLog);
+      std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: PROGRAM\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
+    }
+    return success;
+  }
+
+  /* Read the results of a submitted program; blocks if the driver is not done with it */
+  static void complete(PendingProgram& entry) {
+    TraceScope trace("shader", "finish", entry.path);
+    bool compiled = checkCompileErrors(entry.vertex, "VERTEX", entry.vertexFiles);
+    compiled = checkCompileErrors(entry.fragment, "FRAGMENT", entry.fragmentFiles) && compiled;
+    bool linked = checkLinkErrors(entry.program);
+
+    /* The shaders are linked into the program now and no longer necessary */
+    glDetachShader(entry.program, entry.vertex);
+    glDetachShader(entry.program, entry.fragment);
+    glDeleteShader(entry.vertex);
+    glDeleteShader(entry.fragment);
+
+    if (compiled && linked) {
+      ProgramCache::store(entry.program, entry.cacheKey);
+      ready(entry.program, true);
+    } else {
+      setStatus(entry.program, SHADER_FAILED);
+    }
+  }
+
+public:
+  /* Whether the driver compiles in the background and reports when it is done */
+  static bool parallelSupported() {
+    initialize();
+    return parallel;
+  }
+
+  /*
+   * Start compiling both stages and linking them into program, without
+   * waiting for either. The program stays pending until update() or finish()
+   * picks up the result.
+   */
+  static void submit(GLuint program, const std::string& vertexCode, const std::string& fragmentCode, const std::vector<std::string>& vertexFiles,
+                     const std::vector<std::string>& fragmentFiles, uint64_t cacheKey, const std::string& path) {
+    initialize();
+    TraceScope trace("shader", "compile", path);
+
+    PendingProgram entry;
+    entry.program = program;
+    entry.vertexFiles = vertexFiles;
+    entry.fragmentFiles = fragmentFiles;
+    entry.cacheKey = cacheKey;
+    entry.path = path;
+
+    const char* vertexSource = vertexCode.c_str();
+    const char* fragmentSource = fragmentCode.c_str();
+    entry.vertex = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(entry.vertex, 1, &vertexSource, NULL);
+    glCompileShader(entry.vertex);
+    entry.fragment = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(entry.fragment, 1, &fragmentSource, NULL);
+    glCompileShader(entry.fragment);
+
+    glAttachShader(program, entry.vertex);
+    glAttachShader(program, entry.fragment);
+    ProgramCache::prepare(program);
+    glLinkProgram(program);
+
+    setStatus(program, SHADER_PENDING);
+    pending.push_back(std::move(entry));
+  }
+
+  /* Mark a program that linked some other way (e.g. from the program cache) as ready to draw with */
+  static void ready(GLuint program, bool linked) {
+    if (!linked) {
+      setStatus(program, SHADER_FAILED);
+      return;
+    }
+    bindUniformBlocks(program);
+    uniformTable(program);
+    setStatus(program, SHADER_READY);
+  }
+
+  /* Finish the programs the driver is done with; call once per frame */
+  static void update() {
+    if (pending.empty()) {
+      return;
+    }
+
+    size_t kept = 0;
+    for (size_t i = 0; i < pending.size(); ++i) {
+      GLint done = GL_TRUE;
+      if (parallel) {
+        glGetProgramiv(pending[i].program, GL_COMPLETION_STATUS_KHR, &done);
+      }
+      if (done) {
+        complete(pending[i]);
+      } else {
+        pending[kept++] = std::move(pending[i]);
+      }
+    }
+    pending.resize(kept);
+  }
+
+  /* Wait for program if it is pending */
+  static void finish(GLuint program) {
+    for (size_t i = 0; i < pending.size(); ++i) {
+      if (pending[i].program == program) {
+        PendingProgram entry = std::move(pending[i]);
+        pending.erase(pending.begin() + i);
+        complete(entry);
+        return;
+      }
+    }
+  }
+
+  /* Wait for every pending program, e.g. at the end of a loading screen */
+  static void finishAll() {
+    std::vector<PendingProgram> entries = std::move(pending);
+    pending.clear();
+    for (PendingProgram& entry : entries) {
+      complete(entry);
+    }
+  }
+
+  static enum ShaderStatus status(GLuint program) {
+    return program < statuses.size() ? (enum ShaderStatus)statuses[program] : SHADER_READY;
+  }
+
+  /* Only linked programs are ready; pending and failed ones should not be drawn with */
+  static bool isReady(GLuint program) {
+    return status(program) == SHADER_READY;
+  }
+
+  static size_t pendingCount() {
+    return pending.size();
+  }
+};
 
 // Most of the below shader class is from: https://learnopengl.com/Getting-started/Shaders
 class Shader {
 public:
   unsigned int ID;
-  // constructor generates the shader on the fly
+  // constructor generates the shader on the fly; the program is linked
+  // when it returns
   // ------------------------------------------------------------------------
   Shader(const char* vertexPath, const char* fragmentPath)
+    : Shader(vertexPath, fragmentPath, ShaderDefines())
+  {
+  }
+  // the same, with defines injected after #version; #include is resolved in both
+  // ------------------------------------------------------------------------
+  Shader(const char* vertexPath, const char* fragmentPath, const ShaderDefines& defines)
+    : Shader(vertexPath, fragmentPath, defines, false)
   {
-    // 1. retrieve the vertex/fragment source code from filePath
+  }
+  // queued, the compile is only submitted and ShaderQueue finishes it once
+  // the driver is done; ready() says when it can be drawn with
+  // ------------------------------------------------------------------------
+  Shader(const char* vertexPath, const char* fragmentPath, const ShaderDefines& defines, bool queued)
+  {
+    TraceScope trace("shader", "load", vertexPath);
+    // 1. retrieve and preprocess the vertex/fragment source code, from a mounted asset pack or from disk
     std::string vertexCode;
     std::string fragmentCode;
-    std::ifstream vShaderFile;
-    std::ifstream fShaderFile;
-    // ensure ifstream objects can throw exceptions:
-    vShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-    fShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-    try 
+    std::vector<std::string> vertexFiles;
+    std::vector<std::string> fragmentFiles;
+    bool read = ShaderPreprocessor::process(vertexPath, defines, vertexCode, vertexFiles);
+    read = ShaderPreprocessor::process(fragmentPath, defines, fragmentCode, fragmentFiles) && read;
+    ID = glCreateProgram();
+    if (!read)
     {
-      // open files
-      vShaderFile.open(vertexPath);
-      fShaderFile.open(fragmentPath);
-      std::stringstream vShaderStream, fShaderStream;
-      // read file's buffer contents into streams
-      vShaderStream << vShaderFile.rdbuf();
-      fShaderStream << fShaderFile.rdbuf();		
-      // close file handlers
-      vShaderFile.close();
-      fShaderFile.close();
-      // convert stream into string
-      vertexCode = vShaderStream.str();
-      fragmentCode = fShaderStream.str();			
-    }
-    catch (std::ifstream::failure& e)
+      ShaderQueue::ready(ID, false);
+      return;
+    }
+    // 2. use the cached binary of this program if the driver still accepts it
+    uint64_t cacheKey = ProgramCache::key(vertexCode, fragmentCode, ShaderPreprocessor::describe(defines));
+    bool cached;
     {
-      std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << e.what() << std::endl;
-    }
-    const char* vShaderCode = vertexCode.c_str();
-    const char * fShaderCode = fragmentCode.c_str();
-    // 2. compile shaders
-    unsigned int vertex, fragment;
-    // vertex shader
-    vertex = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertex, 1, &vShaderCode, NULL);
-    glCompileShader(vertex);
-    checkCompileErrors(vertex, "VERTEX");
-    // fragment Shader
-    fragment = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragment, 1, &fShaderCode, NULL);
-    glCompileShader(fragment);
-    checkCompileErrors(fragment, "FRAGMENT");
-    // shader Program
-    ID = glCreateProgram();
-    glAttachShader(ID, vertex);
-    glAttachShader(ID, fragment);
-    glLinkProgram(ID);
-    checkCompileErrors(ID, "PROGRAM");
-    // delete the shaders as they're linked into our program now and no longer necessary
-    glDeleteShader(vertex);
-    glDeleteShader(fragment);
-
+      TraceScope cacheTrace("shader", "cache", vertexPath);
+      cached = ProgramCache::load(ID, cacheKey);
+    }
+    if (cached)
+    {
+      ShaderQueue::ready(ID, true);
+      return;
+    }
+    // 3. otherwise compile and link it, waiting for the result unless queued
+    ShaderQueue::submit(ID, vertexCode, fragmentCode, vertexFiles, fragmentFiles, cacheKey, vertexPath);
+    if (!queued)
+    {
+      ShaderQueue::finish(ID);
+    }
+  }
+  // whether the program has linked and can be drawn with
+  // ------------------------------------------------------------------------
+  bool ready() const
+  {
+    return ShaderQueue::isReady(ID);
   }
   // activate the shader
   // ------------------------------------------------------------------------
   void use() const
   { 
-    glUseProgram(ID); 
+    GLState::useProgram(ID); 
   }
-  // utility uniform functions
+  // uniform lookup; names are hashed (at compile time with UNIFORM) and
+  // resolved through the program's reflection table
   // ------------------------------------------------------------------------
-  void setBool(const std::string &name, bool value) const
+  int uniformLocation(const char* name) const
+  {
+    return uniformTable(ID).location(uniformHash(name), name);
+  }
+  int uniformLocation(const std::string &name) const
+  {
+    return uniformLocation(name.c_str());
+  }
+  int uniformLocation(UniformName name) const
+  {
+    return uniformTable(ID).location(name.hash, name.name);
+  }
+  int uniformLocation(UniformHandle handle) const
+  {
+    return handle.location;
+  }
+  // resolve a name once so later sets skip the lookup entirely
+  // ------------------------------------------------------------------------
+  template <typename Name>
+  UniformHandle handle(const Name &name) const
+  {
+    return UniformHandle{ uniformLocation(name) };
+  }
+  // utility uniform functions; Name is a std::string, a C string, a
+  // UNIFORM("...") name or a UniformHandle
+  // ------------------------------------------------------------------------
+  template <typename Name>
+  void setBool(const Name &name, bool value) const
   {         
-    glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value); 
+    glUniform1i(uniformLocation(name), (int)value); 
   }
   // ------------------------------------------------------------------------
-  void setInt(const std::string &name, int value) const
+  template <typename Name>
+  void setInt(const Name &name, int value) const
   { 
-    glUniform1i(glGetUniformLocation(ID, name.c_str()), value); 
+    glUniform1i(uniformLocation(name), value); 
   }
   // ------------------------------------------------------------------------
-  void setFloat(const std::string &name, float value) const
+  template <typename Name>
+  void setFloat(const Name &name, float value) const
   { 
-    glUniform1f(glGetUniformLocation(ID, name.c_str()), value); 
+    glUniform1f(uniformLocation(name), value); 
   }
   // ------------------------------------------------------------------------
-  void setVec2(const std::string &name, const glm::vec2 &value) const
+  template <typename Name>
+  void setVec2(const Name &name, const glm::vec2 &value) const
   { 
-    glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+    glUniform2fv(uniformLocation(name), 1, &value[0]); 
   }
-  void setVec2(const std::string &name, float x, float y) const
+  template <typename Name>
+  void setVec2(const Name &name, float x, float y) const
   { 
-    glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y); 
+    glUniform2f(uniformLocation(name), x, y); 
   }
   // ------------------------------------------------------------------------
-  void setVec3(const std::string &name, const glm::vec3 &value) const
+  template <typename Name>
+  void setVec3(const Name &name, const glm::vec3 &value) const
   { 
-    glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+    glUniform3fv(uniformLocation(name), 1, &value[0]); 
   }
-  void setVec3(const std::string &name, float x, float y, float z) const
+  template <typename Name>
+  void setVec3(const Name &name, float x, float y, float z) const
   { 
-    glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z); 
+    glUniform3f(uniformLocation(name), x, y, z); 
   }
   // ------------------------------------------------------------------------
-  void setVec4(const std::string &name, const glm::vec4 &value) const
+  template <typename Name>
+  void setVec4(const Name &name, const glm::vec4 &value) const
   { 
-    glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+    glUniform4fv(uniformLocation(name), 1, &value[0]); 
   }
-  void setVec4(const std::string &name, float x, float y, float z, float w) const
+  template <typename Name>
+  void setVec4(const Name &name, float x, float y, float z, float w) const
   { 
-    glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w); 
+    glUniform4f(uniformLocation(name), x, y, z, w); 
   }
   // ------------------------------------------------------------------------
-  void setMat2(const std::string &name, const glm::mat2 &mat) const
+  template <typename Name>
+  void setMat2(const Name &name, const glm::mat2 &mat) const
   {
-    glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+    glUniformMatrix2fv(uniformLocation(name), 1, GL_FALSE, &mat[0][0]);
   }
   // ------------------------------------------------------------------------
-  void setMat3(const std::string &name, const glm::mat3 &mat) const
+  template <typename Name>
+  void setMat3(const Name &name, const glm::mat3 &mat) const
   {
-    glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+    glUniformMatrix3fv(uniformLocation(name), 1, GL_FALSE, &mat[0][0]);
   }
   // ------------------------------------------------------------------------
-  void setMat4(const std::string &name, const glm::mat4 &mat) const
-  {
-    glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
-  }
-
-private:
-  // utility function for checking shader compilation/linking errors.
-  // ------------------------------------------------------------------------
-  static void checkCompileErrors(GLuint shader, std::string type)
-  {
-    GLint success;
-    GLchar infoLog[1024];
-    if (type != "PROGRAM")
-    {
-      glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
-      if (!success)
-      {
-        glGetShaderInfoLog(shader, 1024, NULL, infoLog);
-        std::cout << "ERROR::SHADER_COMPILATION_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
-      }
-    }
-    else
+  template <typename Name>
+  void setMat4(const Name &name, const glm::mat4 &mat) const
   {
-      glGetProgramiv(shader, GL_LINK_STATUS, &success);
-      if (!success)
-      {
-        glGetProgramInfoLog(shader, 1024, NULL, infoLog);
-        std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
-      }
-    }
+    glUniformMatrix4fv(uniformLocation(name), 1, GL_FALSE, &mat[0][0]);
   }
-
 };
 #endif
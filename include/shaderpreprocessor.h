@@ -0,0 +1,152 @@
+/*
+ * include/shaderpreprocessor.h
+ *
+ * GLSL has no #include and GL takes defines only as source text, so Shader
+ * runs every stage through this first. #include "path" is replaced by that
+ * file (relative to the including one, read through AssetFile so packs work)
+ * and each file is pulled in at most once per stage. Defines are inserted
+ * right after #version. #line directives number every file as its own source
+ * string, so a compile error "2(14)" means line 14 of the file listed as
+ * source 2.
+ */
+
+#ifndef SHADERPREPROCESSOR_H
+#define SHADERPREPROCESSOR_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <archive.h>
+
+/* Included files nested deeper than this are assumed to be a cycle */
+#define SHADER_MAX_INCLUDE_DEPTH 16
+
+struct ShaderDefine {
+  std::string name;
+  std::string value; /* May be empty for a plain #define NAME */
+};
+
+typedef std::vector<ShaderDefine> ShaderDefines;
+
+class ShaderPreprocessor {
+private:
+  static std::string directoryOf(const std::string& path) {
+    size_t slash = path.find_last_of('/');
+    return slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+  }
+
+  /* The quoted path of an #include line, or empty if line is not one */
+  static std::string includePath(const std::string& line) {
+    size_t start = line.find_first_not_of(" \t");
+    if (start == std::string::npos || line.compare(start, 8, "#include") != 0) {
+      return std::string();
+    }
+    size_t open = line.find('"', start + 8);
+    size_t close = open == std::string::npos ? open : line.find('"', open + 1);
+    if (close == std::string::npos) {
+      return std::string();
+    }
+    return line.substr(open + 1, close - open - 1);
+  }
+
+  static bool isVersion(const std::string& line) {
+    size_t start = line.find_first_not_of(" \t");
+    return start != std::string::npos && line.compare(start, 8, "#version") == 0;
+  }
+
+  static bool expand(const std::string& path, const ShaderDefines& defines, int depth, std::string& out, std::vector<std::string>& files) {
+    if (depth > SHADER_MAX_INCLUDE_DEPTH) {
+      std::cout << "ERROR::SHADER::INCLUDE_TOO_DEEP: " << path << std::endl;
+      return false;
+    }
+
+    std::string normalized = AssetArchive::normalize(path);
+    for (const std::string& file : files) {
+      if (file == normalized) {
+        /* Already part of this stage */
+        return true;
+      }
+    }
+
+    AssetFile file;
+    if (!file.open(path)) {
+      std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << path << std::endl;
+      return false;
+    }
+    size_t source = files.size();
+    files.push_back(normalized);
+
+    std::string text((const char*)file.data, file.size);
+    size_t position = 0;
+    int lineNumber = 0;
+    bool versionSeen = false;
+    if (depth > 0) {
+      out += "#line 1 " + std::to_string(source) + "\n";
+    }
+
+    while (position < text.size()) {
+      size_t end = text.find('\n', position);
+      if (end == std::string::npos) {
+        end = text.size();
+      }
+      std::string line = text.substr(position, end - position);
+      position = end + 1;
+      lineNumber++;
+
+      std::string included = includePath(line);
+      if (!included.empty()) {
+        if (!expand(directoryOf(path) + included, defines, depth + 1, out, files)) {
+          std::cout << "  included from " << path << ":" << lineNumber << std::endl;
+          return false;
+        }
+        /* Back in this file, on the line after the #include */
+        out += "#line " + std::to_string(lineNumber + 1) + " " + std::to_string(source) + "\n";
+        continue;
+      }
+
+      out += line;
+      out += '\n';
+
+      if (depth == 0 && !versionSeen && isVersion(line)) {
+        versionSeen = true;
+        for (const ShaderDefine& define : defines) {
+          out += "#define " + define.name + (define.value.empty() ? "" : " " + define.value) + "\n";
+        }
+        out += "#line " + std::to_string(lineNumber + 1) + " " + std::to_string(source) + "\n";
+      }
+    }
+
+    /* Without #version the defines simply go first */
+    if (depth == 0 && !versionSeen && !defines.empty()) {
+      std::string header;
+      for (const ShaderDefine& define : defines) {
+        header += "#define " + define.name + (define.value.empty() ? "" : " " + define.value) + "\n";
+      }
+      out = header + "#line 1 0\n" + out;
+    }
+    return true;
+  }
+
+public:
+  /*
+   * Expand the stage at path into out. files receives every file used, in
+   * source string order. Returns false if any of them could not be read.
+   */
+  static bool process(const std::string& path, const ShaderDefines& defines, std::string& out, std::vector<std::string>& files) {
+    out.clear();
+    files.clear();
+    return expand(path, defines, 0, out, files);
+  }
+
+  /* The defines as one string, e.g. for a cache key */
+  static std::string describe(const ShaderDefines& defines) {
+    std::string text;
+    for (const ShaderDefine& define : defines) {
+      text += define.name + "=" + define.value + ";";
+    }
+    return text;
+  }
+};
+
+#endif
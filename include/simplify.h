@@ -0,0 +1,335 @@
+/*
+ * include/simplify.h
+ *
+ * Mesh simplification by quadric error edge collapse (Garland and Heckbert
+ * 1997), used to build the LOD chain of imported meshes. Vertices are only
+ * ever collapsed onto neighbouring vertices, so every level indexes the same
+ * vertex buffer. Vertices on open borders and on UV or normal seams (a
+ * position shared by several vertices) never move, which keeps textures and
+ * shading continuous. Nothing in here touches OpenGL.
+ */
+
+#ifndef SIMPLIFY_H
+#define SIMPLIFY_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <lod.h>
+#include <meshopt.h>
+
+/* Each level aims for this fraction of the previous level's triangles */
+#define MESH_LOD_REDUCTION 0.5f
+/* Levels are not generated past this error, as a fraction of the mesh's size */
+#define MESH_LOD_MAX_ERROR 0.05f
+
+class MeshSimplifier {
+private:
+  /* Sum of squared distances to a set of planes, as the symmetric matrix terms */
+  struct Quadric {
+    double a2 = 0, b2 = 0, c2 = 0, d2 = 0, ab = 0, ac = 0, ad = 0, bc = 0, bd = 0, cd = 0;
+
+    void addPlane(glm::dvec3 n, double d) {
+      a2 += n.x * n.x; b2 += n.y * n.y; c2 += n.z * n.z; d2 += d * d;
+      ab += n.x * n.y; ac += n.x * n.z; ad += n.x * d;
+      bc += n.y * n.z; bd += n.y * d; cd += n.z * d;
+    }
+
+    void add(const Quadric& other) {
+      a2 += other.a2; b2 += other.b2; c2 += other.c2; d2 += other.d2;
+      ab += other.ab; ac += other.ac; ad += other.ad;
+      bc += other.bc; bd += other.bd; cd += other.cd;
+    }
+
+    double evaluate(glm::dvec3 p) const {
+      double error = a2 * p.x * p.x + b2 * p.y * p.y + c2 * p.z * p.z + d2
+        + 2.0 * (ab * p.x * p.y + ac * p.x * p.z + bc * p.y * p.z + ad * p.x + bd * p.y + cd * p.z);
+      return error > 0.0 ? error : 0.0;
+    }
+  };
+
+  struct Collapse {
+    double cost;
+    uint32_t from, to;
+  };
+
+  static uint64_t edgeKey(uint32_t a, uint32_t b) {
+    return (uint64_t)a << 32 | b;
+  }
+
+  /* Whether moving from onto to keeps every other triangle around from facing the same way */
+  static bool keepsOrientation(const std::vector<unsigned int>& indices, const std::vector<uint32_t>& triangles, uint32_t from, uint32_t to, const std::vector<glm::dvec3>& positions) {
+    for (uint32_t triangle : triangles) {
+      const unsigned int* corner = &indices[triangle * 3];
+      if (corner[0] == to || corner[1] == to || corner[2] == to) {
+        continue; /* Becomes degenerate and is dropped */
+      }
+
+      glm::dvec3 before[3], after[3];
+      for (int c = 0; c < 3; ++c) {
+        before[c] = after[c] = positions[corner[c]];
+        if (corner[c] == from) {
+          after[c] = positions[to];
+        }
+      }
+
+      glm::dvec3 normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+      glm::dvec3 normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+      if (glm::dot(normalBefore, normalAfter) <= 0.0) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+public:
+  /*
+   * Simplify indices (triangles over vertexCount vertices, positions first in
+   * each stride floats) down to about targetIndexCount indices without
+   * exceeding targetError, a fraction of the mesh's size. The largest error
+   * introduced, in object space units, is written to resultError.
+   */
+  static std::vector<unsigned int> simplify(const float* vertices, size_t vertexCount, size_t stride, const std::vector<unsigned int>& indices, size_t targetIndexCount, float targetError, float& resultError) {
+    std::vector<unsigned int> result(indices);
+    resultError = 0.0f;
+    if (vertexCount == 0 || indices.size() <= targetIndexCount || indices.size() % 3 != 0) {
+      return result;
+    }
+
+    /* Positions scaled to a unit box so errors and the flip test are independent of the mesh's size */
+    glm::dvec3 minimum(vertices[0], vertices[1], vertices[2]), maximum = minimum;
+    for (size_t v = 1; v < vertexCount; ++v) {
+      glm::dvec3 p(vertices[v * stride], vertices[v * stride + 1], vertices[v * stride + 2]);
+      minimum = glm::min(minimum, p);
+      maximum = glm::max(maximum, p);
+    }
+    glm::dvec3 extent = maximum - minimum;
+    double scale = std::max(extent.x, std::max(extent.y, extent.z));
+    if (scale <= 0.0) {
+      return result;
+    }
+
+    std::vector<glm::dvec3> positions(vertexCount);
+    for (size_t v = 0; v < vertexCount; ++v) {
+      positions[v] = (glm::dvec3(vertices[v * stride], vertices[v * stride + 1], vertices[v * stride + 2]) - minimum) / scale;
+    }
+
+    /* Vertices sharing a position are seams; the first of them stands in for the position */
+    std::vector<uint32_t> positionIds(vertexCount);
+    std::vector<uint8_t> locked(vertexCount, 0);
+    {
+      std::unordered_map<uint64_t, uint32_t> firstAt;
+      std::vector<uint32_t> wedges(vertexCount, 0);
+      for (size_t v = 0; v < vertexCount; ++v) {
+        uint32_t bits[3];
+        memcpy(bits, &vertices[v * stride], 12);
+        uint64_t hash = ((uint64_t)bits[0] * 73856093u) ^ ((uint64_t)bits[1] * 19349663u << 16) ^ ((uint64_t)bits[2] * 83492791u << 32);
+        /* Collisions are resolved by walking to the next slot, comparing the real positions */
+        for (;;) {
+          auto found = firstAt.find(hash);
+          if (found == firstAt.end()) {
+            firstAt.emplace(hash, v);
+            positionIds[v] = v;
+            break;
+          }
+          if (memcmp(&vertices[found->second * stride], &vertices[v * stride], 12) == 0) {
+            positionIds[v] = found->second;
+            break;
+          }
+          hash++;
+        }
+        wedges[positionIds[v]]++;
+      }
+      for (size_t v = 0; v < vertexCount; ++v) {
+        locked[v] = wedges[positionIds[v]] > 1;
+      }
+    }
+
+    /* Open borders: an edge whose reverse is not used by any triangle */
+    {
+      std::unordered_set<uint64_t> edges;
+      for (size_t i = 0; i < result.size(); i += 3) {
+        for (int e = 0; e < 3; ++e) {
+          edges.insert(edgeKey(positionIds[result[i + e]], positionIds[result[i + (e + 1) % 3]]));
+        }
+      }
+      std::vector<uint8_t> borderPosition(vertexCount, 0);
+      for (uint64_t edge : edges) {
+        uint32_t a = edge >> 32, b = (uint32_t)edge;
+        if (edges.find(edgeKey(b, a)) == edges.end()) {
+          borderPosition[a] = borderPosition[b] = 1;
+        }
+      }
+      for (size_t v = 0; v < vertexCount; ++v) {
+        locked[v] |= borderPosition[positionIds[v]];
+      }
+    }
+
+    std::vector<Quadric> quadrics(vertexCount);
+    for (size_t i = 0; i < result.size(); i += 3) {
+      glm::dvec3 a = positions[result[i]], b = positions[result[i + 1]], c = positions[result[i + 2]];
+      glm::dvec3 normal = glm::cross(b - a, c - a);
+      double length = glm::length(normal);
+      if (length <= 0.0) {
+        continue;
+      }
+      normal /= length;
+      Quadric plane;
+      plane.addPlane(normal, -glm::dot(normal, a));
+      for (int c = 0; c < 3; ++c) {
+        quadrics[result[i + c]].add(plane);
+      }
+    }
+
+    double maxCost = (double)targetError * targetError;
+    double worstCost = 0.0;
+    std::vector<uint32_t> collapseTo(vertexCount);
+    std::vector<uint8_t> touched(vertexCount);
+    std::vector<uint32_t> offsets(vertexCount + 1), triangles;
+    std::vector<Collapse> collapses;
+
+    while (result.size() > targetIndexCount) {
+      /* Triangles around each vertex */
+      std::fill(offsets.begin(), offsets.end(), 0);
+      for (unsigned int index : result) {
+        offsets[index + 1]++;
+      }
+      for (size_t v = 0; v < vertexCount; ++v) {
+        offsets[v + 1] += offsets[v];
+      }
+      triangles.resize(result.size());
+      std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+      for (size_t i = 0; i < result.size(); ++i) {
+        triangles[fill[result[i]]++] = i / 3;
+      }
+
+      /* Cheapest edge out of every free vertex */
+      collapses.clear();
+      for (size_t v = 0; v < vertexCount; ++v) {
+        if (locked[v] || offsets[v] == offsets[v + 1]) {
+          continue;
+        }
+        Collapse best = { 0.0, UINT32_MAX, UINT32_MAX };
+        for (uint32_t t = offsets[v]; t < offsets[v + 1]; ++t) {
+          for (int c = 0; c < 3; ++c) {
+            uint32_t other = result[triangles[t] * 3 + c];
+            if (other == v) {
+              continue;
+            }
+            double cost = quadrics[v].evaluate(positions[other]);
+            if (best.from == UINT32_MAX || cost < best.cost) {
+              best = { cost, (uint32_t)v, other };
+            }
+          }
+        }
+        if (best.from != UINT32_MAX && best.cost <= maxCost) {
+          collapses.push_back(best);
+        }
+      }
+      if (collapses.empty()) {
+        break;
+      }
+      std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.cost < b.cost; });
+
+      /* Each collapse removes about two triangles; a vertex and its neighbours change at most once per pass */
+      size_t wanted = (result.size() - targetIndexCount) / 6 + 1;
+      size_t done = 0;
+      for (size_t v = 0; v < vertexCount; ++v) {
+        collapseTo[v] = v;
+      }
+      std::fill(touched.begin(), touched.end(), 0);
+
+      for (const Collapse& collapse : collapses) {
+        if (done == wanted) {
+          break;
+        }
+        if (touched[collapse.from] || touched[collapse.to]) {
+          continue;
+        }
+        std::vector<uint32_t> around(triangles.begin() + offsets[collapse.from], triangles.begin() + offsets[collapse.from + 1]);
+        if (!keepsOrientation(result, around, collapse.from, collapse.to, positions)) {
+          continue;
+        }
+
+        collapseTo[collapse.from] = collapse.to;
+        quadrics[collapse.to].add(quadrics[collapse.from]);
+        worstCost = std::max(worstCost, collapse.cost);
+        for (uint32_t triangle : around) {
+          for (int c = 0; c < 3; ++c) {
+            touched[result[triangle * 3 + c]] = 1;
+          }
+        }
+        done++;
+      }
+      if (done == 0) {
+        break;
+      }
+
+      /* Apply, dropping triangles that lost an edge */
+      size_t write = 0;
+      for (size_t i = 0; i < result.size(); i += 3) {
+        unsigned int a = collapseTo[result[i]], b = collapseTo[result[i + 1]], c = collapseTo[result[i + 2]];
+        if (a != b && b != c && a != c) {
+          result[write++] = a;
+          result[write++] = b;
+          result[write++] = c;
+        }
+      }
+      result.resize(write);
+    }
+
+    resultError = (float)(std::sqrt(worstCost) * scale);
+    return result;
+  }
+
+  /*
+   * Append a LOD chain to indices, which holds the full resolution triangles
+   * on entry. Each level halves the triangle count of the one before, until
+   * the error limit stops progress, and is reordered for the vertex cache.
+   */
+  static std::vector<MeshLod> buildLods(const float* vertices, size_t vertexCount, size_t stride, std::vector<unsigned int>& indices) {
+    std::vector<MeshLod> lods;
+    lods.push_back({ 0, (uint32_t)indices.size(), 0.0f });
+    if (indices.size() % 3 != 0) {
+      std::cout << "ERROR::MESH_SIMPLIFIER::NOT_TRIANGLES: " << indices.size() << " indices" << std::endl;
+      return lods;
+    }
+
+    std::vector<unsigned int> full(indices);
+    std::vector<uint32_t> clusters;
+    float previousError = 0.0f;
+    size_t target = full.size();
+
+    for (int level = 1; level < MESH_MAX_LODS; ++level) {
+      target = (size_t)(target / 3 * MESH_LOD_REDUCTION) * 3;
+      if (target < 3) {
+        break;
+      }
+
+      /* Always from the full mesh, so errors are measured against it */
+      float error;
+      std::vector<unsigned int> simplified = simplify(vertices, vertexCount, stride, full, target, MESH_LOD_MAX_ERROR, error);
+      /* Not worth a level if it barely saves anything */
+      if (simplified.empty() || simplified.size() > lods.back().indexCount * 3 / 4) {
+        break;
+      }
+
+      MeshOptimizer::optimizeVertexCache(simplified, vertexCount, clusters);
+      previousError = std::max(previousError, error);
+      lods.push_back({ (uint32_t)indices.size(), (uint32_t)simplified.size(), previousError });
+      indices.insert(indices.end(), simplified.begin(), simplified.end());
+    }
+
+    return lods;
+  }
+};
+
+#endif
@@ -0,0 +1,384 @@
+/*
+ * include/texcompress.h
+ *
+ * Offline block compression for tools/texcompress.cpp: BC1, BC3, BC4, BC5 and
+ * BC7 (mode 6) encoders and a DDS writer; mip chains come from mipgen.h.
+ * Blocks are encoded in parallel on the job system. Nothing in here touches
+ * OpenGL.
+ */
+
+#ifndef TEXCOMPRESS_H
+#define TEXCOMPRESS_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <jobs.h>
+#include <mipgen.h>
+#include <texturefile.h>
+
+enum TextureCompression {
+  TEXTURE_BC1, /* RGB, 4 bits per pixel */
+  TEXTURE_BC3, /* RGBA, 8 bits per pixel */
+  TEXTURE_BC4, /* R, 4 bits per pixel */
+  TEXTURE_BC5, /* RG, 8 bits per pixel; normal maps */
+  TEXTURE_BC7, /* RGBA, 8 bits per pixel, best quality */
+  TEXTURE_RGBA8 /* Uncompressed, for images that must not lose anything */
+};
+
+/* Writes values of up to 32 bits least significant bit first, as BC7 lays them out */
+struct BlockBitWriter {
+  uint8_t* out;
+  unsigned int bit = 0;
+
+  void write(uint32_t value, unsigned int bits) {
+    for (unsigned int i = 0; i < bits; ++i, ++bit) {
+      if (value & (1u << i)) {
+        out[bit >> 3] |= 1u << (bit & 7);
+      }
+    }
+  }
+};
+
+class BlockEncoder {
+private:
+  /*
+   * Principal axis of the block's colours (the first `channels` of each
+   * texel), by power iteration on their covariance. Returns the two texels
+   * with the lowest and highest projection onto it.
+   */
+  static void principalExtremes(const uint8_t block[64], int channels, float low[4], float high[4]) {
+    float mean[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    for (int i = 0; i < 16; ++i) {
+      for (int c = 0; c < channels; ++c) {
+        mean[c] += block[i * 4 + c];
+      }
+    }
+    for (int c = 0; c < channels; ++c) {
+      mean[c] /= 16.0f;
+    }
+
+    float covariance[4][4] = { { 0.0f } };
+    for (int i = 0; i < 16; ++i) {
+      for (int a = 0; a < channels; ++a) {
+        for (int b = 0; b < channels; ++b) {
+          covariance[a][b] += (block[i * 4 + a] - mean[a]) * (block[i * 4 + b] - mean[b]);
+        }
+      }
+    }
+
+    float axis[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+    for (int iteration = 0; iteration < 8; ++iteration) {
+      float next[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+      float length = 0.0f;
+      for (int a = 0; a < channels; ++a) {
+        for (int b = 0; b < channels; ++b) {
+          next[a] += covariance[a][b] * axis[b];
+        }
+        length = std::max(length, std::fabs(next[a]));
+      }
+      if (length == 0.0f) {
+        break;
+      }
+      for (int a = 0; a < channels; ++a) {
+        axis[a] = next[a] / length;
+      }
+    }
+
+    float minimum = INFINITY, maximum = -INFINITY;
+    int minimumIndex = 0, maximumIndex = 0;
+    for (int i = 0; i < 16; ++i) {
+      float projection = 0.0f;
+      for (int c = 0; c < channels; ++c) {
+        projection += (block[i * 4 + c] - mean[c]) * axis[c];
+      }
+      if (projection < minimum) {
+        minimum = projection;
+        minimumIndex = i;
+      }
+      if (projection > maximum) {
+        maximum = projection;
+        maximumIndex = i;
+      }
+    }
+
+    for (int c = 0; c < 4; ++c) {
+      low[c] = block[minimumIndex * 4 + c];
+      high[c] = block[maximumIndex * 4 + c];
+    }
+  }
+
+  static uint16_t packRGB565(const float color[4]) {
+    int r = std::clamp((int)std::lround(color[0] * 31.0f / 255.0f), 0, 31);
+    int g = std::clamp((int)std::lround(color[1] * 63.0f / 255.0f), 0, 63);
+    int b = std::clamp((int)std::lround(color[2] * 31.0f / 255.0f), 0, 31);
+    return (uint16_t)((r << 11) | (g << 5) | b);
+  }
+
+  static void unpackRGB565(uint16_t packed, int color[3]) {
+    int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+    color[0] = (r << 3) | (r >> 2);
+    color[1] = (g << 2) | (g >> 4);
+    color[2] = (b << 3) | (b >> 2);
+  }
+
+public:
+  /* Colour half of BC1/BC3 from RGBA texels, always in four colour mode */
+  static void encodeBC1(const uint8_t block[64], uint8_t out[8]) {
+    float low[4], high[4];
+    principalExtremes(block, 3, low, high);
+
+    uint16_t color0 = packRGB565(high);
+    uint16_t color1 = packRGB565(low);
+    if (color0 < color1) {
+      std::swap(color0, color1);
+    }
+
+    uint32_t indices = 0;
+    if (color0 != color1) {
+      int palette[4][3];
+      unpackRGB565(color0, palette[0]);
+      unpackRGB565(color1, palette[1]);
+      for (int c = 0; c < 3; ++c) {
+        palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+        palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+      }
+
+      for (int i = 0; i < 16; ++i) {
+        int best = 0, bestError = INT32_MAX;
+        for (int p = 0; p < 4; ++p) {
+          int error = 0;
+          for (int c = 0; c < 3; ++c) {
+            int difference = block[i * 4 + c] - palette[p][c];
+            error += difference * difference;
+          }
+          if (error < bestError) {
+            bestError = error;
+            best = p;
+          }
+        }
+        indices |= (uint32_t)best << (i * 2);
+      }
+    }
+
+    out[0] = color0 & 0xFF;
+    out[1] = color0 >> 8;
+    out[2] = color1 & 0xFF;
+    out[3] = color1 >> 8;
+    memcpy(out + 4, &indices, 4);
+  }
+
+  /* One channel of the texels (0 = red, 3 = alpha) as a BC4 block, in eight value mode */
+  static void encodeBC4(const uint8_t block[64], int channel, uint8_t out[8]) {
+    int minimum = 255, maximum = 0;
+    for (int i = 0; i < 16; ++i) {
+      minimum = std::min<int>(minimum, block[i * 4 + channel]);
+      maximum = std::max<int>(maximum, block[i * 4 + channel]);
+    }
+
+    memset(out, 0, 8);
+    out[0] = maximum;
+    out[1] = minimum;
+    if (maximum == minimum) {
+      return;
+    }
+
+    /* Codes 0 and 1 are the endpoints, 2 to 7 step from red0 towards red1 */
+    int palette[8] = { maximum, minimum };
+    for (int i = 1; i < 7; ++i) {
+      palette[i + 1] = ((7 - i) * maximum + i * minimum) / 7;
+    }
+
+    uint64_t indices = 0;
+    for (int i = 0; i < 16; ++i) {
+      int value = block[i * 4 + channel];
+      int best = 0, bestError = INT32_MAX;
+      for (int p = 0; p < 8; ++p) {
+        int error = std::abs(value - palette[p]);
+        if (error < bestError) {
+          bestError = error;
+          best = p;
+        }
+      }
+      indices |= (uint64_t)best << (i * 3);
+    }
+    for (int i = 0; i < 6; ++i) {
+      out[2 + i] = (indices >> (i * 8)) & 0xFF;
+    }
+  }
+
+  /* BC7 mode 6: one subset, RGBA endpoints of 7 bits plus a shared low bit each, 4 bit indices */
+  static void encodeBC7(const uint8_t block[64], uint8_t out[16]) {
+    static const int weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+    float low[4], high[4];
+    principalExtremes(block, 4, low, high);
+
+    /* Quantize each endpoint to 7 bits per channel with the p bit that fits it best */
+    int endpoints[2][4];
+    int pbits[2];
+    const float* targets[2] = { low, high };
+    for (int e = 0; e < 2; ++e) {
+      int bestError = INT32_MAX;
+      for (int p = 0; p < 2; ++p) {
+        int candidate[4];
+        int error = 0;
+        for (int c = 0; c < 4; ++c) {
+          candidate[c] = std::clamp((int)std::lround((targets[e][c] - p) / 2.0f), 0, 127);
+          int difference = ((candidate[c] << 1) | p) - (int)targets[e][c];
+          error += difference * difference;
+        }
+        if (error < bestError) {
+          bestError = error;
+          pbits[e] = p;
+          memcpy(endpoints[e], candidate, sizeof(candidate));
+        }
+      }
+    }
+
+    int palette[16][4];
+    for (int c = 0; c < 4; ++c) {
+      int e0 = (endpoints[0][c] << 1) | pbits[0];
+      int e1 = (endpoints[1][c] << 1) | pbits[1];
+      for (int i = 0; i < 16; ++i) {
+        palette[i][c] = ((64 - weights[i]) * e0 + weights[i] * e1 + 32) >> 6;
+      }
+    }
+
+    int indices[16];
+    for (int i = 0; i < 16; ++i) {
+      int best = 0, bestError = INT32_MAX;
+      for (int p = 0; p < 16; ++p) {
+        int error = 0;
+        for (int c = 0; c < 4; ++c) {
+          int difference = block[i * 4 + c] - palette[p][c];
+          error += difference * difference;
+        }
+        if (error < bestError) {
+          bestError = error;
+          best = p;
+        }
+      }
+      indices[i] = best;
+    }
+
+    /* The first texel's index is stored without its top bit, so it must be below 8 */
+    if (indices[0] & 8) {
+      std::swap(endpoints[0], endpoints[1]);
+      std::swap(pbits[0], pbits[1]);
+      for (int i = 0; i < 16; ++i) {
+        indices[i] = 15 - indices[i];
+      }
+    }
+
+    memset(out, 0, 16);
+    BlockBitWriter writer{ out };
+    writer.write(1u << 6, 7);
+    for (int c = 0; c < 4; ++c) {
+      writer.write(endpoints[0][c], 7);
+      writer.write(endpoints[1][c], 7);
+    }
+    writer.write(pbits[0], 1);
+    writer.write(pbits[1], 1);
+    writer.write(indices[0], 3);
+    for (int i = 1; i < 16; ++i) {
+      writer.write(indices[i], 4);
+    }
+  }
+
+  static unsigned int blockBytes(enum TextureCompression compression) {
+    return compression == TEXTURE_BC1 || compression == TEXTURE_BC4 ? 8 : 16;
+  }
+
+  static void encode(const uint8_t block[64], enum TextureCompression compression, uint8_t* out) {
+    switch (compression) {
+      case TEXTURE_BC1: encodeBC1(block, out); break;
+      case TEXTURE_BC3: encodeBC4(block, 3, out); encodeBC1(block, out + 8); break;
+      case TEXTURE_BC4: encodeBC4(block, 0, out); break;
+      case TEXTURE_BC5: encodeBC4(block, 0, out); encodeBC4(block, 1, out + 8); break;
+      case TEXTURE_BC7: encodeBC7(block, out); break;
+      case TEXTURE_RGBA8: break;
+    }
+  }
+
+  /* Compress an RGBA8 image; edge blocks repeat the last row and column */
+  static std::vector<uint8_t> compress(const uint8_t* rgba, uint32_t width, uint32_t height, enum TextureCompression compression) {
+    if (compression == TEXTURE_RGBA8) {
+      return std::vector<uint8_t>(rgba, rgba + (size_t)width * height * 4);
+    }
+
+    uint32_t blocksWide = (width + 3) / 4;
+    uint32_t blocksHigh = (height + 3) / 4;
+    unsigned int bytes = blockBytes(compression);
+    std::vector<uint8_t> out((size_t)blocksWide * blocksHigh * bytes);
+
+    JobSystem::parallelFor(blocksHigh, [&](size_t blockY) {
+      uint8_t block[64];
+      for (uint32_t blockX = 0; blockX < blocksWide; ++blockX) {
+        for (int y = 0; y < 4; ++y) {
+          uint32_t sourceY = std::min<uint32_t>(blockY * 4 + y, height - 1);
+          for (int x = 0; x < 4; ++x) {
+            uint32_t sourceX = std::min<uint32_t>(blockX * 4 + x, width - 1);
+            memcpy(block + (y * 4 + x) * 4, rgba + ((size_t)sourceY * width + sourceX) * 4, 4);
+          }
+        }
+        encode(block, compression, &out[(blockY * blocksWide + blockX) * bytes]);
+      }
+    });
+
+    return out;
+  }
+};
+
+uint32_t ddsFormat(enum TextureCompression compression, bool srgb) {
+  switch (compression) {
+    case TEXTURE_BC1: return srgb ? DDS_FORMAT_BC1_UNORM_SRGB : DDS_FORMAT_BC1_UNORM;
+    case TEXTURE_BC3: return srgb ? DDS_FORMAT_BC3_UNORM_SRGB : DDS_FORMAT_BC3_UNORM;
+    case TEXTURE_BC4: return DDS_FORMAT_BC4_UNORM;
+    case TEXTURE_BC5: return DDS_FORMAT_BC5_UNORM;
+    case TEXTURE_BC7: return srgb ? DDS_FORMAT_BC7_UNORM_SRGB : DDS_FORMAT_BC7_UNORM;
+    case TEXTURE_RGBA8: return srgb ? DDS_FORMAT_RGBA8_UNORM_SRGB : DDS_FORMAT_RGBA8_UNORM;
+  }
+  return 0;
+}
+
+/* Write levels (largest first, already in dxgiFormat) as a DDS with the DX10 header */
+bool writeDDS(const std::string& path, uint32_t dxgiFormat, uint32_t width, uint32_t height, const std::vector<std::vector<uint8_t>>& levels) {
+  DDSHeader header;
+  memset(&header, 0, sizeof(header));
+  header.size = sizeof(DDSHeader);
+  header.flags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT | DDSD_LINEARSIZE;
+  header.height = height;
+  header.width = width;
+  header.pitchOrLinearSize = levels[0].size();
+  header.mipMapCount = levels.size();
+  header.pixelFormat.size = sizeof(DDSPixelFormat);
+  header.pixelFormat.flags = DDPF_FOURCC;
+  header.pixelFormat.fourCC = DDS_FOURCC('D', 'X', '1', '0');
+  header.caps = DDSCAPS_TEXTURE | (levels.size() > 1 ? DDSCAPS_COMPLEX | DDSCAPS_MIPMAP : 0);
+
+  DDSHeaderDX10 extended;
+  memset(&extended, 0, sizeof(extended));
+  extended.dxgiFormat = dxgiFormat;
+  extended.resourceDimension = DDS_DIMENSION_TEXTURE2D;
+  extended.arraySize = 1;
+
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  if (!file) {
+    return false;
+  }
+  file.write(DDS_MAGIC, 4);
+  file.write((const char*)&header, sizeof(header));
+  file.write((const char*)&extended, sizeof(extended));
+  for (const std::vector<uint8_t>& level : levels) {
+    file.write((const char*)level.data(), level.size());
+  }
+  return (bool)file;
+}
+
+#endif
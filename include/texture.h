@@ -2,18 +2,32 @@
 #define TEXTURE_H
 #define STB_IMAGE_IMPLEMENTATION
 
+#include <glad/glad.h>
 #include <GLFW/glfw3.h>
 
-#include <assimp/Importer.hpp>
-#include <assimp/scene.h>
-#include <assimp/postprocess.h>
-
 #include <stb_image/stb_image.h>
 
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <filesystem>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
+#include <archive.h>
 #include <globals.h>
+#include <glstate.h>
 #include <error.h>
+#include <jobs.h>
+#include <texturefile.h>
+#include <trace.h>
 
 /*
  * TextureType describes what the texture is used for. This is important for
@@ -28,44 +42,614 @@ enum TextureType {
   HEIGHT_MAP
 };
 
+/*
+ * Pixels decoded from an image file, ready to upload. Decoding touches no GL
+ * state, so it can run on any thread; only the upload in Texture needs the
+ * context.
+ */
+struct DecodedImage {
+  unsigned char* pixels = nullptr;
+  int width = 0;
+  int height = 0;
+  int channels = 0;
+
+  DecodedImage() {}
+  DecodedImage(const DecodedImage&) = delete;
+  DecodedImage& operator=(const DecodedImage&) = delete;
+
+  DecodedImage(DecodedImage&& other) noexcept {
+    *this = std::move(other);
+  }
+
+  DecodedImage& operator=(DecodedImage&& other) noexcept {
+    std::swap(pixels, other.pixels);
+    std::swap(width, other.width);
+    std::swap(height, other.height);
+    std::swap(channels, other.channels);
+    return *this;
+  }
+
+  ~DecodedImage() {
+    stbi_image_free(pixels);
+  }
+
+  /* Decode to exactly desiredChannels (3 or 4) so the upload format always matches the data */
+  bool load(const char* path, int desiredChannels) {
+    TraceScope trace("texture", "decode", path);
+    int fileChannels;
+    /* The flip flag is per thread, so concurrent decodes cannot race on it */
+    stbi_set_flip_vertically_on_load_thread(true);
+    stbi_image_free(pixels);
+    pixels = nullptr;
+
+    /* Decoded straight out of the pack mapping (or the mapped loose file), never copied first */
+    AssetFile file;
+    if (file.open(path) && file.size <= INT_MAX) {
+      pixels = stbi_load_from_memory(file.data, (int)file.size, &width, &height, &fileChannels, desiredChannels);
+    }
+    channels = pixels ? desiredChannels : 0;
+    if (!pixels) {
+      std::cout << "Failed to load texture: " << path << " (" << (file.data ? stbi_failure_reason() : "can't open file") << ")" << std::endl;
+    }
+    return pixels != nullptr;
+  }
+};
+
+/*
+ * Handle to a texture in the TextureRegistry: the low bits index the
+ * registry's table and the high bits hold that slot's generation, so a handle
+ * to a freed texture never resolves to whatever reuses its slot.
+ */
+typedef uint32_t TextureHandle;
+
+#define TEXTURE_HANDLE_NONE 0u
+#define TEXTURE_HANDLE_INDEX_BITS 20
+#define TEXTURE_HANDLE_INDEX_MASK ((1u << TEXTURE_HANDLE_INDEX_BITS) - 1)
+
+/*
+ * Every texture loaded from a file, keyed by canonical path and load
+ * parameters so each image is decoded and uploaded once. Entries are
+ * refcounted and the GL texture is deleted when the last reference goes.
+ * Lookups may come from any thread; adding and releasing textures calls GL
+ * and so belongs on the context's thread.
+ */
+class TextureRegistry {
+private:
+  struct Entry {
+    std::string key;
+    unsigned int texture = 0;
+    uint32_t references = 0;
+    uint32_t generation = 1;
+  };
+
+  inline static std::vector<Entry> entries;
+  inline static std::vector<uint32_t> freeEntries;
+  inline static std::unordered_map<std::string, uint32_t> lookup;
+  inline static std::mutex mutex;
+
+  static TextureHandle makeHandle(uint32_t index) {
+    return (entries[index].generation << TEXTURE_HANDLE_INDEX_BITS) | index;
+  }
+
+  /* Entry behind a handle, or nullptr if the handle is stale. Caller holds the mutex. */
+  static Entry* resolve(TextureHandle handle) {
+    uint32_t index = handle & TEXTURE_HANDLE_INDEX_MASK;
+    if (handle == TEXTURE_HANDLE_NONE || index >= entries.size() || makeHandle(index) != handle || entries[index].references == 0) {
+      return nullptr;
+    }
+    return &entries[index];
+  }
+
+public:
+  /* Registry key of an image file loaded with or without alpha */
+  static std::string key(const std::string& path, bool containsAlpha) {
+    std::error_code error;
+    std::filesystem::path canonical = std::filesystem::weakly_canonical(path, error);
+    return (error ? path : canonical.string()) + (containsAlpha ? "|rgba" : "|rgb");
+  }
+
+  static bool contains(const std::string& key) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return lookup.count(key) != 0;
+  }
+
+  /* Take a reference to the texture registered under key, or TEXTURE_HANDLE_NONE */
+  static TextureHandle find(const std::string& key) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = lookup.find(key);
+    if (found == lookup.end()) {
+      return TEXTURE_HANDLE_NONE;
+    }
+    entries[found->second].references++;
+    return makeHandle(found->second);
+  }
+
+  /* Register a GL texture under key, holding one reference to it */
+  static TextureHandle insert(const std::string& key, unsigned int texture) {
+    std::lock_guard<std::mutex> lock(mutex);
+    uint32_t index;
+    if (!freeEntries.empty()) {
+      index = freeEntries.back();
+      freeEntries.pop_back();
+    } else {
+      index = entries.size();
+      entries.emplace_back();
+    }
+
+    Entry& entry = entries[index];
+    entry.key = key;
+    entry.texture = texture;
+    entry.references = 1;
+    lookup[key] = index;
+    return makeHandle(index);
+  }
+
+  static void addRef(TextureHandle handle) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (Entry* entry = resolve(handle)) {
+      entry->references++;
+    }
+  }
+
+  static void release(TextureHandle handle) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Entry* entry = resolve(handle);
+    if (entry == nullptr || --entry->references > 0) {
+      return;
+    }
+
+    /* Textures outliving the window have nothing left to delete them from */
+    if (glfwGetCurrentContext() != nullptr) {
+      glDeleteTextures(1, &entry->texture);
+    }
+    GLState::forgetTexture(entry->texture);
+
+    lookup.erase(entry->key);
+    entry->key.clear();
+    entry->texture = 0;
+    /* Skip generation 0 so no live handle can equal TEXTURE_HANDLE_NONE */
+    entry->generation = (entry->generation + 1) & (0xFFFFFFFFu >> TEXTURE_HANDLE_INDEX_BITS);
+    if (entry->generation == 0) {
+      entry->generation = 1;
+    }
+    freeEntries.push_back(handle & TEXTURE_HANDLE_INDEX_MASK);
+  }
+
+  /* GL name behind a handle; 0 if the handle is stale */
+  static unsigned int glTexture(TextureHandle handle) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Entry* entry = resolve(handle);
+    return entry ? entry->texture : 0;
+  }
+
+  /* Number of live textures */
+  static size_t size() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return lookup.size();
+  }
+};
+
+/* Pixel buffers the streamer cycles through, so a frame never writes one the GPU may still read */
+#define TEXTURE_STREAM_BUFFERS 3
+
+/*
+ * Loads textures in the background. Images decode (or texture files map) on
+ * the job system and are uploaded by update(), once per frame on the GL
+ * thread, through a ring of pixel buffer objects and never more than
+ * uploadBudget bytes per frame. Large images are spread over several frames a
+ * band of rows at a time; texture files a mip level at a time.
+ *
+ * Until its image is complete a streamed texture shows a 1x1 placeholder. For
+ * a decoded image the placeholder sits in the 1x1 level of the final mip chain
+ * and the texture's base level points at it, so level 0 can fill in unseen.
+ * Texture files upload their smallest level first and lower the base level as
+ * each larger one lands, so they sharpen as they load. The GL name never
+ * changes, so anything holding it picks up the real image.
+ */
+class TextureStreamer {
+private:
+  struct Upload {
+    TextureHandle handle;
+    unsigned int texture;
+    std::string path;
+    DecodedImage image;
+    std::unique_ptr<TextureFile> file;
+    int row = 0;    /* Next row of image */
+    int level = -1; /* Next level of file, counting down to 0 */
+    bool started = false;
+
+    bool failed() const {
+      return !file && !image.pixels;
+    }
+
+    bool done() const {
+      return failed() || (file ? level < 0 : row == image.height);
+    }
+
+    /* Bytes of the smallest piece that can go up next */
+    size_t nextBytes() const {
+      return file ? file->levels[level].size : (size_t)image.width * image.channels;
+    }
+  };
+
+  /* Rows of an image, or a whole level of a file, copied into the current pixel buffer */
+  struct Band {
+    Upload* upload;
+    int level;
+    int row;
+    int rows;
+    size_t offset;
+  };
+
+  inline static std::mutex mutex;
+  inline static std::deque<Upload> decoded; /* Written by workers */
+  inline static std::deque<Upload> active;  /* GL thread only */
+  inline static size_t inFlight = 0;        /* Requested and not yet finished */
+
+  inline static unsigned int buffers[TEXTURE_STREAM_BUFFERS] = { 0 };
+  inline static size_t bufferSizes[TEXTURE_STREAM_BUFFERS] = { 0 };
+  inline static unsigned int nextBuffer = 0;
+
+  static int lastLevel(const DecodedImage& image) {
+    int level = 0;
+    for (int size = std::max(image.width, image.height); size > 1; size >>= 1) {
+      level++;
+    }
+    return level;
+  }
+
+  static GLenum internalFormat(const DecodedImage& image) {
+    return image.channels == 4 ? GL_RGBA8 : GL_RGB8;
+  }
+
+  static GLenum format(const DecodedImage& image) {
+    return image.channels == 4 ? GL_RGBA : GL_RGB;
+  }
+
+  static void begin(Upload& upload) {
+    GLState::bindTexture(0, GL_TEXTURE_2D, upload.texture);
+    if (upload.file) {
+      /* Levels arrive smallest first; the placeholder in level 0 is out of range until level 0 replaces it */
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, upload.file->levels.size() - 1);
+    } else {
+      /* Allocate level 0 behind the placeholder, which moves to the 1x1 level */
+      const DecodedImage& image = upload.image;
+      int level = lastLevel(image);
+
+      glTexImage2D(GL_TEXTURE_2D, level, internalFormat(image), 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, placeholder);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, level);
+      glTexImage2D(GL_TEXTURE_2D, 0, internalFormat(image), image.width, image.height, 0, format(image), GL_UNSIGNED_BYTE, NULL);
+    }
+    upload.started = true;
+  }
+
+  static void finish(Upload& upload) {
+    if (upload.image.pixels) {
+      /* Level 0 is complete: show it and build the rest of the chain */
+      GLState::bindTexture(0, GL_TEXTURE_2D, upload.texture);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 1000);
+      glGenerateMipmap(GL_TEXTURE_2D);
+    }
+    if (!upload.failed() && debugPrint == true) {
+      std::cout << "NEPTUNE::INFO: Loaded texture: " << upload.path << " (ID: " << upload.texture << ")" << std::endl;
+    }
+    TextureRegistry::release(upload.handle);
+    inFlight--;
+  }
+
+public:
+  /* Bytes uploaded per frame at most; a frame always makes progress of at least one row or level */
+  inline static size_t uploadBudget = 4 << 20;
+
+  /* Colour of a texture whose image has not arrived yet */
+  inline static unsigned char placeholder[4] = { 128, 128, 128, 255 };
+
+  /*
+   * Load path in the background and upload it into texture, which handle keeps
+   * alive until then. filePath, if not empty, is a texture file (see
+   * TextureFile::find) to use instead; if it cannot be used, path is decoded.
+   */
+  static void request(TextureHandle handle, unsigned int texture, const std::string& path, const std::string& filePath, int channels) {
+    TextureRegistry::addRef(handle);
+    inFlight++;
+    if (!filePath.empty()) {
+      TextureFile::queryFormatSupport();
+    }
+
+    JobSystem::submit([handle, texture, path, filePath, channels] {
+      Upload upload;
+      upload.handle = handle;
+      upload.texture = texture;
+      upload.path = filePath.empty() ? path : filePath;
+
+      if (!filePath.empty()) {
+        TraceScope trace("texture", "read", filePath);
+        upload.file = std::make_unique<TextureFile>();
+        if (upload.file->load(filePath) && upload.file->supported()) {
+          upload.level = upload.file->levels.size() - 1;
+        } else {
+          upload.file.reset();
+          upload.path = path;
+        }
+      }
+      if (!upload.file && path != filePath) {
+        upload.image.load(path.c_str(), channels);
+      }
+
+      std::lock_guard<std::mutex> lock(mutex);
+      decoded.push_back(std::move(upload));
+    });
+  }
+
+  /* Textures requested but not uploaded yet */
+  static size_t pending() {
+    return inFlight;
+  }
+
+  /* Upload loaded images within the budget. Call once per frame on the GL thread. */
+  static void update() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      while (!decoded.empty()) {
+        active.push_back(std::move(decoded.front()));
+        decoded.pop_front();
+      }
+    }
+
+    /* Failed loads keep their placeholder */
+    while (!active.empty() && active.front().failed()) {
+      finish(active.front());
+      active.pop_front();
+    }
+    if (active.empty()) {
+      return;
+    }
+
+    /* The buffer must hold the budget, and at least the next piece of the first upload */
+    size_t capacity = std::max(uploadBudget, active.front().nextBytes());
+
+    unsigned int index = nextBuffer;
+    nextBuffer = (nextBuffer + 1) % TEXTURE_STREAM_BUFFERS;
+    if (buffers[index] == 0) {
+      glGenBuffers(1, &buffers[index]);
+    }
+    GLState::bindBuffer(GL_PIXEL_UNPACK_BUFFER, buffers[index]);
+    if (bufferSizes[index] < capacity) {
+      glBufferData(GL_PIXEL_UNPACK_BUFFER, capacity, NULL, GL_STREAM_DRAW);
+      bufferSizes[index] = capacity;
+    }
+
+    /* Invalidating lets the driver hand out fresh memory instead of waiting on the GPU */
+    unsigned char* mapped = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, capacity, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (mapped == nullptr) {
+      GLState::bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+      return;
+    }
+
+    TraceScope trace("texture", "stream");
+    std::vector<Band> bands;
+    size_t used = 0;
+    bool full = false;
+    for (Upload& upload : active) {
+      if (upload.failed()) {
+        continue;
+      }
+
+      if (upload.file) {
+        while (upload.level >= 0 && !full) {
+          size_t size = upload.file->levels[upload.level].size;
+          if (used + size > capacity) {
+            full = true;
+            break;
+          }
+          memcpy(mapped + used, upload.file->levelData(upload.level), size);
+          bands.push_back({ &upload, upload.level, 0, 0, used });
+          upload.level--;
+          used += size;
+        }
+      } else {
+        size_t rowBytes = (size_t)upload.image.width * upload.image.channels;
+        int rows = std::min<size_t>(upload.image.height - upload.row, (capacity - used) / rowBytes);
+        if (rows > 0) {
+          memcpy(mapped + used, upload.image.pixels + upload.row * rowBytes, rows * rowBytes);
+          bands.push_back({ &upload, 0, upload.row, rows, used });
+          upload.row += rows;
+          used += rows * rowBytes;
+        }
+        full = upload.row < upload.image.height;
+      }
+
+      if (full) {
+        break;
+      }
+    }
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (const Band& band : bands) {
+      Upload& upload = *band.upload;
+      if (!upload.started) {
+        begin(upload);
+      }
+      GLState::bindTexture(0, GL_TEXTURE_2D, upload.texture);
+      if (upload.file) {
+        upload.file->upload(band.level, (const void*)band.offset);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, band.level);
+      } else {
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, band.row, upload.image.width, band.rows, format(upload.image), GL_UNSIGNED_BYTE, (const void*)band.offset);
+        Trace::uploaded((size_t)band.rows * upload.image.width * upload.image.channels);
+      }
+    }
+
+    /* Nothing else expects a pixel unpack buffer to be bound */
+    GLState::bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    while (!active.empty() && active.front().done()) {
+      finish(active.front());
+      active.pop_front();
+    }
+  }
+};
+
+/*
+ * A reference to a registered texture. Copies share the image and the last
+ * one to go frees it, so keep a Texture alive for as long as anything (a
+ * Cube's textures, for example) uses its GL name.
+ */
 class Texture {
 public:
-  unsigned int texture;
+  TextureHandle handle = TEXTURE_HANDLE_NONE;
+  unsigned int texture = 0;
   enum TextureType type;
-  aiString path;
 
-  /* TextureType has no effect outside of loading models. Use GENERIC if unsure. */
-  Texture(const char* path, unsigned int slot, bool containsAlpha, enum TextureType typeName) {
+  /*
+   * TextureType has no effect outside of loading models. Use GENERIC if unsure.
+   * A streamed texture is usable straight away and shows a placeholder until
+   * TextureStreamer has loaded its image in the background.
+   */
+  Texture(const char* path, unsigned int slot, bool containsAlpha, enum TextureType typeName, bool streamed = false) {
+    TraceScope trace("texture", "load", path);
     type = typeName;
+    std::string registryKey = TextureRegistry::key(path, containsAlpha);
+    if (acquire(registryKey)) {
+      return;
+    }
+
+    /* A pre-built .dds/.ktx2 next to the image replaces it */
+    std::string filePath = TextureFile::find(path);
+
+    if (streamed) {
+      DecodedImage placeholder;
+      placeholder.pixels = TextureStreamer::placeholder;
+      placeholder.width = placeholder.height = 1;
+      placeholder.channels = 4;
+      create(registryKey, placeholder, slot);
+      /* Borrowed, not owned */
+      placeholder.pixels = nullptr;
+
+      TextureStreamer::request(handle, texture, path, filePath, containsAlpha ? 4 : 3);
+      return;
+    }
+
+    if (!filePath.empty()) {
+      TextureFile::queryFormatSupport();
+      TextureFile file;
+      bool loaded;
+      {
+        TraceScope readTrace("texture", "read", filePath);
+        loaded = file.load(filePath) && file.supported();
+      }
+      if (loaded) {
+        create(registryKey, file, slot);
+        if (debugPrint == true) {
+          std::cout << "NEPTUNE::INFO: Loaded texture: " << filePath << " (ID: " << texture << ")" << std::endl;
+        }
+        return;
+      }
+    }
+
+    DecodedImage image;
+    image.load(path, containsAlpha ? 4 : 3);
+    create(registryKey, image, slot);
+    if (image.pixels && debugPrint == true) {
+      std::cout << "NEPTUNE::INFO: Loaded texture: " << path << " (ID: " << texture << ")" << std::endl;
+    }
+  }
+
+  /*
+   * The texture for path, uploading image (decoded elsewhere, e.g. by a worker
+   * thread) only if path is not registered yet
+   */
+  Texture(const std::string& path, const DecodedImage& image, bool containsAlpha, enum TextureType typeName) {
+    type = typeName;
+    std::string registryKey = TextureRegistry::key(path, containsAlpha);
+    if (!acquire(registryKey)) {
+      create(registryKey, image, 0);
+    }
+  }
+
+  Texture(const Texture& other) : handle(other.handle), texture(other.texture), type(other.type) {
+    TextureRegistry::addRef(handle);
+  }
+
+  Texture(Texture&& other) noexcept : handle(other.handle), texture(other.texture), type(other.type) {
+    other.handle = TEXTURE_HANDLE_NONE;
+    other.texture = 0;
+  }
+
+  Texture& operator=(const Texture& other) {
+    if (this != &other) {
+      TextureRegistry::addRef(other.handle);
+      TextureRegistry::release(handle);
+      handle = other.handle;
+      texture = other.texture;
+      type = other.type;
+    }
+    return *this;
+  }
+
+  Texture& operator=(Texture&& other) noexcept {
+    std::swap(handle, other.handle);
+    std::swap(texture, other.texture);
+    type = other.type;
+    return *this;
+  }
+
+  ~Texture() {
+    TextureRegistry::release(handle);
+  }
+
+private:
+  bool acquire(const std::string& registryKey) {
+    handle = TextureRegistry::find(registryKey);
+    texture = TextureRegistry::glTexture(handle);
+    return handle != TEXTURE_HANDLE_NONE;
+  }
+
+  /* Upload every level stored in a texture file; the file's mip chain is used as is */
+  void create(const std::string& registryKey, const TextureFile& file, unsigned int slot) {
+    TraceScope trace("texture", "upload", registryKey);
+    generate(slot);
+    for (size_t level = 0; level < file.levels.size(); ++level) {
+      file.upload(level, file.levelData(level));
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, file.levels.size() - 1);
+
+    handle = TextureRegistry::insert(registryKey, texture);
+  }
+
+  void create(const std::string& registryKey, const DecodedImage& image, unsigned int slot) {
+    TraceScope trace("texture", "upload", registryKey);
+    generate(slot);
+    /* Generate the texture */
+    if (image.pixels) {
+      GLenum format = image.channels == 4 ? GL_RGBA : GL_RGB;
+      /* Rows of 3 channel images are not always 4 byte aligned */
+      glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+      glTexImage2D(GL_TEXTURE_2D, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, image.pixels);
+      glGenerateMipmap(GL_TEXTURE_2D);
+      Trace::uploaded((size_t)image.width * image.height * image.channels);
+    }
+
+    handle = TextureRegistry::insert(registryKey, texture);
+  }
+
+  void generate(unsigned int slot) {
     glGenTextures(1, &texture);
     /*
      * Slots are defined as integers starting at GL_TEXTURE0 (0x84c0).
      * Incrementing GL_TEXTURE0 gives GL_TEXTURE#, where: # = the number that is
      * incremented by.
      */
-    glActiveTexture(GL_TEXTURE0 + slot); 
-    glBindTexture(GL_TEXTURE_2D, texture);
+    GLState::bindTexture(slot, GL_TEXTURE_2D, texture);
 
     /* Set the texture wrapping/filtering options */
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);	
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    /* Load and generate the texture */
-    int width, height, nrChannels;
-    stbi_set_flip_vertically_on_load(true);  
-    unsigned char *data = stbi_load(path, &width, &height, &nrChannels, 0);
-    if (data) {
-      glTexImage2D(GL_TEXTURE_2D, 0, containsAlpha ? GL_RGBA : GL_RGB, width, height, 0, containsAlpha ? GL_RGBA : GL_RGB, GL_UNSIGNED_BYTE, data);
-      glGenerateMipmap(GL_TEXTURE_2D);
-      if (debugPrint == true) {
-        std::cout << "NEPTUNE::INFO: Loaded texture: " << path << " (ID: " << texture << ")" << std::endl;
-      }
-    } else {
-      std::cout << "Failed to load texture: " << path << " (" << stbi_failure_reason() << ")" << std::endl;
-    }
-
-    stbi_image_free(data);
   }
 };
 
@@ -0,0 +1,399 @@
+/*
+ * include/texturefile.h
+ *
+ * Pre-built textures in DDS or KTX2 containers: block compressed (BC1, BC3,
+ * BC4, BC5, BC7) or plain RGBA8, with every mip level stored in the file.
+ * TextureFile maps the file and finds each level so it can be handed to GL
+ * as is. tools/texcompress.cpp writes these files; they are read from a
+ * mounted asset pack when it holds them.
+ */
+
+#ifndef TEXTUREFILE_H
+#define TEXTUREFILE_H
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <archive.h>
+#include <trace.h>
+
+/* Formats outside the GL 3.3 core headers */
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_SRGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_SRGB_S3TC_DXT1_EXT 0x8C4C
+#endif
+#ifndef GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT 0x8C4F
+#endif
+#ifndef GL_COMPRESSED_RGBA_BPTC_UNORM
+#define GL_COMPRESSED_RGBA_BPTC_UNORM 0x8E8C
+#endif
+#ifndef GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM
+#define GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM 0x8E8D
+#endif
+
+#define DDS_MAGIC "DDS "
+#define DDS_FOURCC(a, b, c, d) ((uint32_t)(a) | ((uint32_t)(b) << 8) | ((uint32_t)(c) << 16) | ((uint32_t)(d) << 24))
+
+#define DDSD_CAPS 0x1
+#define DDSD_HEIGHT 0x2
+#define DDSD_WIDTH 0x4
+#define DDSD_PIXELFORMAT 0x1000
+#define DDSD_MIPMAPCOUNT 0x20000
+#define DDSD_LINEARSIZE 0x80000
+#define DDPF_FOURCC 0x4
+#define DDSCAPS_COMPLEX 0x8
+#define DDSCAPS_TEXTURE 0x1000
+#define DDSCAPS_MIPMAP 0x400000
+#define DDS_DIMENSION_TEXTURE2D 3
+
+/* DXGI_FORMAT values of the formats the engine reads */
+enum DDSFormat {
+  DDS_FORMAT_RGBA8_UNORM = 28,
+  DDS_FORMAT_RGBA8_UNORM_SRGB = 29,
+  DDS_FORMAT_BC1_UNORM = 71,
+  DDS_FORMAT_BC1_UNORM_SRGB = 72,
+  DDS_FORMAT_BC3_UNORM = 77,
+  DDS_FORMAT_BC3_UNORM_SRGB = 78,
+  DDS_FORMAT_BC4_UNORM = 80,
+  DDS_FORMAT_BC5_UNORM = 83,
+  DDS_FORMAT_BC7_UNORM = 98,
+  DDS_FORMAT_BC7_UNORM_SRGB = 99
+};
+
+struct DDSPixelFormat {
+  uint32_t size;
+  uint32_t flags;
+  uint32_t fourCC;
+  uint32_t rgbBitCount;
+  uint32_t redMask;
+  uint32_t greenMask;
+  uint32_t blueMask;
+  uint32_t alphaMask;
+};
+
+struct DDSHeader {
+  uint32_t size;
+  uint32_t flags;
+  uint32_t height;
+  uint32_t width;
+  uint32_t pitchOrLinearSize;
+  uint32_t depth;
+  uint32_t mipMapCount;
+  uint32_t reserved1[11];
+  DDSPixelFormat pixelFormat;
+  uint32_t caps;
+  uint32_t caps2;
+  uint32_t caps3;
+  uint32_t caps4;
+  uint32_t reserved2;
+};
+
+struct DDSHeaderDX10 {
+  uint32_t dxgiFormat;
+  uint32_t resourceDimension;
+  uint32_t miscFlag;
+  uint32_t arraySize;
+  uint32_t miscFlags2;
+};
+
+static const unsigned char KTX2_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+struct KTX2Header {
+  unsigned char identifier[12];
+  uint32_t vkFormat;
+  uint32_t typeSize;
+  uint32_t pixelWidth;
+  uint32_t pixelHeight;
+  uint32_t pixelDepth;
+  uint32_t layerCount;
+  uint32_t faceCount;
+  uint32_t levelCount;
+  uint32_t supercompressionScheme;
+  uint32_t dfdByteOffset;
+  uint32_t dfdByteLength;
+  uint32_t kvdByteOffset;
+  uint32_t kvdByteLength;
+  uint64_t sgdByteOffset;
+  uint64_t sgdByteLength;
+};
+
+struct KTX2Level {
+  uint64_t byteOffset;
+  uint64_t byteLength;
+  uint64_t uncompressedByteLength;
+};
+
+/* One format as DDS, KTX2 (VkFormat) and GL name it */
+struct TextureFormat {
+  uint32_t dxgiFormat;
+  uint32_t vkFormat;
+  GLenum internalFormat;
+  unsigned int blockBytes; /* Bytes per 4x4 block, or 0 if not block compressed */
+};
+
+static const TextureFormat TEXTURE_FORMATS[] = {
+  { DDS_FORMAT_RGBA8_UNORM, 37, GL_RGBA8, 0 },
+  { DDS_FORMAT_RGBA8_UNORM_SRGB, 43, GL_SRGB8_ALPHA8, 0 },
+  { DDS_FORMAT_BC1_UNORM, 131, GL_COMPRESSED_RGB_S3TC_DXT1_EXT, 8 },
+  { DDS_FORMAT_BC1_UNORM_SRGB, 132, GL_COMPRESSED_SRGB_S3TC_DXT1_EXT, 8 },
+  { DDS_FORMAT_BC3_UNORM, 137, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, 16 },
+  { DDS_FORMAT_BC3_UNORM_SRGB, 138, GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT, 16 },
+  { DDS_FORMAT_BC4_UNORM, 139, GL_COMPRESSED_RED_RGTC1, 8 },
+  { DDS_FORMAT_BC5_UNORM, 141, GL_COMPRESSED_RG_RGTC2, 16 },
+  { DDS_FORMAT_BC7_UNORM, 145, GL_COMPRESSED_RGBA_BPTC_UNORM, 16 },
+  { DDS_FORMAT_BC7_UNORM_SRGB, 146, GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM, 16 }
+};
+
+/* Bytes in one mip level of a texture in format */
+size_t textureLevelSize(const TextureFormat& format, uint32_t width, uint32_t height) {
+  if (format.blockBytes == 0) {
+    return (size_t)width * height * 4;
+  }
+  return (size_t)((width + 3) / 4) * ((height + 3) / 4) * format.blockBytes;
+}
+
+struct TextureFileLevel {
+  uint32_t width;
+  uint32_t height;
+  size_t offset; /* From the start of the file */
+  size_t size;
+};
+
+class TextureFile {
+private:
+  inline static bool formatsQueried = false;
+  inline static bool s3tcSupported = false;
+  inline static bool bptcSupported = false;
+
+  static const TextureFormat* findFormat(uint32_t dxgiFormat, uint32_t vkFormat) {
+    for (const TextureFormat& candidate : TEXTURE_FORMATS) {
+      if ((dxgiFormat != 0 && candidate.dxgiFormat == dxgiFormat) || (vkFormat != 0 && candidate.vkFormat == vkFormat)) {
+        return &candidate;
+      }
+    }
+    return nullptr;
+  }
+
+  static bool endsWith(const std::string& text, const std::string& suffix) {
+    return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+  }
+
+  /* Levels stored back to back from offset, largest first, as DDS does */
+  bool addPackedLevels(size_t offset, uint32_t levelCount) {
+    uint32_t levelWidth = width, levelHeight = height;
+    for (uint32_t i = 0; i < levelCount; ++i) {
+      size_t size = textureLevelSize(*format, levelWidth, levelHeight);
+      if (offset + size > file.size) {
+        return false;
+      }
+      levels.push_back({ levelWidth, levelHeight, offset, size });
+      offset += size;
+      levelWidth = std::max(1u, levelWidth / 2);
+      levelHeight = std::max(1u, levelHeight / 2);
+    }
+    return true;
+  }
+
+  bool loadDDS() {
+    if (file.size < 4 + sizeof(DDSHeader)) {
+      return false;
+    }
+    const DDSHeader* header = (const DDSHeader*)(file.data + 4);
+    size_t offset = 4 + sizeof(DDSHeader);
+
+    uint32_t dxgiFormat = 0;
+    const DDSPixelFormat& pixelFormat = header->pixelFormat;
+    if (!(pixelFormat.flags & DDPF_FOURCC)) {
+      return false;
+    }
+    switch (pixelFormat.fourCC) {
+      case DDS_FOURCC('D', 'X', '1', '0'): {
+        if (file.size < offset + sizeof(DDSHeaderDX10)) {
+          return false;
+        }
+        const DDSHeaderDX10* extended = (const DDSHeaderDX10*)(file.data + offset);
+        if (extended->resourceDimension != DDS_DIMENSION_TEXTURE2D || extended->arraySize > 1) {
+          return false;
+        }
+        dxgiFormat = extended->dxgiFormat;
+        offset += sizeof(DDSHeaderDX10);
+        break;
+      }
+      case DDS_FOURCC('D', 'X', 'T', '1'): dxgiFormat = DDS_FORMAT_BC1_UNORM; break;
+      case DDS_FOURCC('D', 'X', 'T', '5'): dxgiFormat = DDS_FORMAT_BC3_UNORM; break;
+      case DDS_FOURCC('A', 'T', 'I', '1'):
+      case DDS_FOURCC('B', 'C', '4', 'U'): dxgiFormat = DDS_FORMAT_BC4_UNORM; break;
+      case DDS_FOURCC('A', 'T', 'I', '2'):
+      case DDS_FOURCC('B', 'C', '5', 'U'): dxgiFormat = DDS_FORMAT_BC5_UNORM; break;
+      default: return false;
+    }
+
+    format = findFormat(dxgiFormat, 0);
+    if (format == nullptr) {
+      return false;
+    }
+    width = header->width;
+    height = header->height;
+    uint32_t levelCount = (header->flags & DDSD_MIPMAPCOUNT) && header->mipMapCount > 0 ? header->mipMapCount : 1;
+    return addPackedLevels(offset, levelCount);
+  }
+
+  bool loadKTX2() {
+    if (file.size < sizeof(KTX2Header)) {
+      return false;
+    }
+    const KTX2Header* header = (const KTX2Header*)file.data;
+    /* Plain 2D textures only; supercompressed (Basis, zstd) files are not read */
+    if (header->supercompressionScheme != 0 || header->pixelDepth > 1 || header->layerCount > 1 || header->faceCount != 1) {
+      return false;
+    }
+
+    format = findFormat(0, header->vkFormat);
+    if (format == nullptr) {
+      return false;
+    }
+    width = header->pixelWidth;
+    height = header->pixelHeight;
+
+    uint32_t levelCount = std::max(1u, header->levelCount);
+    if (file.size < sizeof(KTX2Header) + levelCount * sizeof(KTX2Level)) {
+      return false;
+    }
+    const KTX2Level* index = (const KTX2Level*)(file.data + sizeof(KTX2Header));
+    uint32_t levelWidth = width, levelHeight = height;
+    for (uint32_t i = 0; i < levelCount; ++i) {
+      size_t size = textureLevelSize(*format, levelWidth, levelHeight);
+      if (index[i].byteLength < size || index[i].byteOffset + size > file.size) {
+        return false;
+      }
+      levels.push_back({ levelWidth, levelHeight, (size_t)index[i].byteOffset, size });
+      levelWidth = std::max(1u, levelWidth / 2);
+      levelHeight = std::max(1u, levelHeight / 2);
+    }
+    return true;
+  }
+
+public:
+  AssetFile file;
+  const TextureFormat* format = nullptr;
+  uint32_t width = 0;
+  uint32_t height = 0;
+  std::vector<TextureFileLevel> levels; /* Largest first */
+
+  bool load(const std::string& path) {
+    levels.clear();
+    format = nullptr;
+    if (!file.open(path)) {
+      return false;
+    }
+
+    bool loaded = false;
+    if (file.size >= 4 && memcmp(file.data, DDS_MAGIC, 4) == 0) {
+      loaded = loadDDS();
+    } else if (file.size >= sizeof(KTX2_IDENTIFIER) && memcmp(file.data, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) == 0) {
+      loaded = loadKTX2();
+    }
+
+    if (!loaded || width == 0 || height == 0) {
+      std::cout << "ERROR::TEXTURE::INVALID_TEXTURE_FILE: " << path << std::endl;
+      levels.clear();
+      file.close();
+      return false;
+    }
+    return true;
+  }
+
+  const unsigned char* levelData(size_t level) const {
+    return file.data + levels[level].offset;
+  }
+
+  bool compressed() const {
+    return format->blockBytes != 0;
+  }
+
+  /* Define one level of the bound GL_TEXTURE_2D from data, or from an offset into the bound pixel unpack buffer */
+  void upload(size_t level, const void* data) const {
+    const TextureFileLevel& stored = levels[level];
+    Trace::uploaded(stored.size);
+    if (compressed()) {
+      glCompressedTexImage2D(GL_TEXTURE_2D, level, format->internalFormat, stored.width, stored.height, 0, stored.size, data);
+    } else {
+      glTexImage2D(GL_TEXTURE_2D, level, format->internalFormat, stored.width, stored.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
+    }
+  }
+
+  /* Whether the driver can sample this file's format; see queryFormatSupport */
+  bool supported() const {
+    switch (format->internalFormat) {
+      case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+      case GL_COMPRESSED_SRGB_S3TC_DXT1_EXT:
+      case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+      case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT:
+        return s3tcSupported;
+      case GL_COMPRESSED_RGBA_BPTC_UNORM:
+      case GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM:
+        return bptcSupported;
+      default:
+        /* RGTC and RGBA8 are core */
+        return true;
+    }
+  }
+
+  /*
+   * Check which compressed formats the context supports. Needs a current
+   * context, so it runs on the GL thread before any file is loaded; after
+   * that supported() may be called from any thread.
+   */
+  static void queryFormatSupport() {
+    if (formatsQueried) {
+      return;
+    }
+    s3tcSupported = glfwExtensionSupported("GL_EXT_texture_compression_s3tc");
+    bptcSupported = glfwExtensionSupported("GL_ARB_texture_compression_bptc");
+    formatsQueried = true;
+  }
+
+  /*
+   * The pre-built file to use instead of the image at source: source itself if
+   * it is a .dds/.ktx2, otherwise <source>.dds or <source>.ktx2 when one exists
+   * and is at least as new as source. Empty if there is none. Files in a
+   * mounted pack are taken as they are: the pack was built from them.
+   */
+  static std::string find(const std::string& source) {
+    if (endsWith(source, ".dds") || endsWith(source, ".ktx2")) {
+      return source;
+    }
+
+    std::error_code error;
+    for (const char* extension : { ".dds", ".ktx2" }) {
+      std::string candidate = source + extension;
+      if (AssetArchive::contains(candidate)) {
+        return candidate;
+      }
+      if (!std::filesystem::exists(candidate, error)) {
+        continue;
+      }
+      if (std::filesystem::exists(source, error) && std::filesystem::last_write_time(candidate, error) < std::filesystem::last_write_time(source, error)) {
+        continue;
+      }
+      return candidate;
+    }
+    return std::string();
+  }
+};
+
+#endif
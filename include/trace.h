@@ -0,0 +1,257 @@
+/*
+ * include/trace.h
+ *
+ * Load time instrumentation. A TraceScope records one phase of loading one
+ * asset (reading a shader, decoding an image, parsing a model, uploading its
+ * buffers, ...) with its wall time and what the calling thread read, uploaded
+ * to GL and allocated while it ran. Events can be written out as a Chrome
+ * trace (chrome://tracing or ui.perfetto.dev) or summed per phase; see
+ * tools/loadbench.cpp.
+ *
+ * Nothing is recorded until Trace::enabled is set, and a disabled scope costs
+ * a relaxed atomic load. Counters are per thread, so work a scope hands to
+ * the job system shows up in the scopes of those jobs, not in its own.
+ *
+ * Allocations are only counted when NEPTUNE_TRACE_ALLOCATIONS is defined
+ * before this header is first included. That replaces the global operator
+ * new and delete, so define it in one translation unit only.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <new>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct TraceCounters {
+  uint64_t bytesRead = 0;      /* Asset bytes handed to a loader, from a pack or from disk */
+  uint64_t bytesUploaded = 0;  /* Buffer and texture data given to GL */
+  uint64_t allocations = 0;    /* Only with NEPTUNE_TRACE_ALLOCATIONS */
+  uint64_t allocatedBytes = 0;
+
+  TraceCounters& operator+=(const TraceCounters& other) {
+    bytesRead += other.bytesRead;
+    bytesUploaded += other.bytesUploaded;
+    allocations += other.allocations;
+    allocatedBytes += other.allocatedBytes;
+    return *this;
+  }
+};
+
+struct TraceEvent {
+  const char* category; /* The kind of asset: "shader", "texture", "model" */
+  const char* name;     /* The phase: "load", "read", "decode", "upload", ... */
+  std::string asset;
+  double begin;         /* Microseconds since the trace epoch */
+  double duration;
+  uint32_t thread;
+  TraceCounters counters;
+};
+
+/* All events of one category and phase added up */
+struct TracePhase {
+  std::string category;
+  std::string name;
+  size_t count = 0;
+  double milliseconds = 0.0;
+  TraceCounters counters;
+};
+
+class Trace {
+private:
+  inline static std::mutex mutex;
+  inline static std::vector<TraceEvent> events;
+  inline static std::atomic<uint32_t> nextThread{ 0 };
+  inline static const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+  static void writeEscaped(FILE* file, std::string_view text) {
+    for (char c : text) {
+      if (c == '"' || c == '\\') {
+        fprintf(file, "\\%c", c);
+      } else if ((unsigned char)c < 0x20) {
+        fprintf(file, "\\u%04x", c);
+      } else {
+        fputc(c, file);
+      }
+    }
+  }
+
+public:
+  inline static std::atomic<bool> enabled{ false };
+
+  /* The calling thread's running totals */
+  static TraceCounters& counters() {
+    thread_local TraceCounters threadCounters;
+    return threadCounters;
+  }
+
+  /* Small stable number for the calling thread, used as the Chrome trace tid */
+  static uint32_t thread() {
+    thread_local uint32_t id = nextThread++;
+    return id;
+  }
+
+  static double now() {
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - epoch).count();
+  }
+
+  static void read(size_t bytes) {
+    counters().bytesRead += bytes;
+  }
+
+  static void uploaded(size_t bytes) {
+    counters().bytesUploaded += bytes;
+  }
+
+  static void record(TraceEvent&& event) {
+    std::lock_guard<std::mutex> lock(mutex);
+    events.push_back(std::move(event));
+  }
+
+  static std::vector<TraceEvent> snapshot() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return events;
+  }
+
+  static void clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    events.clear();
+  }
+
+  /* Sum the recorded events per category and phase, in the order each phase first finished */
+  static std::vector<TracePhase> phases() {
+    std::vector<TracePhase> result;
+    for (const TraceEvent& event : snapshot()) {
+      auto phase = std::find_if(result.begin(), result.end(), [&](const TracePhase& candidate) {
+        return candidate.category == event.category && candidate.name == event.name;
+      });
+      if (phase == result.end()) {
+        TracePhase added;
+        added.category = event.category;
+        added.name = event.name;
+        result.push_back(std::move(added));
+        phase = result.end() - 1;
+      }
+      phase->count++;
+      phase->milliseconds += event.duration / 1000.0;
+      phase->counters += event.counters;
+    }
+    return result;
+  }
+
+  /* Write the recorded events as Chrome trace event JSON */
+  static bool write(const std::string& path) {
+    FILE* file = fopen(path.c_str(), "wb");
+    if (file == nullptr) {
+      std::cout << "ERROR::TRACE::FILE_NOT_SUCCESSFULLY_WRITTEN: " << path << std::endl;
+      return false;
+    }
+
+    std::vector<TraceEvent> recorded = snapshot();
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    for (size_t i = 0; i < recorded.size(); ++i) {
+      const TraceEvent& event = recorded[i];
+      fprintf(file, "{\"name\":\"%s %s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%u,\"args\":{\"asset\":\"",
+              event.category, event.name, event.category, event.begin, event.duration, event.thread);
+      writeEscaped(file, event.asset);
+      fprintf(file, "\",\"bytesRead\":%llu,\"bytesUploaded\":%llu,\"allocations\":%llu,\"allocatedBytes\":%llu}}%s\n",
+              (unsigned long long)event.counters.bytesRead, (unsigned long long)event.counters.bytesUploaded,
+              (unsigned long long)event.counters.allocations, (unsigned long long)event.counters.allocatedBytes,
+              i + 1 < recorded.size() ? "," : "");
+    }
+    fprintf(file, "]}\n");
+
+    bool written = ferror(file) == 0;
+    written = fclose(file) == 0 && written;
+    if (!written) {
+      std::cout << "ERROR::TRACE::FILE_NOT_SUCCESSFULLY_WRITTEN: " << path << std::endl;
+    }
+    return written;
+  }
+};
+
+/* Records the enclosing block as one event when tracing is enabled */
+class TraceScope {
+private:
+  const char* category;
+  const char* name;
+  std::string asset;
+  double begin = 0.0;
+  TraceCounters start;
+  bool active;
+
+public:
+  TraceScope(const char* category, const char* name, std::string_view asset = std::string_view())
+    : category(category), name(name), active(Trace::enabled.load(std::memory_order_relaxed)) {
+    if (!active) {
+      return;
+    }
+    this->asset = asset;
+    /* Taken last so the scope's own bookkeeping is not counted */
+    start = Trace::counters();
+    begin = Trace::now();
+  }
+
+  TraceScope(const TraceScope&) = delete;
+  TraceScope& operator=(const TraceScope&) = delete;
+
+  ~TraceScope() {
+    if (!active) {
+      return;
+    }
+    double end = Trace::now();
+    const TraceCounters& current = Trace::counters();
+
+    TraceCounters used;
+    used.bytesRead = current.bytesRead - start.bytesRead;
+    used.bytesUploaded = current.bytesUploaded - start.bytesUploaded;
+    used.allocations = current.allocations - start.allocations;
+    used.allocatedBytes = current.allocatedBytes - start.allocatedBytes;
+
+    Trace::record({ category, name, std::move(asset), begin, end - begin, Trace::thread(), used });
+  }
+};
+
+#ifdef NEPTUNE_TRACE_ALLOCATIONS
+void* operator new(size_t size) {
+  TraceCounters& counters = Trace::counters();
+  counters.allocations++;
+  counters.allocatedBytes += size;
+  if (void* memory = malloc(size > 0 ? size : 1)) {
+    return memory;
+  }
+  throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) {
+  return operator new(size);
+}
+
+void operator delete(void* memory) noexcept {
+  free(memory);
+}
+
+void operator delete[](void* memory) noexcept {
+  free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept {
+  free(memory);
+}
+
+void operator delete[](void* memory, size_t) noexcept {
+  free(memory);
+}
+#endif
+
+#endif
@@ -0,0 +1,83 @@
+/*
+ * include/vertex.h
+ *
+ * Vertex layouts shared by the runtime and the offline asset tools.
+ */
+
+#ifndef VERTEX_H
+#define VERTEX_H
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+struct Vertex {
+  glm::vec3 Position;
+  glm::vec3 Normal;
+  glm::vec2 TexCoords;
+};
+
+/* Mesh uploads arrays of Vertex as they are */
+static_assert(sizeof(Vertex) == 8 * sizeof(float), "Vertex must match the POSITION_NORMAL_TEXTURE layout");
+
+
+/*
+ * Define what vertex attributes are used and in what order. If a normal or
+ * texture vector/coordinate isn't needed, there is no point in storing that
+ * data
+ */
+enum VertexAttributes {
+  POSITION,
+  POSITION_NORMAL,
+  POSITION_TEXTURE,
+  POSITION_NORMAL_TEXTURE,
+  /*
+   * Quantized POSITION_NORMAL_TEXTURE (see quantize.h). Positions are unsigned
+   * normalized relative to the mesh bounds and need the mesh's dequantize
+   * matrix; normals are signed normalized 10:10:10:2 and UVs half floats.
+   *   QUANTIZED16: position 16 bit x3 + padding, normal, UV
+   *   QUANTIZED12: position 10:10:10:2, normal, UV
+   */
+  POSITION_NORMAL_TEXTURE_QUANTIZED16,
+  POSITION_NORMAL_TEXTURE_QUANTIZED12,
+};
+
+/* Size in bytes of one vertex in each layout */
+unsigned int vertexStride(enum VertexAttributes vertexAttributes) {
+  switch (vertexAttributes) {
+    case POSITION: return 3 * sizeof(float);
+    case POSITION_NORMAL: return 6 * sizeof(float);
+    case POSITION_TEXTURE: return 5 * sizeof(float);
+    case POSITION_NORMAL_TEXTURE: return 8 * sizeof(float);
+    case POSITION_NORMAL_TEXTURE_QUANTIZED16: return 16;
+    case POSITION_NORMAL_TEXTURE_QUANTIZED12: return 12;
+  }
+  return 0;
+}
+
+/*
+ * Size in bytes of one vertex of the position-only stream that goes with
+ * each layout (see VertexDataObject). Position always comes first in a
+ * vertex, so this is also how many leading bytes of it are the position;
+ * QUANTIZED16 keeps its padding so positions stay 4 byte aligned.
+ */
+unsigned int positionStride(enum VertexAttributes vertexAttributes) {
+  switch (vertexAttributes) {
+    case POSITION_NORMAL_TEXTURE_QUANTIZED16: return 8;
+    case POSITION_NORMAL_TEXTURE_QUANTIZED12: return 4;
+    default: return 3 * sizeof(float);
+  }
+}
+
+/* Copy the positions of count interleaved vertices into a tightly packed position stream */
+void copyPositions(const void* vertices, size_t count, enum VertexAttributes vertexAttributes, void* out) {
+  size_t stride = vertexStride(vertexAttributes);
+  size_t size = positionStride(vertexAttributes);
+  for (size_t i = 0; i < count; ++i) {
+    memcpy((uint8_t*)out + i * size, (const uint8_t*)vertices + i * stride, size);
+  }
+}
+
+#endif
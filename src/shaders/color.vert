@@ -2,10 +2,10 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec3 aTexCoord;
+layout (location = 3) in mat4 aInstanceModel; /* Identity unless drawn instanced */
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+#include "include/camera.glsl"
 
 out vec3 Normal;
 out vec3 FragPos;  
@@ -13,8 +13,9 @@ out vec3 TexCoord;
 
 void main()
 {
-  gl_Position = projection * view * model * vec4(aPos, 1.0);
-  Normal = mat3(transpose(model)) * aNormal;  
-  FragPos = vec3(model * vec4(aPos, 1.0));
+  mat4 world = model * aInstanceModel;
+  gl_Position = viewProjection * world * vec4(aPos, 1.0);
+  Normal = mat3(transpose(world)) * aNormal;  
+  FragPos = vec3(world * vec4(aPos, 1.0));
   TexCoord = aTexCoord;
 }       
@@ -0,0 +1,61 @@
+#version 330 core
+/*
+ * Lighting pass of the deferred path. Reads the G-buffer, rebuilds the world
+ * position from depth and shades the directional light and the point lights
+ * of the pixel's cluster, so every pixel is lit once however much geometry
+ * was drawn over it. DeferredRenderer compiles it with DIRECTIONAL_LIGHT
+ * and FOG as needed.
+ */
+out vec4 FragColor;
+
+in vec2 ScreenCoords;
+
+#include "include/camera.glsl"
+#include "include/lights.glsl"
+#include "include/clusters.glsl"
+#include "include/gbuffer.glsl"
+
+uniform sampler2D gAlbedoSpecular;
+uniform sampler2D gNormalShininess;
+uniform sampler2D gDepth;
+uniform mat4 inverseViewProjection;
+
+void main()
+{
+  float depth = texture(gDepth, ScreenCoords).r;
+  if (depth >= 1.0)
+  {
+    /* Nothing was drawn here; leave the clear colour */
+    discard;
+  }
+
+  vec4 clip = inverseViewProjection * vec4(vec3(ScreenCoords, depth) * 2.0 - 1.0, 1.0);
+  vec3 position = clip.xyz / clip.w;
+
+  vec4 albedoSpecular = texture(gAlbedoSpecular, ScreenCoords);
+  vec4 normalShininess = texture(gNormalShininess, ScreenCoords);
+  vec3 albedo = albedoSpecular.rgb;
+  vec3 specularColor = vec3(albedoSpecular.a);
+  vec3 normal = decodeNormal(normalShininess.xy);
+  float shininess = max(normalShininess.z * GBUFFER_MAX_SHININESS, 1.0);
+
+  vec3 viewDir = normalize(viewPosition.xyz - position);
+  vec3 result = vec3(0.0);
+
+#ifdef DIRECTIONAL_LIGHT
+  result += phongDirectionalLight(normal, viewDir, albedo, specularColor, shininess);
+#endif
+
+  uvec2 cluster = clusterLights(position);
+  for (uint i = 0u; i < cluster.y; i++)
+  {
+    PointLight light = clusterLight(cluster.x + i);
+    result += phongPointLight(light, light.specular.w, position, normal, viewDir, albedo, specularColor, shininess);
+  }
+
+#ifdef FOG
+  result = applyFog(result, length(viewPosition.xyz - position));
+#endif
+
+  FragColor = vec4(result, 1.0);
+}
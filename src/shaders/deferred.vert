@@ -0,0 +1,10 @@
+#version 330 core
+/* One triangle covering the screen, made from gl_VertexID with no vertex buffer */
+out vec2 ScreenCoords;
+
+void main()
+{
+  vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+  ScreenCoords = corner;
+  gl_Position = vec4(corner * 2.0 - 1.0, 0.0, 1.0);
+}
@@ -0,0 +1,18 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 3) in mat4 aInstanceModel; /* Identity unless drawn instanced */
+
+#include "include/camera.glsl"
+
+/* Must match phong.vert's position exactly for the GL_EQUAL colour pass */
+invariant gl_Position;
+
+uniform mat4 model;
+
+void main()
+{
+  mat4 world = model * aInstanceModel;
+  vec3 FragPos = vec3(world * vec4(aPos, 1.0));
+
+  gl_Position = viewProjection * vec4(FragPos, 1.0);
+}
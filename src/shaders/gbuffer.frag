@@ -0,0 +1,40 @@
+#version 330 core
+/*
+ * Geometry pass of the deferred path: the material half of phong.frag,
+ * written to the G-buffer instead of lit. PhongShader compiles it with
+ * DIFFUSE_MAP and SPECULAR_MAP like the forward variants.
+ */
+layout (location = 0) out vec4 gAlbedoSpecular;
+layout (location = 1) out vec4 gNormalShininess;
+
+in vec3 FragPos;
+in vec3 Normal;
+in vec2 TexCoords;
+
+#include "include/gbuffer.glsl"
+
+#ifdef DIFFUSE_MAP
+uniform sampler2D diffuseMap;
+#endif
+#ifdef SPECULAR_MAP
+uniform sampler2D specularMap;
+#endif
+uniform vec3 materialDiffuse = vec3(1.0);
+uniform vec3 materialSpecular = vec3(0.5);
+uniform float materialShininess = 32.0;
+
+void main()
+{
+  vec3 albedo = materialDiffuse;
+#ifdef DIFFUSE_MAP
+  albedo *= texture(diffuseMap, TexCoords).rgb;
+#endif
+  vec3 specularColor = materialSpecular;
+#ifdef SPECULAR_MAP
+  specularColor = texture(specularMap, TexCoords).rgb;
+#endif
+
+  /* Specular colour is kept as its intensity only */
+  gAlbedoSpecular = vec4(albedo, dot(specularColor, vec3(1.0 / 3.0)));
+  gNormalShininess = vec4(encodeNormal(normalize(Normal)), clamp(materialShininess / GBUFFER_MAX_SHININESS, 0.0, 1.0), 0.0);
+}
@@ -0,0 +1,7 @@
+/* Camera matrices, written once per frame by Engine::refresh (CameraUniforms in camera.h) */
+layout (std140) uniform Camera {
+  mat4 view;
+  mat4 projection;
+  mat4 viewProjection;
+  vec4 viewPosition;
+};
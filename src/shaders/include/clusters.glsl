@@ -0,0 +1,32 @@
+/* Clustered point lights, assigned every frame by LightClusters (include/clusters.h) */
+#include "camera.glsl"
+#include "lights.glsl"
+
+/* Keep in sync with CLUSTER_TILES_X, CLUSTER_TILES_Y and CLUSTER_SLICES */
+#define CLUSTER_TILES_X 16
+#define CLUSTER_TILES_Y 9
+#define CLUSTER_SLICES 24
+
+uniform samplerBuffer lightData;       /* Four texels per light, in PointLight order */
+uniform usamplerBuffer clusterRecords; /* Per cluster: first entry in lightIndices, light count */
+uniform usamplerBuffer lightIndices;
+
+/* The first lightIndices entry and the number of lights of the cluster holding this fragment */
+uvec2 clusterLights(vec3 worldPosition)
+{
+  float depth = -(view * vec4(worldPosition, 1.0)).z;
+  int slice = clamp(int(log(max(depth, 1e-6)) * clusterParameters.z + clusterParameters.w), 0, CLUSTER_SLICES - 1);
+  ivec2 tile = clamp(ivec2(gl_FragCoord.xy * clusterParameters.xy), ivec2(0), ivec2(CLUSTER_TILES_X - 1, CLUSTER_TILES_Y - 1));
+  return texelFetch(clusterRecords, tile.x + CLUSTER_TILES_X * (tile.y + CLUSTER_TILES_Y * slice)).xy;
+}
+
+PointLight clusterLight(uint entry)
+{
+  int base = int(texelFetch(lightIndices, int(entry)).x) * 4;
+  PointLight light;
+  light.position = texelFetch(lightData, base);
+  light.ambient = texelFetch(lightData, base + 1);
+  light.diffuse = texelFetch(lightData, base + 2);
+  light.specular = texelFetch(lightData, base + 3);
+  return light;
+}
@@ -0,0 +1,34 @@
+/*
+ * G-buffer layout (include/deferred.h), 8 bytes per pixel plus depth:
+ *
+ *   0  RGBA8     albedo, specular intensity
+ *   1  RGB10_A2  octahedral normal, shininess / GBUFFER_MAX_SHININESS
+ *
+ * Position is not stored; the lighting pass rebuilds it from depth.
+ */
+
+/* Keep in sync with GBUFFER_MAX_SHININESS */
+#define GBUFFER_MAX_SHININESS 256.0
+
+vec2 octahedralWrap(vec2 v)
+{
+  return (1.0 - abs(v.yx)) * vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+/* Unit normal to [0, 1]^2 */
+vec2 encodeNormal(vec3 n)
+{
+  n /= abs(n.x) + abs(n.y) + abs(n.z);
+  vec2 folded = n.z >= 0.0 ? n.xy : octahedralWrap(n.xy);
+  return folded * 0.5 + 0.5;
+}
+
+vec3 decodeNormal(vec2 encoded)
+{
+  vec2 f = encoded * 2.0 - 1.0;
+  vec3 n = vec3(f, 1.0 - abs(f.x) - abs(f.y));
+  float t = clamp(-n.z, 0.0, 1.0);
+  n.x += n.x >= 0.0 ? -t : t;
+  n.y += n.y >= 0.0 ? -t : t;
+  return normalize(n);
+}
@@ -0,0 +1,58 @@
+/*
+ * Scene lights and fog, written once per frame by Engine::refresh
+ * (LightingUniforms in lighting.h), and the Phong terms the forward and
+ * deferred shaders share.
+ */
+
+/* Keep in sync with LIGHTING_MAX_POINT_LIGHTS */
+#define MAX_POINT_LIGHTS 16
+
+struct PointLight {
+  vec4 position; /* w constant attenuation */
+  vec4 ambient;  /* w linear attenuation */
+  vec4 diffuse;  /* w quadratic attenuation */
+  vec4 specular;  /* w range, in the clustered light buffer only */
+};
+
+layout (std140) uniform Lights {
+  vec4 directionalDirection;
+  vec4 directionalAmbient;
+  vec4 directionalDiffuse;
+  vec4 directionalSpecular;
+  vec4 fog; /* rgb colour, a density */
+  vec4 clusterParameters; /* Tiles per pixel in xy; slice = log(depth) * z + w */
+  PointLight pointLights[MAX_POINT_LIGHTS];
+};
+
+/* One light's contribution; lightDir points from the surface to the light */
+vec3 phongLight(vec3 lightDir, vec3 ambient, vec3 diffuse, vec3 specular, vec3 normal, vec3 viewDir, vec3 albedo, vec3 specularColor, float shininess)
+{
+  float diff = max(dot(normal, lightDir), 0.0);
+  vec3 reflectDir = reflect(-lightDir, normal);
+  float spec = pow(max(dot(viewDir, reflectDir), 0.0), shininess);
+  return ambient * albedo + diffuse * diff * albedo + specular * spec * specularColor;
+}
+
+vec3 phongDirectionalLight(vec3 normal, vec3 viewDir, vec3 albedo, vec3 specularColor, float shininess)
+{
+  return phongLight(normalize(-directionalDirection.xyz), directionalAmbient.rgb, directionalDiffuse.rgb, directionalSpecular.rgb, normal, viewDir, albedo, specularColor, shininess);
+}
+
+/* A point light with attenuation; past range it is off */
+vec3 phongPointLight(PointLight light, float range, vec3 position, vec3 normal, vec3 viewDir, vec3 albedo, vec3 specularColor, float shininess)
+{
+  vec3 toLight = light.position.xyz - position;
+  float lightDistance = length(toLight);
+  if (lightDistance >= range)
+  {
+    return vec3(0.0);
+  }
+  float attenuation = 1.0 / (light.position.w + light.ambient.w * lightDistance + light.diffuse.w * (lightDistance * lightDistance));
+  return attenuation * phongLight(toLight / lightDistance, light.ambient.rgb, light.diffuse.rgb, light.specular.rgb, normal, viewDir, albedo, specularColor, shininess);
+}
+
+/* Exponential fog over the distance from the eye */
+vec3 applyFog(vec3 color, float eyeDistance)
+{
+  return mix(fog.rgb, color, exp(-fog.a * eyeDistance));
+}
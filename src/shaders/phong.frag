@@ -0,0 +1,78 @@
+#version 330 core
+/*
+ * Phong uber-shader. PhongShader (include/phong.h) compiles one variant per
+ * feature set with these defines:
+ *
+ *   DIFFUSE_MAP, SPECULAR_MAP  sample diffuseMap / specularMap instead of the constant colours
+ *   DIRECTIONAL_LIGHT          add the directional light
+ *   POINT_LIGHTS n             add the first n point lights
+ *   CLUSTERED_LIGHTS           add the point lights of this fragment's cluster
+ *   FOG                        exponential distance fog
+ */
+out vec4 FragColor;
+
+in vec3 FragPos;
+in vec3 Normal;
+in vec2 TexCoords;
+
+#include "include/camera.glsl"
+#include "include/lights.glsl"
+#ifdef CLUSTERED_LIGHTS
+#include "include/clusters.glsl"
+#endif
+
+#ifndef POINT_LIGHTS
+#define POINT_LIGHTS 0
+#endif
+
+#ifdef DIFFUSE_MAP
+uniform sampler2D diffuseMap;
+#endif
+#ifdef SPECULAR_MAP
+uniform sampler2D specularMap;
+#endif
+uniform vec3 materialDiffuse = vec3(1.0);  /* Multiplies the diffuse map when there is one */
+uniform vec3 materialSpecular = vec3(0.5); /* Used without a specular map */
+uniform float materialShininess = 32.0;
+
+void main()
+{
+  vec3 albedo = materialDiffuse;
+#ifdef DIFFUSE_MAP
+  albedo *= texture(diffuseMap, TexCoords).rgb;
+#endif
+  vec3 specularColor = materialSpecular;
+#ifdef SPECULAR_MAP
+  specularColor = texture(specularMap, TexCoords).rgb;
+#endif
+
+  vec3 normal = normalize(Normal);
+  vec3 viewDir = normalize(viewPosition.xyz - FragPos);
+  vec3 result = vec3(0.0);
+
+#ifdef DIRECTIONAL_LIGHT
+  result += phongDirectionalLight(normal, viewDir, albedo, specularColor, materialShininess);
+#endif
+
+#if POINT_LIGHTS > 0
+  for (int i = 0; i < POINT_LIGHTS; i++)
+  {
+    result += phongPointLight(pointLights[i], 1e30, FragPos, normal, viewDir, albedo, specularColor, materialShininess);
+  }
+#endif
+
+#ifdef CLUSTERED_LIGHTS
+  uvec2 cluster = clusterLights(FragPos);
+  for (uint i = 0u; i < cluster.y; i++)
+  {
+    PointLight light = clusterLight(cluster.x + i);
+    result += phongPointLight(light, light.specular.w, FragPos, normal, viewDir, albedo, specularColor, materialShininess);
+  }
+#endif
+
+#ifdef FOG
+  result = applyFog(result, length(viewPosition.xyz - FragPos));
+#endif
+
+  FragColor = vec4(result, 1.0);
+}
@@ -0,0 +1,27 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+layout (location = 3) in mat4 aInstanceModel; /* Identity unless drawn instanced */
+
+#include "include/camera.glsl"
+
+/* DepthPrepass draws the same positions with depth.vert and tests them with GL_EQUAL */
+invariant gl_Position;
+
+out vec3 FragPos;
+out vec3 Normal;
+out vec2 TexCoords;
+
+uniform mat4 model;
+uniform mat3 normalMatrix; /* Inverse transpose of model, from the CPU; instances are assumed to scale uniformly */
+
+void main()
+{
+  mat4 world = model * aInstanceModel;
+  FragPos = vec3(world * vec4(aPos, 1.0));
+  Normal = normalMatrix * (mat3(aInstanceModel) * aNormal);
+  TexCoords = aTexCoords;
+
+  gl_Position = viewProjection * vec4(FragPos, 1.0);
+}
@@ -1,20 +0,0 @@
-#version 330 core
-layout (location = 0) in vec3 aPos;
-layout (location = 1) in vec3 aNormal;
-layout (location = 2) in vec3 aTexCoord;
-
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
-
-out vec3 Normal;
-out vec3 FragPos;  
-out vec3 TexCoord;
-
-void main()
-{
-  gl_Position = projection * view * model * vec4(aPos, 1.0);
-  Normal = mat3(transpose(model)) * aNormal;  
-  FragPos = vec3(model * vec4(aPos, 1.0));
-  TexCoord = aTexCoord;
-}       
@@ -1,94 +0,0 @@
-#version 330 core
-out vec4 FragColor;
-
-struct Material {
-  sampler2D diffuse;
-  sampler2D specular;    
-  float shininess;
-}; 
-
-struct PointLight {    
-  vec3 position;
-
-  float constant;
-  float linear;
-  float quadratic;  
-
-  vec3 ambient;
-  vec3 diffuse;
-  vec3 specular;
-};  
-
-struct DirLight {
-  vec3 direction;
-
-  vec3 ambient;
-  vec3 diffuse;
-  vec3 specular;
-};
-
-in vec3 FragPos;  
-in vec3 Normal;  
-in vec2 TexCoords;
-
-uniform vec3 viewPos;
-uniform Material material;
-
-// TODO Specify multiple point lights
-#define NR_POINT_LIGHTS 3  
-uniform PointLight pointLights[NR_POINT_LIGHTS];
-uniform DirLight dirLight;
-
-vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir)
-{
-  vec3 lightDir = normalize(-light.direction);
-  // diffuse shading
-  float diff = max(dot(normal, lightDir), 0.0);
-  // specular shading
-  vec3 reflectDir = reflect(-lightDir, normal);
-  float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
-  // combine results
-  vec3 ambient  = light.ambient  * vec3(texture(material.diffuse, TexCoords));
-  vec3 diffuse  = light.diffuse  * diff * vec3(texture(material.diffuse, TexCoords));
-  vec3 specular = light.specular * spec * vec3(texture(material.specular, TexCoords));
-  return (ambient + diffuse + specular);
-}  
-
-vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
-{
-  vec3 lightDir = normalize(light.position - fragPos);
-  // diffuse shading
-  float diff = max(dot(normal, lightDir), 0.0);
-  // specular shading
-  vec3 reflectDir = reflect(-lightDir, normal);
-  float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
-  // attenuation
-  float distance    = length(light.position - fragPos);
-  float attenuation = 1.0 / (light.constant + light.linear * distance + 
-    light.quadratic * (distance * distance));    
-  // combine results
-  vec3 ambient  = light.ambient  * vec3(texture(material.diffuse, TexCoords));
-  vec3 diffuse  = light.diffuse  * diff * vec3(texture(material.diffuse, TexCoords));
-  vec3 specular = light.specular * spec * vec3(texture(material.specular, TexCoords));
-  ambient  *= attenuation;
-  diffuse  *= attenuation;
-  specular *= attenuation;
-  return (ambient + diffuse + specular);
-} 
-
-void main()
-{
-    // properties
-    vec3 norm = normalize(Normal);
-    vec3 viewDir = normalize(viewPos - FragPos);
-
-    // phase 1: Directional lighting
-    vec3 result = CalcDirLight(dirLight, norm, viewDir);
-    // phase 2: Point lights
-    for(int i = 0; i < NR_POINT_LIGHTS; i++)
-        result += CalcPointLight(pointLights[i], norm, FragPos, viewDir);    
-    // phase 3: Spot light
-    //result += CalcSpotLight(spotLight, norm, FragPos, viewDir);    
-    
-    FragColor = vec4(result, 1.0);
-}
@@ -2,15 +2,19 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aColor;
 layout (location = 2) in vec2 aTexCoord;
+layout (location = 3) in mat4 aInstanceModel; /* Identity unless drawn instanced */
 
 out vec3 ourColor;
 out vec2 TexCoord;
 
-uniform mat4 mvp;
+uniform mat4 model;
+
+#include "../include/camera.glsl"
 
 void main()
 {
-    gl_Position = mvp * vec4(aPos, 1.0);
+    mat4 world = model * aInstanceModel;
+    gl_Position = viewProjection * world * vec4(aPos, 1.0);
     ourColor = aColor;
     TexCoord = aTexCoord;
 }       
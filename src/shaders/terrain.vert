@@ -2,14 +2,15 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
+layout (location = 3) in mat4 aInstanceModel; /* Identity unless drawn instanced */
 
 out vec3 FragPos;
 out vec3 Normal;
 out vec2 TexCoords;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+uniform mat3 normalMatrix; /* Inverse transpose of model, from the CPU; instances are assumed to scale uniformly */
+#include "include/camera.glsl"
 
 uniform vec3 cameraPos;
 
@@ -53,13 +54,14 @@ float pNoise(vec2 p, float freq, int res){
 }
 
 void main() {
+    mat4 world = model * aInstanceModel;
     vec3 displacement = aPos;
 
     displacement.y += pNoise(vec2(displacement.x, displacement.z), 0.5, 50) * 1;
 
-    FragPos = vec3(model * vec4(displacement, 1.0));
-    Normal = mat3(transpose(inverse(model))) * aNormal;
+    FragPos = vec3(world * vec4(displacement, 1.0));
+    Normal = normalMatrix * (mat3(aInstanceModel) * aNormal);
     TexCoords = aTexCoords;
 
-    gl_Position = projection * view * vec4(FragPos, 1.0);
+    gl_Position = viewProjection * vec4(FragPos, 1.0);
 }
@@ -0,0 +1,34 @@
+/*
+ * tools/cook.cpp
+ *
+ * Offline cook step for models. Converts anything assimp can read into the
+ * .nmesh container that Model memory maps at runtime (see include/meshfile.h).
+ *
+ * Build: g++ -std=c++17 -O2 -Iinclude tools/cook.cpp -lassimp -pthread -o cook
+ * Usage: ./cook <model> [output]
+ *
+ * Without an output path the result is written next to the model as
+ * <model>.nmesh, which is where Model looks for it. Each mesh is welded and
+ * reordered on the way (see include/meshopt.h) and its before/after vertex
+ * cache (ACMR/ATVR) and vertex fetch statistics are printed.
+ */
+
+#include <meshcook.h>
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    std::cout << "Usage: " << argv[0] << " <model> [output]" << std::endl;
+    return 1;
+  }
+
+  std::string source = argv[1];
+  std::string output = argc > 2 ? argv[2] : source + MESH_FILE_EXTENSION;
+
+  MeshCooker cooker;
+  if (!cooker.cook(source, output)) {
+    return 1;
+  }
+
+  std::cout << "NEPTUNE::INFO: Cooked " << source << " -> " << output << std::endl;
+  return 0;
+}
@@ -0,0 +1,51 @@
+/*
+ * tools/importbench.cpp
+ *
+ * Times the CPU side of model import (assimp, mesh conversion and image
+ * decoding; see include/importer.h) without a window or GL context, so import
+ * throughput can be compared across worker counts. Peak resident memory is
+ * reported too, since that is what large models run out of first.
+ *
+ * Build: g++ -std=c++17 -O2 -Iinclude tools/importbench.cpp -lassimp -pthread -o importbench
+ * Usage: ./importbench <model> [workers] [runs]
+ */
+
+#include <chrono>
+
+#include <sys/resource.h>
+
+#include <importer.h>
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    std::cout << "Usage: " << argv[0] << " <model> [workers] [runs]" << std::endl;
+    return 1;
+  }
+
+  std::string source = argv[1];
+  if (argc > 2) {
+    JobSystem::start(std::stoi(argv[2]));
+  }
+  int runs = argc > 3 ? std::stoi(argv[3]) : 5;
+
+  double best = 0.0;
+  for (int run = 0; run < runs; ++run) {
+    auto start = std::chrono::steady_clock::now();
+
+    ImportedModel model;
+    if (!importModel(source, model, true)) {
+      return 1;
+    }
+
+    double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    best = run == 0 ? milliseconds : std::min(best, milliseconds);
+
+    std::cout << "run " << run << ": " << milliseconds << " ms (" << model.meshes.size() << " meshes, " << model.images.size() << " images)" << std::endl;
+  }
+
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+
+  std::cout << "NEPTUNE::INFO: " << JobSystem::workerCount() << " workers, best of " << runs << ": " << best << " ms, peak memory " << usage.ru_maxrss / 1024 << " MiB" << std::endl;
+  return 0;
+}
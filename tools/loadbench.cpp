@@ -0,0 +1,228 @@
+/*
+ * tools/loadbench.cpp
+ *
+ * Loads every asset under a directory the way the engine does, minus the GL
+ * calls, and prints where the time went per phase (see include/trace.h). The
+ * first run starts from a cold page cache: every file (and the pack, if one is
+ * given) is evicted with posix_fadvise first. Later runs are warm; the best
+ * one is reported next to it.
+ *
+ * Build: g++ -std=c++17 -O2 -Iinclude tools/loadbench.cpp -lassimp -pthread -o loadbench
+ * Usage: ./loadbench <directory> [--pack <file.npak>] [--workers <n>] [--runs <n>] [--trace <file.json>]
+ *
+ * Shaders are read but not compiled and images are decoded but not uploaded,
+ * since there is no context; time the GL side by setting Trace::enabled in the
+ * engine and writing a trace. Models are imported with their images. .mtl and
+ * other files a model pulls in are only read through the model. With --trace
+ * the warm run that was reported is written as a Chrome trace.
+ */
+
+#define NEPTUNE_TRACE_ALLOCATIONS
+#include <trace.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <archive.h>
+#include <importer.h>
+#include <meshfile.h>
+
+#include <cctype>
+#include <cstdio>
+
+enum AssetKind {
+  ASSET_SHADER,
+  ASSET_IMAGE,
+  ASSET_TEXTURE_FILE,
+  ASSET_COOKED_MESH,
+  ASSET_MODEL,
+  ASSET_OTHER
+};
+
+struct BenchAsset {
+  std::string path;
+  enum AssetKind kind;
+};
+
+enum AssetKind assetKind(std::string extension) {
+  std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+  for (const char* shader : { ".vert", ".frag", ".geom", ".glsl" }) {
+    if (extension == shader) return ASSET_SHADER;
+  }
+  for (const char* image : { ".png", ".jpg", ".jpeg", ".tga", ".bmp", ".hdr" }) {
+    if (extension == image) return ASSET_IMAGE;
+  }
+  for (const char* model : { ".obj", ".fbx", ".gltf", ".glb", ".dae", ".3ds", ".ply", ".stl" }) {
+    if (extension == model) return ASSET_MODEL;
+  }
+  if (extension == ".dds" || extension == ".ktx2") return ASSET_TEXTURE_FILE;
+  if (extension == MESH_FILE_EXTENSION) return ASSET_COOKED_MESH;
+  return ASSET_OTHER;
+}
+
+/* Drop path from the page cache so the next read comes from the device */
+void evict(const std::string& path) {
+  int descriptor = open(path.c_str(), O_RDONLY);
+  if (descriptor >= 0) {
+    posix_fadvise(descriptor, 0, 0, POSIX_FADV_DONTNEED);
+    close(descriptor);
+  }
+}
+
+/* Mapped files are only read when touched; the engine touches them when uploading */
+uint64_t touch(const unsigned char* data, size_t size) {
+  uint64_t sum = 0;
+  for (size_t i = 0; i < size; i += 4096) {
+    sum += data[i];
+  }
+  return sum;
+}
+
+/* Load every asset once and return the wall time in milliseconds */
+double loadAll(const std::vector<BenchAsset>& assets, uint64_t& checksum) {
+  auto start = std::chrono::steady_clock::now();
+  for (const BenchAsset& asset : assets) {
+    switch (asset.kind) {
+      case ASSET_SHADER: {
+        TraceScope trace("shader", "read", asset.path);
+        AssetFile file;
+        if (file.open(asset.path)) {
+          std::string source((const char*)file.data, file.size);
+          checksum += source.size();
+        }
+        break;
+      }
+      case ASSET_IMAGE: {
+        TraceScope trace("texture", "load", asset.path);
+        DecodedImage image;
+        image.load(asset.path.c_str(), 4);
+        checksum += image.width;
+        break;
+      }
+      case ASSET_TEXTURE_FILE: {
+        TraceScope trace("texture", "read", asset.path);
+        TextureFile file;
+        if (file.load(asset.path)) {
+          checksum += touch(file.file.data, file.file.size);
+        }
+        break;
+      }
+      case ASSET_COOKED_MESH: {
+        TraceScope trace("model", "read", asset.path);
+        AssetFile file;
+        const MeshFileHeader* header;
+        const char* strings;
+        if (file.open(asset.path) && meshFileEntries(file, header, strings) != nullptr) {
+          checksum += touch(file.data, file.size);
+        }
+        break;
+      }
+      case ASSET_MODEL: {
+        TraceScope trace("model", "load", asset.path);
+        ImportedModel model;
+        if (importModel(asset.path, model, true)) {
+          checksum += model.meshes.size();
+        }
+        break;
+      }
+      case ASSET_OTHER:
+        break;
+    }
+  }
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void printPhases(const char* title, double milliseconds, const std::vector<TracePhase>& phases) {
+  printf("%s: %.2f ms\n", title, milliseconds);
+  printf("  %-18s %7s %11s %11s %11s %12s\n", "phase", "count", "ms", "read MiB", "upload MiB", "allocations");
+  for (const TracePhase& phase : phases) {
+    std::string name = phase.category + " " + phase.name;
+    printf("  %-18s %7zu %11.2f %11.2f %11.2f %12llu\n", name.c_str(), phase.count, phase.milliseconds,
+           phase.counters.bytesRead / 1048576.0, phase.counters.bytesUploaded / 1048576.0, (unsigned long long)phase.counters.allocations);
+  }
+}
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    std::cout << "Usage: " << argv[0] << " <directory> [--pack <file.npak>] [--workers <n>] [--runs <n>] [--trace <file.json>]" << std::endl;
+    return 1;
+  }
+
+  std::string directory = argv[1];
+  std::string pack, tracePath;
+  int runs = 5;
+  for (int i = 2; i + 1 < argc; i += 2) {
+    std::string option = argv[i];
+    if (option == "--pack") {
+      pack = argv[i + 1];
+    } else if (option == "--workers") {
+      JobSystem::start(std::stoi(argv[i + 1]));
+    } else if (option == "--runs") {
+      runs = std::max(2, std::stoi(argv[i + 1]));
+    } else if (option == "--trace") {
+      tracePath = argv[i + 1];
+    } else {
+      std::cout << "ERROR::LOADBENCH::UNKNOWN_OPTION: " << option << std::endl;
+      return 1;
+    }
+  }
+
+  /* Assets are listed from disk and loaded by the same paths, so a mounted pack serves any it holds */
+  std::vector<BenchAsset> assets;
+  std::vector<std::string> files;
+  std::error_code error;
+  for (const auto& item : std::filesystem::recursive_directory_iterator(directory, error)) {
+    if (!item.is_regular_file(error)) {
+      continue;
+    }
+    std::string path = item.path().generic_string();
+    files.push_back(path);
+    enum AssetKind kind = assetKind(item.path().extension().string());
+    if (kind != ASSET_OTHER) {
+      assets.push_back({ path, kind });
+    }
+  }
+  std::sort(assets.begin(), assets.end(), [](const BenchAsset& a, const BenchAsset& b) { return a.path < b.path; });
+
+  if (assets.empty()) {
+    std::cout << "ERROR::LOADBENCH::NO_ASSETS: " << directory << std::endl;
+    return 1;
+  }
+
+  for (const std::string& file : files) {
+    evict(file);
+  }
+  if (!pack.empty()) {
+    /* Evicted before mounting, so the table of contents is read cold too */
+    evict(pack);
+    if (!AssetArchive::mount(pack)) {
+      return 1;
+    }
+  }
+
+  Trace::enabled = true;
+  uint64_t checksum = 0;
+
+  double cold = loadAll(assets, checksum);
+  std::vector<TracePhase> coldPhases = Trace::phases();
+
+  double warm = 0.0;
+  std::vector<TracePhase> warmPhases;
+  for (int run = 1; run < runs; ++run) {
+    Trace::clear();
+    double milliseconds = loadAll(assets, checksum);
+    if (run == 1 || milliseconds < warm) {
+      warm = milliseconds;
+      warmPhases = Trace::phases();
+      if (!tracePath.empty() && !Trace::write(tracePath)) {
+        return 1;
+      }
+    }
+  }
+
+  printf("NEPTUNE::INFO: %zu assets, %u workers%s (checksum %llu)\n", assets.size(), JobSystem::workerCount(),
+         pack.empty() ? "" : ", packed", (unsigned long long)checksum);
+  printPhases("cold", cold, coldPhases);
+  printPhases("warm (best)", warm, warmPhases);
+  return 0;
+}
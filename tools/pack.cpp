@@ -0,0 +1,145 @@
+/*
+ * tools/pack.cpp
+ *
+ * Builds an asset pack (see include/archive.h) out of files and directories,
+ * which are walked recursively. Mount the result with AssetArchive::mount
+ * before loading and every Shader, Texture and Model path inside it is read
+ * from the pack instead of from disk.
+ *
+ * Build: g++ -std=c++17 -O2 -Iinclude tools/pack.cpp -o pack
+ * Usage: ./pack <output.npak> <file or directory>... [--store]
+ *
+ * Entries are stored under their paths as given, relative to the directory the
+ * engine runs from (e.g. "src/shaders/color.vert"). Each one is LZ4
+ * compressed unless that saves less than a tenth of it, as with PNG, JPEG or
+ * block compressed DDS data; those stay stored so they are read in place.
+ * --store stores everything.
+ */
+
+#include <archive.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+
+/* Compressed entries must come out at most this fraction of their size */
+#define PACK_MIN_SAVING 0.9
+
+struct PackedFile {
+  std::string path;   /* Normalized, as looked up */
+  std::string source; /* On disk */
+};
+
+bool readFile(const std::string& path, std::vector<uint8_t>& data) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    return false;
+  }
+  data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+  return !file.bad();
+}
+
+void pad(std::vector<uint8_t>& blob, size_t alignment) {
+  blob.resize((blob.size() + alignment - 1) / alignment * alignment, 0);
+}
+
+int main(int argc, char** argv) {
+  if (argc < 3) {
+    std::cout << "Usage: " << argv[0] << " <output.npak> <file or directory>... [--store]" << std::endl;
+    return 1;
+  }
+
+  std::string output = argv[1];
+  bool store = false;
+  std::vector<PackedFile> files;
+
+  for (int i = 2; i < argc; ++i) {
+    std::string argument = argv[i];
+    if (argument == "--store") {
+      store = true;
+      continue;
+    }
+
+    std::error_code error;
+    if (std::filesystem::is_directory(argument, error)) {
+      for (const auto& item : std::filesystem::recursive_directory_iterator(argument, error)) {
+        std::string source = item.path().generic_string();
+        /* Never pack a pack, least of all the one being written */
+        if (item.is_regular_file(error) && item.path().extension() != ARCHIVE_EXTENSION) {
+          files.push_back({ AssetArchive::normalize(source), source });
+        }
+      }
+    } else if (std::filesystem::is_regular_file(argument, error)) {
+      files.push_back({ AssetArchive::normalize(argument), argument });
+    } else {
+      std::cout << "ERROR::PACK::FILE_NOT_FOUND: " << argument << std::endl;
+      return 1;
+    }
+  }
+
+  /* Sorted so packs are reproducible and neighbouring assets sit next to each other */
+  std::sort(files.begin(), files.end(), [](const PackedFile& a, const PackedFile& b) { return a.path < b.path; });
+  files.erase(std::unique(files.begin(), files.end(), [](const PackedFile& a, const PackedFile& b) { return a.path == b.path; }), files.end());
+
+  std::vector<ArchiveEntry> entries(files.size());
+  std::string strings;
+  for (size_t i = 0; i < files.size(); ++i) {
+    entries[i].path = (uint32_t)strings.size();
+    strings += files[i].path;
+    strings += '\0';
+  }
+
+  size_t tableSize = sizeof(ArchiveHeader) + entries.size() * sizeof(ArchiveEntry) + strings.size();
+  size_t blobStart = (tableSize + ARCHIVE_ALIGNMENT - 1) / ARCHIVE_ALIGNMENT * ARCHIVE_ALIGNMENT;
+
+  std::vector<uint8_t> blobs;
+  size_t totalSize = 0, compressedCount = 0;
+  std::vector<uint8_t> data, compressed;
+  for (size_t i = 0; i < files.size(); ++i) {
+    if (!readFile(files[i].source, data)) {
+      std::cout << "ERROR::PACK::FILE_NOT_SUCCESSFULLY_READ: " << files[i].source << std::endl;
+      return 1;
+    }
+
+    compressed.clear();
+    if (!store && !data.empty()) {
+      LZ4Block::compress(data.data(), data.size(), compressed);
+    }
+    bool useCompressed = !compressed.empty() && compressed.size() <= data.size() * PACK_MIN_SAVING;
+    const std::vector<uint8_t>& stored = useCompressed ? compressed : data;
+
+    pad(blobs, ARCHIVE_ALIGNMENT);
+    entries[i].compression = useCompressed ? ARCHIVE_LZ4 : ARCHIVE_STORED;
+    entries[i].offset = blobStart + blobs.size();
+    entries[i].storedSize = stored.size();
+    entries[i].size = data.size();
+    blobs.insert(blobs.end(), stored.begin(), stored.end());
+
+    totalSize += data.size();
+    compressedCount += useCompressed;
+  }
+
+  ArchiveHeader header;
+  memcpy(header.magic, ARCHIVE_MAGIC, 4);
+  header.version = ARCHIVE_VERSION;
+  header.entryCount = (uint32_t)entries.size();
+  header.stringTableSize = (uint32_t)strings.size();
+
+  std::ofstream file(output, std::ios::binary);
+  file.write((const char*)&header, sizeof(header));
+  file.write((const char*)entries.data(), entries.size() * sizeof(ArchiveEntry));
+  file.write(strings.data(), strings.size());
+  std::vector<char> padding(blobStart - tableSize, 0);
+  file.write(padding.data(), padding.size());
+  file.write((const char*)blobs.data(), blobs.size());
+  file.close();
+
+  if (!file) {
+    std::cout << "ERROR::PACK::FILE_NOT_SUCCESSFULLY_WRITTEN: " << output << std::endl;
+    return 1;
+  }
+
+  std::cout << "NEPTUNE::INFO: Packed " << entries.size() << " files (" << compressedCount << " LZ4 compressed), "
+            << totalSize << " -> " << blobStart + blobs.size() << " bytes into " << output << std::endl;
+  return 0;
+}
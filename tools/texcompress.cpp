@@ -0,0 +1,122 @@
+/*
+ * tools/texcompress.cpp
+ *
+ * Offline texture compression. Converts PNG/JPG (anything stb_image reads)
+ * into block compressed DDS files with a full, gamma correct mip chain (see
+ * include/mipgen.h), so nothing is generated at load time. Texture picks up
+ * <image>.dds automatically when it is at least as new as the image.
+ *
+ * Build: g++ -std=c++17 -O2 -mavx2 -Iinclude tools/texcompress.cpp -lassimp -pthread -o texcompress
+ *        (drop -mavx2 for CPUs without it; the SSE kernel is used instead)
+ * Usage: ./texcompress [options] [--model <model>] [image...]
+ *
+ *   --format bc1|bc3|bc4|bc5|bc7|rgba8  Output format. Without it, opaque
+ *                                       images become BC1 and images with alpha BC3.
+ *   --srgb                              Tag the output as sRGB for the sampler
+ *   --linear                            The image is data, not sRGB colour (specular, masks)
+ *   --normal                            The image is a normal map; renormalised per level
+ *   --alpha-cutoff <value>              Keep the alpha test coverage at this cutoff in every level
+ *   --model <model>                     Compress every texture the model's materials reference
+ */
+
+#include <chrono>
+
+#include <importer.h>
+#include <texcompress.h>
+
+static bool parseFormat(const std::string& name, enum TextureCompression& compression) {
+  const char* names[] = { "bc1", "bc3", "bc4", "bc5", "bc7", "rgba8" };
+  for (int i = 0; i < 6; ++i) {
+    if (name == names[i]) {
+      compression = (enum TextureCompression)i;
+      return true;
+    }
+  }
+  return false;
+}
+
+static bool compressImage(const std::string& path, bool forceFormat, enum TextureCompression compression, bool srgb, const MipOptions& mipOptions) {
+  auto start = std::chrono::steady_clock::now();
+
+  /* Decoded flipped, as Texture does, so the stored rows go up in the same order */
+  DecodedImage image;
+  if (!image.load(path.c_str(), 4)) {
+    return false;
+  }
+  uint32_t width = image.width;
+  uint32_t height = image.height;
+
+  if (!forceFormat) {
+    bool opaque = true;
+    for (size_t i = 0; i < (size_t)width * height && opaque; ++i) {
+      opaque = image.pixels[i * 4 + 3] == 255;
+    }
+    compression = opaque ? TEXTURE_BC1 : TEXTURE_BC3;
+  }
+
+  MipChain chain = MipGenerator::build(image.pixels, width, height, mipOptions);
+  std::vector<std::vector<uint8_t>> levels;
+  size_t compressedBytes = 0;
+  for (size_t i = 0; i < chain.levels.size(); ++i) {
+    levels.push_back(BlockEncoder::compress(chain.levels[i].data(), chain.widths[i], chain.heights[i], compression));
+    compressedBytes += levels.back().size();
+  }
+
+  std::string output = path + ".dds";
+  if (!writeDDS(output, ddsFormat(compression, srgb), width, height, levels)) {
+    std::cout << "ERROR::TEXCOMPRESS::CANNOT_WRITE: " << output << std::endl;
+    return false;
+  }
+
+  double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  size_t uncompressedBytes = (size_t)width * height * 4 * 4 / 3;
+  std::cout << "NEPTUNE::INFO: " << path << " -> " << output << " (" << width << "x" << height << ", " << levels.size() << " levels, "
+            << compressedBytes / 1024 << " KiB vs " << uncompressedBytes / 1024 << " KiB, " << milliseconds << " ms)" << std::endl;
+  return true;
+}
+
+int main(int argc, char** argv) {
+  enum TextureCompression compression = TEXTURE_BC1;
+  bool forceFormat = false;
+  bool srgb = false;
+  MipOptions mipOptions;
+  std::vector<std::string> images;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string argument = argv[i];
+    if (argument == "--format" && i + 1 < argc) {
+      if (!parseFormat(argv[++i], compression)) {
+        std::cout << "ERROR::TEXCOMPRESS::UNKNOWN_FORMAT: " << argv[i] << std::endl;
+        return 1;
+      }
+      forceFormat = true;
+    } else if (argument == "--srgb") {
+      srgb = true;
+    } else if (argument == "--linear") {
+      mipOptions.srgb = false;
+    } else if (argument == "--normal") {
+      mipOptions.normalMap = true;
+    } else if (argument == "--alpha-cutoff" && i + 1 < argc) {
+      mipOptions.alphaCutoff = std::stof(argv[++i]);
+    } else if (argument == "--model" && i + 1 < argc) {
+      ImportedModel model;
+      if (!importModel(argv[++i], model, false)) {
+        return 1;
+      }
+      images.insert(images.end(), model.imagePaths.begin(), model.imagePaths.end());
+    } else {
+      images.push_back(argument);
+    }
+  }
+
+  if (images.empty()) {
+    std::cout << "Usage: " << argv[0] << " [--format bc1|bc3|bc4|bc5|bc7|rgba8] [--srgb] [--linear] [--normal] [--alpha-cutoff <value>] [--model <model>] [image...]" << std::endl;
+    return 1;
+  }
+
+  bool succeeded = true;
+  for (const std::string& image : images) {
+    succeeded &= compressImage(image, forceFormat, compression, srgb, mipOptions);
+  }
+  return succeeded ? 0 : 1;
+}